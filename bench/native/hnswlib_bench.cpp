@@ -0,0 +1,273 @@
+// Native benchmark of the hnswlib headers, built with `make native-bench`.
+// It runs the same workloads as the wasm benches (uniform random vectors,
+// the hnswParamsForAda parameters) so the hot path can be profiled with perf,
+// VTune or the sanitizers before it goes through Emscripten.
+//
+//   ./build/native/hnswlib_bench [--points 10000] [--queries 200] [--dim 1538]
+//       [--m 32] [--ef-construction 128] [--k 8] [--ef 8,16,32,64,128,256]
+//       [--threads 1] [--seed 100] [--sections distance,build,search,persist]
+
+#include "hnswlib.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+struct Options {
+    size_t points = 10000;
+    size_t queries = 200;
+    size_t dim = 1538;
+    size_t m = 32;
+    size_t ef_construction = 128;
+    size_t k = 8;
+    std::vector<size_t> ef = {8, 16, 32, 64, 128, 256};
+    size_t threads = 1;
+    size_t seed = 100;
+    std::unordered_set<std::string> sections = {"distance", "build", "search", "persist"};
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::vector<std::string> split(const std::string &value) {
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [--points N] [--queries N] [--dim N] [--m N] [--ef-construction N] [--k N]\n"
+            "          [--ef N,N,...] [--threads N] [--seed N] [--sections distance,build,search,persist]\n",
+            program);
+    exit(1);
+}
+
+Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        std::string value = argv[++i];
+        if (name == "--points") {
+            options.points = std::stoul(value);
+        } else if (name == "--queries") {
+            options.queries = std::stoul(value);
+        } else if (name == "--dim") {
+            options.dim = std::stoul(value);
+        } else if (name == "--m") {
+            options.m = std::stoul(value);
+        } else if (name == "--ef-construction") {
+            options.ef_construction = std::stoul(value);
+        } else if (name == "--k") {
+            options.k = std::stoul(value);
+        } else if (name == "--ef") {
+            options.ef.clear();
+            for (const std::string &ef : split(value))
+                options.ef.push_back(std::stoul(ef));
+        } else if (name == "--threads") {
+            options.threads = std::stoul(value);
+        } else if (name == "--seed") {
+            options.seed = std::stoul(value);
+        } else if (name == "--sections") {
+            options.sections.clear();
+            for (const std::string &section : split(value))
+                options.sections.insert(section);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (options.points == 0 || options.dim == 0 || options.k == 0 || options.k > options.points)
+        usage(argv[0]);
+    return options;
+}
+
+// uniform in [0, 1) like createVectorData in test/testHelpers.ts
+std::vector<float> randomVectors(size_t count, size_t dim, std::mt19937 &generator) {
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    std::vector<float> vectors(count * dim);
+    for (float &value : vectors)
+        value = distribution(generator);
+    return vectors;
+}
+
+double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    size_t position = std::min(values.size() - 1, (size_t) (p * values.size()));
+    return values[position];
+}
+
+// keeps the compiler from dropping the benchmarked calls
+volatile float sink;
+
+void benchDistance(const Options &options) {
+    printf("\n== distance kernels ==\n");
+    printf("%6s %8s %14s %10s\n", "dim", "space", "Mdist/s", "GB/s");
+    std::mt19937 generator(options.seed);
+    const size_t dims[] = {16, 64, 128, 256, 384, 768, 1536, options.dim};
+    const size_t vectors = 1024;
+    for (size_t dim : dims) {
+        std::vector<float> data = randomVectors(vectors, dim, generator);
+        hnswlib::L2Space l2(dim);
+        hnswlib::InnerProductSpace ip(dim);
+        hnswlib::SpaceInterface<float> *spaces[] = {&l2, &ip};
+        const char *names[] = {"l2", "ip"};
+        for (int s = 0; s < 2; s++) {
+            hnswlib::DISTFUNC<float> distance = spaces[s]->get_dist_func();
+            void *param = spaces[s]->get_dist_func_param();
+            // about 2^26 multiply-adds per measurement
+            size_t rounds = std::max((size_t) 1, ((size_t) 1 << 26) / (dim * vectors));
+            float sum = 0;
+            Clock::time_point start = Clock::now();
+            for (size_t r = 0; r < rounds; r++) {
+                const float *query = data.data() + (r % vectors) * dim;
+                for (size_t i = 0; i < vectors; i++)
+                    sum += distance(query, data.data() + i * dim, param);
+            }
+            double seconds = secondsSince(start);
+            sink = sum;
+            double computations = (double) rounds * vectors;
+            printf("%6zu %8s %14.2f %10.2f\n", dim, names[s], computations / seconds / 1e6,
+                   computations * dim * sizeof(float) / seconds / 1e9);
+        }
+    }
+}
+
+hnswlib::HierarchicalNSW<float> *benchBuild(const Options &options, hnswlib::SpaceInterface<float> &space,
+                                            const std::vector<float> &data) {
+    // the index built with addPoint is the one searched and saved
+    printf("\n== build (%zu points, dim %zu, M %zu, efConstruction %zu) ==\n",
+           options.points, options.dim, options.m, options.ef_construction);
+    printf("%-16s %10s %12s\n", "method", "seconds", "points/s");
+    std::vector<hnswlib::labeltype> labels(options.points);
+    for (size_t i = 0; i < options.points; i++)
+        labels[i] = i;
+
+    hnswlib::HierarchicalNSW<float> *index = new hnswlib::HierarchicalNSW<float>(
+        &space, options.points, options.m, options.ef_construction, options.seed);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < options.points; i++)
+        index->addPoint(data.data() + i * options.dim, labels[i]);
+    double seconds = secondsSince(start);
+    printf("%-16s %10.3f %12.1f\n", "addPoint", seconds, options.points / seconds);
+    if (!options.sections.count("build"))
+        return index;
+
+    {
+        hnswlib::HierarchicalNSW<float> batch(&space, options.points, options.m, options.ef_construction, options.seed);
+        start = Clock::now();
+        batch.buildFromBatch(data.data(), labels.data(), options.points, options.threads);
+        seconds = secondsSince(start);
+        printf("%-16s %10.3f %12.1f\n", "buildFromBatch", seconds, options.points / seconds);
+    }
+    {
+        hnswlib::HierarchicalNSW<float> offline(&space, options.points, options.m, options.ef_construction, options.seed);
+        hnswlib::NNDescentBuilder<float> builder;
+        start = Clock::now();
+        builder.build(offline, data.data(), labels.data(), options.points, options.threads);
+        seconds = secondsSince(start);
+        printf("%-16s %10.3f %12.1f\n", "nnDescent", seconds, options.points / seconds);
+    }
+    return index;
+}
+
+void benchSearch(const Options &options, hnswlib::SpaceInterface<float> &space, const std::vector<float> &data,
+                 hnswlib::HierarchicalNSW<float> &index) {
+    std::mt19937 generator(options.seed + 1);
+    std::vector<float> queries = randomVectors(options.queries, options.dim, generator);
+
+    hnswlib::BruteforceSearch<float> exact(&space, options.points);
+    for (size_t i = 0; i < options.points; i++)
+        exact.addPoint(data.data() + i * options.dim, i);
+    std::vector<std::unordered_set<hnswlib::labeltype>> truth(options.queries);
+    Clock::time_point start = Clock::now();
+    for (size_t q = 0; q < options.queries; q++) {
+        auto result = exact.searchKnn(queries.data() + q * options.dim, options.k);
+        while (!result.empty()) {
+            truth[q].insert(result.top().second);
+            result.pop();
+        }
+    }
+    double exact_seconds = secondsSince(start);
+
+    printf("\n== search (%zu queries, k %zu) ==\n", options.queries, options.k);
+    printf("%-10s %10s %10s %10s %10s %12s\n", "ef", "recall", "p50 us", "p99 us", "QPS", "dist/query");
+    printf("%-10s %10.4f %10s %10s %10.1f %12zu\n", "bruteforce", 1.0, "-", "-", options.queries / exact_seconds, options.points);
+    for (size_t ef : options.ef) {
+        index.setEf(ef);
+        std::vector<double> latencies;
+        latencies.reserve(options.queries);
+        size_t hits = 0;
+        long distances_before = index.metric_distance_computations;
+        start = Clock::now();
+        for (size_t q = 0; q < options.queries; q++) {
+            Clock::time_point query_start = Clock::now();
+            auto result = index.searchKnn(queries.data() + q * options.dim, options.k);
+            latencies.push_back(secondsSince(query_start) * 1e6);
+            while (!result.empty()) {
+                hits += truth[q].count(result.top().second);
+                result.pop();
+            }
+        }
+        double seconds = secondsSince(start);
+        long distances = index.metric_distance_computations - distances_before;
+        printf("%-10zu %10.4f %10.1f %10.1f %10.1f %12.1f\n", ef, (double) hits / (options.queries * options.k),
+               percentile(latencies, 0.5), percentile(latencies, 0.99), options.queries / seconds,
+               (double) distances / options.queries);
+    }
+}
+
+void benchPersist(hnswlib::SpaceInterface<float> &space, hnswlib::HierarchicalNSW<float> &index) {
+    printf("\n== save / load ==\n");
+    printf("%-8s %10s %10s %10s\n", "step", "seconds", "MB", "MB/s");
+    Clock::time_point start = Clock::now();
+    std::vector<char> buffer = index.saveIndexToBuffer();
+    double seconds = secondsSince(start);
+    double megabytes = buffer.size() / 1e6;
+    printf("%-8s %10.3f %10.1f %10.1f\n", "save", seconds, megabytes, megabytes / seconds);
+
+    hnswlib::HierarchicalNSW<float> loaded(&space);
+    start = Clock::now();
+    loaded.loadIndexFromBuffer(buffer, &space);
+    seconds = secondsSince(start);
+    printf("%-8s %10.3f %10.1f %10.1f\n", "load", seconds, megabytes, megabytes / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options options = parseOptions(argc, argv);
+
+    if (options.sections.count("distance"))
+        benchDistance(options);
+
+    bool needs_index = options.sections.count("build") || options.sections.count("search") || options.sections.count("persist");
+    if (!needs_index)
+        return 0;
+
+    std::mt19937 generator(options.seed);
+    std::vector<float> data = randomVectors(options.points, options.dim, generator);
+    hnswlib::L2Space space(options.dim);
+    hnswlib::HierarchicalNSW<float> *index = benchBuild(options, space, data);
+    if (options.sections.count("search"))
+        benchSearch(options, space, data, *index);
+    if (options.sections.count("persist"))
+        benchPersist(space, *index);
+    delete index;
+    return 0;
+}
@@ -44,11 +44,145 @@ export interface SearchResult {
   distances: number[];
   /** The indices of the nearest neighbors found. */
   neighbors: number[];
+  /** The work done by the search, only set when search stats are enabled. */
+  stats?: QueryStats;
+}
+
+/** Result of a range search or a partition search, closest first. */
+export interface RangeSearchResult {
+  /** The distances of the data points found. */
+  distances: Float32Array;
+  /** The labels of the data points found. */
+  neighbors: Uint32Array;
+}
+
+/**
+ * How `searchDocuments` scores a document from the similarities of its chunks, the similarity being 1 / (1 + distance)
+ * for `l2`, (1 + cosine similarity) / 2 for `cosine` and the logistic function of the inner product for `ip`, all
+ * non-negative so more close chunks never lower a score. `max`: the best chunk. `sum`: the sum of the `topN` best
+ * chunks found.
+ * `maxsim`: the sum over the query vectors of the best chunk for each, computed exactly over all chunks of the
+ * documents found.
+ */
+export type DocumentAggregation = 'max' | 'sum' | 'maxsim';
+
+/**
+ * How `hybridSearch` fuses the dense and sparse rankings. `rrf`: reciprocal rank fusion, a data point scores
+ * weight / (60 + rank) in each ranking. `weighted`: the weighted sum of the scores of each ranking, min-max normalized.
+ */
+export type FusionMethod = 'rrf' | 'weighted';
+
+/** Result of a sparse or hybrid search, best first. */
+export interface HybridSearchResult {
+  /** The labels of the data points found. */
+  neighbors: Uint32Array;
+  /** The scores of the data points found, higher is closer. */
+  scores: Float32Array;
+}
+
+/** Result of a document search, best first. */
+export interface DocumentSearchResult {
+  /** The documents found. */
+  documents: Uint32Array;
+  /** The scores of the documents found, higher is closer. */
+  scores: Float32Array;
+}
+
+/** Counters of the `searchKnn` result cache. */
+export interface QueryCacheStats {
+  /** The number of searches answered from the cache. */
+  hits: number;
+  /** The number of cacheable searches that were run. */
+  misses: number;
+  /** The number of cached results. */
+  entries: number;
+  /** The number of changes of the index, each of them empties the cache. */
+  generation: number;
+}
+
+/** Work done by a single search. */
+export interface QueryStats {
+  /** The effective size of the dynamic candidate list. */
+  ef: number;
+  /** The number of expanded nodes over all levels. */
+  hops: number;
+  /** The number of expanded nodes per level, index 0 is the base layer. */
+  levelHops: number[];
+  /** The number of distance computations. */
+  distanceComputations: number;
+  /** The number of data points reached on the base layer. */
+  visited: number;
+  /** The number of candidates rejected by the filter function. */
+  filterRejections: number;
+  /** The number of candidates skipped because they are marked as deleted. */
+  deletedSkips: number;
+  /** Whether adaptive early termination ended the search. */
+  stoppedEarly: boolean;
+  /** The elapsed time of the search in milliseconds. */
+  elapsedMs: number;
+}
+
+/**
+ * Search stats aggregated since the last reset.
+ * Histogram bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i), latency is bucketed in microseconds.
+ */
+export interface SearchStats {
+  /** The number of searches recorded. */
+  queries: number;
+  /** The total number of expanded nodes. */
+  hops: number;
+  /** The total number of distance computations. */
+  distanceComputations: number;
+  /** The total number of data points reached on the base layer. */
+  visited: number;
+  /** The total number of candidates rejected by filter functions. */
+  filterRejections: number;
+  /** The total number of candidates skipped because they are marked as deleted. */
+  deletedSkips: number;
+  /** The number of searches ended by adaptive early termination. */
+  stoppedEarly: number;
+  /** The total elapsed time in milliseconds. */
+  elapsedMs: number;
+  /** The elapsed time of the slowest search in milliseconds. */
+  maxElapsedMs: number;
+  /** The histogram of elapsed times in microseconds. */
+  latencyHistogram: number[];
+  /** The histogram of expanded nodes per search. */
+  hopsHistogram: number[];
+  /** The histogram of distance computations per search. */
+  distanceComputationsHistogram: number[];
 }
 
 /** Function for filtering elements by its labels. */
 export type FilterFunction = (label: number) => boolean;
 
+/**
+ * Filter of a search: a function called with each label, or the array of allowed labels.
+ * With an array the index knows how selective the filter is, and very selective filters are served by an exact scan.
+ */
+export type SearchFilter = FilterFunction | number[] | Uint32Array;
+
+/**
+ * Condition on the attributes set with `setAttributes`: `and`, `or` and `not` of other predicates, numbers of an
+ * attribute in [min, max] (either bound may be left out), or any of the tags of an attribute. `not` matches the data
+ * points that have attributes but do not match its predicate.
+ */
+export type AttributePredicate =
+  | { and: AttributePredicate[] }
+  | { or: AttributePredicate[] }
+  | { not: AttributePredicate }
+  | { attribute: string; min?: number; max?: number }
+  | { attribute: string; tags: string | string[] };
+
+/**
+ * Filter of a `HierarchicalNSW` search: a `SearchFilter`, or an attribute predicate evaluated natively. The labels
+ * matching a predicate are cached until the attributes change, and their number is known like with an array.
+ */
+export type IndexFilter = SearchFilter | AttributePredicate;
+
+/** Attributes of a data point: numbers, or keyword tags as a string or an array of strings. */
+export type Attributes = Record<string, number | string | string[]>;
+
 /**
  * L2 space object.
  * @param {number} numDimensions The dimensionality of space.
@@ -157,6 +291,33 @@ export class BruteforceSearch {
     numNeighbors: number,
     filter: FilterFunction | undefined
   ): SearchResult;
+  /**
+   * returns the data points within the given distance of the query point, closest first.
+   * @param {number[]} queryPoint The query vector.
+   * @param {number} radius The maximum distance of the data points to return.
+   * @param {number} maxResults The maximum number of data points to return, the closest ones are kept.
+   * @param {FilterFunction | undefined} filter The function filters elements by its labels.
+   * @return {RangeSearchResult} The distances and labels of the data points found.
+   */
+  searchRange(
+    queryPoint: Float32Array | number[],
+    radius: number,
+    maxResults: number,
+    filter: FilterFunction | undefined
+  ): RangeSearchResult;
+  /**
+   * returns exact search results for several query points at once. The stored data points are scanned
+   * once per block of queries, which is faster than calling `searchKnn` for each query.
+   * @param {number[][]} queryPoints The query vectors.
+   * @param {number} numNeighbors The number of nearest neighbors to search for.
+   * @param {FilterFunction | undefined} filter The function filters elements by its labels.
+   * @return {SearchResult[]} The search result of each query point, in the same order.
+   */
+  searchKnnBatch(
+    queryPoints: VectorFloat[] | number[][],
+    numNeighbors: number,
+    filter: FilterFunction | undefined
+  ): SearchResult[];
   /**
    * returns the maximum number of data points that can be indexed.
    * @return {numbers} The maximum number of data points that can be indexed.
@@ -228,6 +389,27 @@ export class HierarchicalNSW {
    * @param {number} newMaxElements The new maximum number of data points.
    */
   resizeIndex(newMaxElements: number): void;
+  /**
+   * sets how the search index grows when items are added to a full index. With a factor above 1 the maximum number of
+   * elements is multiplied by it as needed, without moving the stored elements. With 0 (default), adding to a full index throws an error.
+   * Concurrent inserts wait for the growth; searches may run during the growth only with lock-free search enabled.
+   * @param {number} growthFactor The growth factor, 0 or greater than 1.
+   */
+  setGrowthFactor(growthFactor: number): void;
+  /**
+   * returns the growth factor.
+   * @return {number} The growth factor, 0 if the search index does not grow.
+   */
+  getGrowthFactor(): number;
+  /**
+   * physically removes the elements marked as deleted, repairs the graph around them and renumbers the remaining elements.
+   * Without `shrinkToFit` the freed memory is kept for the data points added later. The removed labels lose their
+   * document id, sparse vector and attributes, and `addItems` does not hand them out again.
+   * @param {boolean} shrinkToFit The flag to also reduce the maximum number of elements to the current count and
+   * release the freed memory.
+   * @return {number} The number of bytes released, 0 if `shrinkToFit` is false.
+   */
+  compact(shrinkToFit: boolean): number;
   /**
    * adds a datum point to the search index.
    * @param {VectorFloat | number[]} point The datum point to be added to the search index.
@@ -251,6 +433,33 @@ export class HierarchicalNSW {
    */
   addItems(items: VectorFloat[] | number[][], replaceDeleted?: boolean): VectorInt;
 
+  /**
+   * adds the initial data to an empty search index, faster than adding the items one by one. The neighbor lists that
+   * overflow are pruned once at the end instead of on every insertion. The search index must not be used until it returns.
+   * @param {VectorFloat | number[]} items The datum points stored one after another, `labels.length * dim` values.
+   * @param {VectorInt | number[]} labels The label of each datum point.
+   */
+  buildFromBatch(items: VectorFloat | number[], labels: VectorInt | number[]): void;
+  /**
+   * replaces the vectors of existing datum points, e.g. after re-embedding part of the corpus. The neighbor lists around
+   * the updated points are repaired once for the whole batch rather than once per point, so a neighbor shared by several
+   * updated points is repaired only once.
+   * @param {VectorInt | number[]} labels The labels of the datum points to update, all in the index and not deleted.
+   * @param {VectorFloat | number[]} items The new datum points stored one after another, `labels.length * dim` values.
+   * @param {number} repairProbability The probability that a neighbor of an updated point gets its links repaired, in
+   * the range [0, 1]. 1 repairs all of them like `addPoint` with an existing label does.
+   */
+  updateItems(labels: VectorInt | number[], items: VectorFloat | number[], repairProbability: number): void;
+  /**
+   * builds an empty search index offline, e.g. for a static snapshot. Every layer is linked from an approximate
+   * k-nearest-neighbor graph computed with NN-Descent and pruned with the same heuristic as the insertion. The result is
+   * a regular search index that can be saved with `writeIndexToBuffer` and extended with `addPoint`.
+   * @param {VectorFloat | number[]} items The datum points stored one after another, `labels.length * dim` values.
+   * @param {VectorInt | number[]} labels The label of each datum point, all different.
+   * @param {number} maxIterations The maximum number of NN-Descent iterations (e.g. 10).
+   */
+  buildOffline(items: VectorFloat | number[], labels: VectorInt | number[], maxIterations: number): void;
+
   // /**
   //  * adds a datum point to the search index.
   //  * @param {Float32Array[] | number[][]} items The datum array to be added to the search index.
@@ -283,14 +492,171 @@ export class HierarchicalNSW {
    * returns `numNeighbors` closest items for a given query point.
    * @param {VectorFloat | number[]} queryPoint The query point vector.
    * @param {number} numNeighbors The number of nearest neighbors to search for.
-   * @param {FilterFunction} filter The function filters elements by its labels.
+   * @param {IndexFilter} filter The function filters elements by its labels, the array of allowed labels, or an attribute predicate.
    * @return {SearchResult} The search result object consists of distances and indices of the nearest neighbors found.
    */
   searchKnn(
     queryPoint: VectorFloat | number[],
     numNeighbors: number,
-    filter?: FilterFunction | undefined
+    filter?: IndexFilter | undefined
   ): SearchResult;
+  /**
+   * sets the number of `searchKnn` results kept in a least recently used cache, 0 (the default) disables it. A result
+   * is reused for the same query, `numNeighbors`, `efSearch` and filter. Searches with a filter function, and all
+   * searches while search stats are enabled, are not cached. Every change of the index empties the cache.
+   * @param {number} capacity The maximum number of cached results.
+   */
+  setQueryCacheSize(capacity: number): void;
+  /**
+   * returns the maximum number of cached `searchKnn` results.
+   * @return {number} The capacity of the cache, 0 when disabled.
+   */
+  getQueryCacheSize(): number;
+  /**
+   * returns the counters of the `searchKnn` result cache.
+   * @return {QueryCacheStats} The hits, misses, entries and generation of the cache.
+   */
+  getQueryCacheStats(): QueryCacheStats;
+  /**
+   * resets the hit and miss counters of the `searchKnn` result cache.
+   */
+  resetQueryCacheStats(): void;
+  /**
+   * returns the data points within the given distance of the query point, closest first.
+   * @param {number[]} queryPoint The query vector.
+   * @param {number} radius The maximum distance of the data points to return.
+   * @param {number} maxResults The maximum number of data points to return, the closest ones are kept.
+   * @param {IndexFilter | undefined} filter The function filters elements by its labels, the array of allowed labels, or an attribute predicate.
+   * @return {RangeSearchResult} The distances and labels of the data points found.
+   */
+  searchRange(
+    queryPoint: VectorFloat | number[],
+    radius: number,
+    maxResults: number,
+    filter: IndexFilter | undefined
+  ): RangeSearchResult;
+  /**
+   * returns diverse nearest neighbors by maximal marginal relevance (MMR). The `fetchK` nearest neighbors are found
+   * first, then picked one at a time, each pick being the candidate with the highest
+   * `lambda * sim(query, candidate) - (1 - lambda) * max sim(candidate, picked)`, with sim = -distance.
+   * @param {VectorFloat | number[]} queryPoint The query point vector.
+   * @param {number} numNeighbors The number of neighbors to return.
+   * @param {number} fetchK The number of nearest neighbors to pick from.
+   * @param {number} lambda The weight of relevance against diversity in [0, 1], 1 gives the plain k-NN order.
+   * @param {IndexFilter | undefined} filter The filter, see `searchKnn`, or undefined.
+   * @return {RangeSearchResult} The neighbors in the order picked, with their distances to the query.
+   */
+  searchKnnDiverse(
+    queryPoint: VectorFloat | number[],
+    numNeighbors: number,
+    fetchK: number,
+    lambda: number,
+    filter: IndexFilter | undefined
+  ): RangeSearchResult;
+  /**
+   * sets the sparse vector of a data point, e.g. its BM25 or learned term weights, replacing the one it had. The
+   * sparse vectors share the labels of the dense ones and are saved with the index by `writeIndexToBuffer`.
+   * @param {VectorInt | number[]} terms The term ids.
+   * @param {VectorFloat | number[]} weights The weight of each term, must be non-negative.
+   * @param {number} label The label of the data point.
+   */
+  addSparsePoint(terms: VectorInt | number[], weights: VectorFloat | number[], label: number): void;
+  /**
+   * removes the sparse vector of a data point.
+   * @param {number} label The label of the data point.
+   * @return {boolean} Whether the data point had a sparse vector.
+   */
+  removeSparsePoint(label: number): boolean;
+  /**
+   * returns the number of data points with a sparse vector.
+   * @return {number} The number of sparse vectors.
+   */
+  getSparseCount(): number;
+  /**
+   * returns the data points with the highest sparse scores, the sum of query weight * point weight over the shared
+   * terms. Only data points in the dense index and not marked as deleted are returned.
+   * @param {VectorInt | number[]} terms The query term ids.
+   * @param {VectorFloat | number[]} weights The query term weights, must be non-negative.
+   * @param {number} numNeighbors The number of results.
+   * @param {IndexFilter | undefined} filter The filter, see `searchKnn`, or undefined.
+   * @return {HybridSearchResult} The data points found, highest score first.
+   */
+  searchSparse(
+    terms: VectorInt | number[],
+    weights: VectorFloat | number[],
+    numNeighbors: number,
+    filter: IndexFilter | undefined
+  ): HybridSearchResult;
+  /**
+   * searches the dense and the sparse vectors and fuses both rankings. Each ranking holds up to `max(numNeighbors,
+   * efSearch)` data points.
+   * @param {VectorFloat | number[]} queryPoint The dense query vector.
+   * @param {VectorInt | number[]} terms The sparse query term ids.
+   * @param {VectorFloat | number[]} weights The sparse query term weights.
+   * @param {number} numNeighbors The number of results.
+   * @param {FusionMethod} fusion How the rankings are fused.
+   * @param {number} denseWeight The weight of the dense ranking in [0, 1], the sparse ranking gets the rest.
+   * @param {IndexFilter | undefined} filter The filter, see `searchKnn`, or undefined.
+   * @return {HybridSearchResult} The data points found, highest fused score first.
+   */
+  hybridSearch(
+    queryPoint: VectorFloat | number[],
+    terms: VectorInt | number[],
+    weights: VectorFloat | number[],
+    numNeighbors: number,
+    fusion: FusionMethod,
+    denseWeight: number,
+    filter: IndexFilter | undefined
+  ): HybridSearchResult;
+  /**
+   * sets the attributes of a data point for filtering searches with attribute predicates, replacing the ones it had.
+   * An attribute holds either numbers or tags, fixed by its first value. If any attribute is invalid the data point
+   * keeps the attributes it had. The attributes are saved with the index by `writeIndexToBuffer`.
+   * @param {number} label The label of the data point.
+   * @param {Attributes} attributes The attributes by name.
+   */
+  setAttributes(label: number, attributes: Attributes): void;
+  /**
+   * removes the attributes of a data point.
+   * @param {number} label The label of the data point.
+   */
+  removeAttributes(label: number): void;
+  /**
+   * returns the attributes of a data point, tags as arrays.
+   * @param {number} label The label of the data point.
+   * @return {Attributes | undefined} The attributes, or undefined if it has none.
+   */
+  getAttributes(label: number): Attributes | undefined;
+  /**
+   * assigns data points to documents for `searchDocuments`, e.g. the chunks of a chunked document. A label belongs to
+   * at most one document, assigning it again moves it. The assignment is kept in memory only, it is not saved with the
+   * index and is cleared by `initIndex` and `readIndexFromBuffer`.
+   * @param {VectorInt | number[]} labels The labels of the data points.
+   * @param {VectorInt | number[]} documentIds The document of each data point.
+   */
+  setDocumentIds(labels: VectorInt | number[], documentIds: VectorInt | number[]): void;
+  /**
+   * returns the document of a data point.
+   * @param {number} label The label of the data point.
+   * @return {number | undefined} The document set with `setDocumentIds`, or undefined.
+   */
+  getDocumentId(label: number): number | undefined;
+  /**
+   * returns the documents closest to the query, grouping the data points by document while searching. The search
+   * keeps expanding until `numDocuments` distinct documents are found, so no over-fetching is needed. Data points
+   * without a document are not considered.
+   * @param {VectorFloat[] | number[][]} queryPoints The query vectors, more than one only for `maxsim`.
+   * @param {number} numDocuments The number of documents to return.
+   * @param {DocumentAggregation} aggregation How the chunk similarities make the document score.
+   * @param {number} topN The number of best chunks summed by `sum`, ignored otherwise.
+   * @return {DocumentSearchResult} The documents found, best first.
+   */
+  searchDocuments(
+    queryPoints: VectorFloat[] | number[][],
+    numDocuments: number,
+    aggregation: DocumentAggregation,
+    topN: number
+  ): DocumentSearchResult;
   /**
    * returns a list of all used labels
    * @return {VectorInt} The list of indices.
@@ -302,7 +668,22 @@ export class HierarchicalNSW {
    */
   getDeletedLabels(): VectorInt;
   /**
-   * returns the datum point vector specified by label.
+   * returns a view of all used labels without copying. The view points into the module memory, which any call into
+   * the module may grow and thereby detach the view, so consume it before the next call into the module or copy it
+   * with `slice()`.
+   * @return {Uint32Array} The list of indices.
+   */
+  getUsedLabelsView(): Uint32Array;
+  /**
+   * returns a view of all deleted labels without copying. The view points into the module memory, which any call into
+   * the module may grow and thereby detach the view, so consume it before the next call into the module or copy it
+   * with `slice()`.
+   * @return {Uint32Array} The list of indices.
+   */
+  getDeletedLabelsView(): Uint32Array;
+  /**
+   * returns the datum point vector specified by label. Cosine indexes return the vector as it was added,
+   * except for indexes saved by older versions, which stored it normalized.
    * @param {number} label The index of the datum point.
    * @return {number[]} The datum point vector.
    */
@@ -332,6 +713,178 @@ export class HierarchicalNSW {
    * @param {number} ef The size of the dynamic list for the nearest neighbors.
    */
   setEfSearch(ef: number): void;
+  /**
+   * returns the patience of the adaptive early termination (0 means disabled).
+   * @return {number} The number of expansions without improving the top-k after which a search stops.
+   */
+  getEarlyStopPatience(): number;
+  /**
+   * sets the patience of the adaptive early termination. A search stops once its top-k has not improved
+   * for the given number of expansions, even if the `ef` candidates have not been collected yet.
+   * @param {number} patience The number of expansions without improvement, or 0 to disable early termination.
+   */
+  setEarlyStopPatience(patience: number): void;
+  /**
+   * picks and sets the smallest early termination patience that keeps the given fraction of the top-k found
+   * by the full `ef` search, measured on a sample of the indexed data points searched for their neighbors other
+   * than themselves.
+   * @param {number} targetRecall The fraction of the full search results to keep, in the range (0, 1].
+   * @param {number} k The number of nearest neighbors the searches will ask for.
+   * @return {number} The chosen patience, or 0 if early termination cannot reach the target recall or `k` is not
+   * smaller than `ef`.
+   */
+  tuneEarlyStopPatience(targetRecall: number, k: number): number;
+  /**
+   * sets how filtered searches pick their strategy from the estimated fraction of elements the filter allows.
+   * Below `bruteForceSelectivity` the allowed elements are scanned exactly, below `twoHopSelectivity` the graph
+   * is traversed through allowed elements only, bridging rejected neighbors by their own neighbors. The fraction is
+   * exact for label and attribute filters; filter functions are sampled, and pick the exact scan only when the
+   * upper end of the 95% confidence interval of their estimate is below `bruteForceSelectivity`.
+   * @param {number} bruteForceSelectivity The selectivity below which an exact scan is used (default: 0.02).
+   * @param {number} twoHopSelectivity The selectivity below which the two-hop traversal is used (default: 0.2).
+   */
+  setFilterSelectivityThresholds(bruteForceSelectivity: number, twoHopSelectivity: number): void;
+  /**
+   * returns whether lock-free search is enabled.
+   * @return {boolean} True if searches run without locks while points are added, updated or deleted.
+   */
+  getLockFreeSearch(): boolean;
+  /**
+   * enables or disables lock-free search. When enabled, searches on other threads (pthread builds) keep running
+   * against a consistent view of the graph while `addItems`, `addPoint` or `markDelete` modify it, at the cost of
+   * a version check per visited element. `buildFromBatch` and loading still need exclusive access, `compact` waits for the running operations.
+   * @param {boolean} enabled Whether searches run without locks (default: false).
+   */
+  setLockFreeSearch(enabled: boolean): void;
+  /**
+   * returns whether searches collect stats.
+   * @return {boolean} True if `searchKnn` reports and aggregates search stats.
+   */
+  getSearchStatsEnabled(): boolean;
+  /**
+   * enables or disables collecting stats. When enabled, `searchKnn` sets the `stats` field of its result
+   * and adds it to the aggregate returned by `getSearchStats`.
+   * @param {boolean} enabled Whether to collect search stats.
+   */
+  setSearchStatsEnabled(enabled: boolean): void;
+  /**
+   * returns the search stats aggregated since the last reset.
+   * @return {SearchStats} The aggregated search stats.
+   */
+  getSearchStats(): SearchStats;
+  /**
+   * clears the aggregated search stats.
+   */
+  resetSearchStats(): void;
+}
+
+/**
+ * Container for many small search indexes, e.g. one per tenant, addressed by a partition key.
+ * A partition is searched by brute force until it holds `promoteThreshold` data points, then it is
+ * rebuilt as a Hierarchical NSW graph. The graphs share their working buffers, so idle partitions are cheap.
+ * Partitions are created by their first `addPoint` and labels only have to be unique within a partition.
+ *
+ * ```typescript
+ * index = new PartitionedIndex('l2', 3);
+ * index.initIndex(1000, 16, 200, 100);
+ *
+ * index.addPoint(7, [0, 1, 2], 0);
+ * index.addPoint(7, [1, 2, 3], 1);
+ * index.addPoint(8, [0, 1, 2], 0);
+ *
+ * const result = index.searchKnn(7, [1, 2, 2], 1, undefined);
+ * ```
+ */
+export class PartitionedIndex {
+  /**
+   * @param {SpaceName} spaceName The metric space to create for the index ('l2', 'ip', or 'cosine').
+   * @param {number} numDimensions The dimensionality of data points.
+   */
+  constructor(spaceName: SpaceName, numDimensions: number);
+  /**
+   * initializes an empty container.
+   * @param {number} promoteThreshold The number of data points at which a partition switches from brute-force search to a graph.
+   * @param {number} m The maximum number of outgoing connections on the graphs (default: 16).
+   * @param {number} efConstruction The parameter that controls speed/accuracy trade-off during the graph construction (default: 200).
+   * @param {number} randomSeed The seed value of random number generator (default: 100).
+   */
+  initIndex(promoteThreshold: number, m: number, efConstruction: number, randomSeed: number): void;
+  /** is index initialized */
+  isIndexInitialized(): boolean;
+  /**
+   * adds a datum point to a partition, creating the partition if it does not exist. Updates the point if the label is already used in the partition.
+   * @param {number} partition The partition key.
+   * @param {Float32Array | number[]} point The datum point to be added.
+   * @param {number} label The label of the datum point, unique within the partition.
+   */
+  addPoint(partition: number, point: Float32Array | number[], label: number): void;
+  /**
+   * removes the datum point from a partition.
+   * @param {number} partition The partition key.
+   * @param {number} label The label of the datum point to be removed.
+   */
+  removePoint(partition: number, label: number): void;
+  /**
+   * returns `numNeighbors` closest items of a partition for a given query point. The result is empty if the partition does not exist.
+   * @param {number} partition The partition key.
+   * @param {Float32Array | number[]} queryPoint The query point vector.
+   * @param {number} numNeighbors The number of nearest neighbors to search for.
+   * @param {SearchFilter | undefined} filter The function filtering elements by their labels, or an array of the allowed labels.
+   * @return {RangeSearchResult} The distances and labels of the nearest neighbors found, closest first.
+   */
+  searchKnn(
+    partition: number,
+    queryPoint: Float32Array | number[],
+    numNeighbors: number,
+    filter: SearchFilter | undefined
+  ): RangeSearchResult;
+  /**
+   * removes a partition with all of its data points.
+   * @param {number} partition The partition key.
+   */
+  dropPartition(partition: number): void;
+  /**
+   * returns the number of partitions.
+   * @return {number} The number of partitions.
+   */
+  getNumPartitions(): number;
+  /**
+   * returns the keys of all partitions.
+   * @return {number[]} The partition keys.
+   */
+  getPartitionKeys(): number[];
+  /**
+   * returns the number of data points in a partition, 0 if it does not exist.
+   * @param {number} partition The partition key.
+   * @return {number} The number of data points.
+   */
+  getPartitionSize(partition: number): number;
+  /**
+   * returns whether the partition has been rebuilt as a graph.
+   * @param {number} partition The partition key.
+   * @return {boolean} true if the partition is searched with a graph.
+   */
+  isPartitionPromoted(partition: number): boolean;
+  /**
+   * returns the number of data points at which a partition is rebuilt as a graph.
+   * @return {number} The promote threshold.
+   */
+  getPromoteThreshold(): number;
+  /**
+   * returns the ef parameter used by the graph partitions.
+   * @return {number} The ef parameter value.
+   */
+  getEfSearch(): number;
+  /**
+   * sets the ef parameter of all graph partitions, current and future.
+   * @param {number} ef The ef parameter value.
+   */
+  setEfSearch(ef: number): void;
+  /**
+   * returns the dimensionality of data points.
+   * @return {number} The dimensionality of data points.
+   */
+  getNumDimensions(): number;
 }
 
 export class VectorFloat {
@@ -0,0 +1,473 @@
+#pragma once
+
+#include "label_filter.h"
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* Condition on the attributes of a label. RANGE matches the labels whose number in `column` is
+* within [min, max], TAGS those with any of `tags` in `column`. NOT matches the labels that have
+* attributes but do not match its single child.
+*/
+struct AttributePredicate {
+    enum Kind { AND, OR, NOT, RANGE, TAGS };
+
+    Kind kind{AND};
+    std::string column;
+    double min{0};
+    double max{0};
+    std::vector<std::string> tags;
+    std::vector<AttributePredicate> children;
+
+    /*
+    * Canonical text of the predicate, the same predicates give the same key.
+    */
+    std::string key() const {
+        std::ostringstream out;
+        out << std::setprecision(17);
+        auto quoted = [&](const std::string &text) { out << text.size() << ':' << text; };
+        switch (kind) {
+            case AND:
+            case OR:
+            case NOT:
+                out << (kind == AND ? "and(" : kind == OR ? "or(" : "not(");
+                for (size_t i = 0; i < children.size(); i++)
+                    out << (i ? "," : "") << children[i].key();
+                out << ')';
+                break;
+            case RANGE:
+                out << "range(";
+                quoted(column);
+                out << ',' << min << ',' << max << ')';
+                break;
+            case TAGS:
+                out << "tags(";
+                quoted(column);
+                for (const std::string &tag : tags) {
+                    out << ',';
+                    quoted(tag);
+                }
+                out << ')';
+                break;
+        }
+        return out.str();
+    }
+};
+
+
+/*
+* A value of one attribute of a label, numbers and tags as set with AttributeStore::setNumber and
+* AttributeStore::setTags.
+*/
+struct AttributeValue {
+    std::string name;
+    bool is_tags{false};
+    double number{0};
+    std::vector<std::string> tags;
+};
+
+
+/*
+* Columnar attributes of labels, for filtering searches natively. A column holds either numbers or
+* keyword tags, fixed by the first value set in it. Each label with attributes gets a compact row,
+* the rows of removed labels are reused, so the columns are sized by the number of labels and not
+* by their values. Number columns are stored densely by row and every tag has a bitmap of its rows,
+* so predicates are evaluated into a bitmap of rows by scans and bitwise operations. The bitmaps of
+* the predicates and their clauses are cached until the next change of the attributes.
+*
+* Every operation takes the store lock.
+*/
+class AttributeStore {
+    static const size_t MAX_CACHED_PREDICATES = 64;
+    typedef FlatHashMap<labeltype, uint32_t> RowMap;
+
+    struct Column {
+        bool is_tags{false};
+        // numbers by row, valid where present is set
+        std::vector<double> numbers;
+        LabelBitmap present;
+        std::unordered_map<std::string, LabelBitmap> tag_rows;
+        std::unordered_map<uint32_t, std::vector<std::string>> row_tags;
+    };
+
+    std::map<std::string, Column> columns_;
+    // the row of each label with attributes, copied on write while filters hold it
+    std::shared_ptr<RowMap> row_of_;
+    std::vector<labeltype> row_labels_;
+    std::vector<std::vector<std::string>> row_columns_;
+    std::vector<uint32_t> free_rows_;
+    LabelBitmap rows_;
+
+    std::unordered_map<std::string, std::shared_ptr<const LabelBitmap>> cache_;
+
+    mutable std::mutex lock_;
+
+    RowMap &mutableRowMap() {
+        if (row_of_.use_count() > 1)
+            row_of_ = std::make_shared<RowMap>(*row_of_);
+        return *row_of_;
+    }
+
+    bool findRow(labeltype label, uint32_t &row) const {
+        auto found = row_of_->find(label);
+        if (found == row_of_->end())
+            return false;
+        row = found->second;
+        return true;
+    }
+
+    uint32_t rowFor(labeltype label) {
+        uint32_t row;
+        if (findRow(label, row))
+            return row;
+        if (!free_rows_.empty()) {
+            row = free_rows_.back();
+            free_rows_.pop_back();
+            row_labels_[row] = label;
+        } else {
+            row = (uint32_t) row_labels_.size();
+            row_labels_.push_back(label);
+            row_columns_.emplace_back();
+        }
+        mutableRowMap()[label] = row;
+        rows_.set(row);
+        return row;
+    }
+
+    Column &columnFor(const std::string &name, bool is_tags) {
+        auto found = columns_.find(name);
+        if (found == columns_.end()) {
+            Column &column = columns_[name];
+            column.is_tags = is_tags;
+            return column;
+        }
+        if (found->second.is_tags != is_tags)
+            throw std::runtime_error("Attribute " + name + " holds " + (is_tags ? "numbers" : "tags"));
+        return found->second;
+    }
+
+    void addToRow(uint32_t row, const std::string &name) {
+        std::vector<std::string> &names = row_columns_[row];
+        if (std::find(names.begin(), names.end(), name) == names.end())
+            names.push_back(name);
+    }
+
+    static void removeFromColumn(Column &column, uint32_t row) {
+        if (!column.is_tags) {
+            column.present.reset(row);
+            return;
+        }
+        auto found = column.row_tags.find(row);
+        if (found == column.row_tags.end())
+            return;
+        for (const std::string &tag : found->second) {
+            auto tag_rows = column.tag_rows.find(tag);
+            tag_rows->second.reset(row);
+        }
+        column.row_tags.erase(found);
+    }
+
+    void removeLocked(labeltype label) {
+        uint32_t row;
+        if (!findRow(label, row))
+            return;
+        for (const std::string &name : row_columns_[row])
+            removeFromColumn(columns_[name], row);
+        row_columns_[row].clear();
+        mutableRowMap().erase(label);
+        rows_.reset(row);
+        free_rows_.push_back(row);
+        cache_.clear();
+    }
+
+    void setNumberLocked(labeltype label, const std::string &name, double value) {
+        Column &column = columnFor(name, false);
+        uint32_t row = rowFor(label);
+        if (column.numbers.size() <= row)
+            column.numbers.resize(row_labels_.size(), 0);
+        column.numbers[row] = value;
+        column.present.set(row);
+        addToRow(row, name);
+    }
+
+    void setTagsLocked(labeltype label, const std::string &name, const std::vector<std::string> &tags) {
+        Column &column = columnFor(name, true);
+        uint32_t row = rowFor(label);
+        removeFromColumn(column, row);
+        std::vector<std::string> &row_tags = column.row_tags[row];
+        for (const std::string &tag : tags) {
+            if (std::find(row_tags.begin(), row_tags.end(), tag) != row_tags.end())
+                continue;
+            row_tags.push_back(tag);
+            column.tag_rows[tag].set(row);
+        }
+        addToRow(row, name);
+    }
+
+    std::shared_ptr<const LabelBitmap> evaluateLocked(const AttributePredicate &predicate) {
+        std::string key = predicate.key();
+        auto cached = cache_.find(key);
+        if (cached != cache_.end())
+            return cached->second;
+
+        std::shared_ptr<LabelBitmap> result = std::make_shared<LabelBitmap>();
+        switch (predicate.kind) {
+            case AttributePredicate::AND:
+                *result = rows_;
+                for (const AttributePredicate &child : predicate.children)
+                    result->intersectWith(*evaluateLocked(child));
+                break;
+            case AttributePredicate::OR:
+                for (const AttributePredicate &child : predicate.children)
+                    result->unionWith(*evaluateLocked(child));
+                break;
+            case AttributePredicate::NOT:
+                if (predicate.children.size() != 1)
+                    throw std::runtime_error("A not predicate has exactly one clause");
+                *result = rows_;
+                result->subtract(*evaluateLocked(predicate.children[0]));
+                break;
+            case AttributePredicate::RANGE: {
+                auto found = columns_.find(predicate.column);
+                if (found == columns_.end())
+                    break;
+                const Column &column = found->second;
+                if (column.is_tags)
+                    throw std::runtime_error("Attribute " + predicate.column + " holds tags");
+                for (uint32_t row = 0; row < column.numbers.size(); row++) {
+                    double value = column.numbers[row];
+                    if (value >= predicate.min && value <= predicate.max && column.present.test(row))
+                        result->set(row);
+                }
+                break;
+            }
+            case AttributePredicate::TAGS: {
+                auto found = columns_.find(predicate.column);
+                if (found == columns_.end())
+                    break;
+                const Column &column = found->second;
+                if (!column.is_tags)
+                    throw std::runtime_error("Attribute " + predicate.column + " holds numbers");
+                for (const std::string &tag : predicate.tags) {
+                    auto tag_rows = column.tag_rows.find(tag);
+                    if (tag_rows != column.tag_rows.end())
+                        result->unionWith(tag_rows->second);
+                }
+                break;
+            }
+        }
+
+        if (cache_.size() >= MAX_CACHED_PREDICATES)
+            cache_.clear();
+        cache_[key] = result;
+        return result;
+    }
+
+ public:
+    AttributeStore() : row_of_(std::make_shared<RowMap>()) {}
+
+
+    /*
+    * Sets a number attribute of the label.
+    */
+    void setNumber(labeltype label, const std::string &name, double value) {
+        std::unique_lock<std::mutex> lock(lock_);
+        setNumberLocked(label, name, value);
+        cache_.clear();
+    }
+
+
+    /*
+    * Sets the tags of the label in a tag attribute, replacing the ones it had there.
+    */
+    void setTags(labeltype label, const std::string &name, const std::vector<std::string> &tags) {
+        std::unique_lock<std::mutex> lock(lock_);
+        setTagsLocked(label, name, tags);
+        cache_.clear();
+    }
+
+
+    /*
+    * Replaces all attributes of the label with the given ones. The values are checked against the
+    * kinds of their columns first, so the label keeps its attributes if one does not fit.
+    */
+    void setAttributes(labeltype label, const std::vector<AttributeValue> &values) {
+        std::unique_lock<std::mutex> lock(lock_);
+        for (const AttributeValue &value : values) {
+            auto found = columns_.find(value.name);
+            if (found != columns_.end() && found->second.is_tags != value.is_tags)
+                throw std::runtime_error("Attribute " + value.name + " holds " + (value.is_tags ? "numbers" : "tags"));
+        }
+        removeLocked(label);
+        for (const AttributeValue &value : values) {
+            if (value.is_tags)
+                setTagsLocked(label, value.name, value.tags);
+            else
+                setNumberLocked(label, value.name, value.number);
+        }
+        cache_.clear();
+    }
+
+
+    /*
+    * Removes all attributes of the label.
+    */
+    void removeLabel(labeltype label) {
+        std::unique_lock<std::mutex> lock(lock_);
+        removeLocked(label);
+    }
+
+
+    bool hasAttributes(labeltype label) const {
+        std::unique_lock<std::mutex> lock(lock_);
+        return row_of_->count(label) != 0;
+    }
+
+
+    /*
+    * Calls onNumber(name, value) and onTags(name, tags) for each attribute of the label.
+    */
+    template<typename NumberFn, typename TagsFn>
+    void forEachAttribute(labeltype label, NumberFn onNumber, TagsFn onTags) const {
+        std::unique_lock<std::mutex> lock(lock_);
+        uint32_t row;
+        if (!findRow(label, row))
+            return;
+        for (const std::string &name : row_columns_[row]) {
+            const Column &column = columns_.at(name);
+            if (!column.is_tags && column.present.test(row))
+                onNumber(name, column.numbers[row]);
+            else if (column.is_tags && column.row_tags.count(row))
+                onTags(name, column.row_tags.at(row));
+        }
+    }
+
+
+    /*
+    * The rows of the labels matching the predicate.
+    */
+    std::shared_ptr<const LabelBitmap> evaluate(const AttributePredicate &predicate) {
+        std::unique_lock<std::mutex> lock(lock_);
+        return evaluateLocked(predicate);
+    }
+
+
+    /*
+    * Filter allowing the labels matching the predicate. It holds the rows of the labels as they are
+    * now, later changes of the attributes do not affect it.
+    */
+    LabelBitmapFilter filter(const AttributePredicate &predicate) {
+        std::unique_lock<std::mutex> lock(lock_);
+        return LabelBitmapFilter(evaluateLocked(predicate), row_of_);
+    }
+
+
+    void clear() {
+        std::unique_lock<std::mutex> lock(lock_);
+        columns_.clear();
+        row_of_ = std::make_shared<RowMap>();
+        row_labels_.clear();
+        row_columns_.clear();
+        free_rows_.clear();
+        rows_.clear();
+        cache_.clear();
+    }
+
+
+    size_t getCurrentElementCount() const {
+        std::unique_lock<std::mutex> lock(lock_);
+        return row_of_->size();
+    }
+
+
+    void saveToStream(std::ostream &output) const {
+        std::unique_lock<std::mutex> lock(lock_);
+        auto writeString = [&](const std::string &text) {
+            uint32_t size = (uint32_t) text.size();
+            writeBinaryPOD(output, size);
+            output.write(text.data(), size);
+        };
+        size_t count = row_of_->size();
+        writeBinaryPOD(output, count);
+        for (uint32_t row = 0; row < row_labels_.size(); row++) {
+            if (!rows_.test(row))
+                continue;
+            const std::vector<std::string> &names = row_columns_[row];
+            writeBinaryPOD(output, row_labels_[row]);
+            uint32_t size = (uint32_t) names.size();
+            writeBinaryPOD(output, size);
+            for (const std::string &name : names) {
+                const Column &column = columns_.at(name);
+                writeString(name);
+                writeBinaryPOD(output, column.is_tags);
+                if (!column.is_tags) {
+                    writeBinaryPOD(output, column.numbers[row]);
+                    continue;
+                }
+                auto tags = column.row_tags.find(row);
+                uint32_t tag_count = tags == column.row_tags.end() ? 0 : (uint32_t) tags->second.size();
+                writeBinaryPOD(output, tag_count);
+                for (uint32_t i = 0; i < tag_count; i++)
+                    writeString(tags->second[i]);
+            }
+        }
+    }
+
+
+    void loadFromStream(std::istream &input) {
+        std::unique_lock<std::mutex> lock(lock_);
+        columns_.clear();
+        row_of_ = std::make_shared<RowMap>();
+        row_labels_.clear();
+        row_columns_.clear();
+        free_rows_.clear();
+        rows_.clear();
+        cache_.clear();
+        auto readString = [&]() {
+            uint32_t size;
+            readBinaryPOD(input, size);
+            std::string text(size, '\0');
+            input.read(&text[0], size);
+            if (!input)
+                throw std::runtime_error("Attributes seem to be corrupted or unsupported");
+            return text;
+        };
+        size_t count;
+        readBinaryPOD(input, count);
+        for (size_t i = 0; i < count; i++) {
+            labeltype label;
+            uint32_t size;
+            readBinaryPOD(input, label);
+            readBinaryPOD(input, size);
+            for (uint32_t j = 0; j < size; j++) {
+                std::string name = readString();
+                bool is_tags;
+                readBinaryPOD(input, is_tags);
+                if (!is_tags) {
+                    double value;
+                    readBinaryPOD(input, value);
+                    setNumberLocked(label, name, value);
+                    continue;
+                }
+                uint32_t tag_count;
+                readBinaryPOD(input, tag_count);
+                std::vector<std::string> tags(tag_count);
+                for (uint32_t t = 0; t < tag_count; t++)
+                    tags[t] = readString();
+                setTagsLocked(label, name, tags);
+            }
+            if (!input)
+                throw std::runtime_error("Attributes seem to be corrupted or unsupported");
+        }
+    }
+};
+
+}  // namespace hnswlib
@@ -1,9 +1,11 @@
 #pragma once
-#include <unordered_map>
+#include "flat_hash_map.h"
+#include "thread_pool.h"
 #include <fstream>
 #include <sstream>
 #include <mutex>
 #include <algorithm>
+#include <type_traits>
 #include <assert.h>
 
 namespace hnswlib {
@@ -20,7 +22,146 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
     void *dist_func_param_;
     std::mutex index_lock;
 
-    std::unordered_map<labeltype, size_t > dict_external_to_internal;
+    FlatHashMap<labeltype, size_t> dict_external_to_internal;
+
+    // tile sizes of the blocked scan: queries per block and stored elements per tile
+    static const size_t QUERY_BLOCK_SIZE = 8;
+    static const size_t ELEMENT_TILE_SIZE = 64;
+    static const size_t MIN_ELEMENTS_PER_THREAD = 4096;
+
+    // For the inner product and cosine spaces the scan computes the dot products of four queries
+    // with a stored vector at once instead of calling fstdistfunc_ per pair. dot_dim_ is the number
+    // of values in the dot product, the cosine space stores the inverse norm after them.
+    enum DotProductSpace { DOT_NONE, DOT_INNER_PRODUCT, DOT_COSINE };
+    DotProductSpace dot_space_{DOT_NONE};
+    size_t dot_dim_{0};
+    INNERPRODUCTBATCHFUNC inner_product_batch4_{nullptr};
+    DISTFUNC<float> inner_product_{nullptr};
+
+    /*
+    * Max-heap of at most k (distance, label) pairs. Candidates that cannot enter the
+    * top-k are rejected with a single comparison against the current worst.
+    */
+    struct TopKBuffer {
+        size_t k;
+        std::vector<std::pair<dist_t, labeltype>> items;
+
+        explicit TopKBuffer(size_t k) : k(k) {
+            items.reserve(k);
+        }
+
+        bool accepts(dist_t dist) const {
+            return items.size() < k || dist < items.front().first;
+        }
+
+        void push(dist_t dist, labeltype label) {
+            if (!accepts(dist))
+                return;
+            if (items.size() == k) {
+                std::pop_heap(items.begin(), items.end());
+                items.pop_back();
+            }
+            items.emplace_back(dist, label);
+            std::push_heap(items.begin(), items.end());
+        }
+    };
+
+
+    /*
+    * Uses the blocked dot products in the scan if s is an inner product or cosine space of floats.
+    */
+    void selectDotProductSpace(SpaceInterface<dist_t> *s) {
+        dot_space_ = DOT_NONE;
+        if (!std::is_same<dist_t, float>::value)
+            return;
+        if (dynamic_cast<InnerProductSpace *>(s)) {
+            dot_space_ = DOT_INNER_PRODUCT;
+            dot_dim_ = data_size_ / sizeof(float);
+        } else if (dynamic_cast<CosineSpace *>(s)) {
+            dot_space_ = DOT_COSINE;
+            dot_dim_ = data_size_ / sizeof(float) - 1;
+        } else {
+            return;
+        }
+        inner_product_batch4_ = selectInnerProductBatch4Func();
+        inner_product_ = selectInnerProductFunc(dot_dim_);
+    }
+
+
+    /*
+    * scanRange for the inner product and cosine spaces: the queries of a block are taken four at
+    * a time, the remaining ones one at a time with the plain inner product.
+    */
+    void scanRangeDotProducts(
+        const void *query_data,
+        size_t num_queries,
+        size_t begin,
+        size_t end,
+        BaseFilterFunctor* isIdAllowed,
+        std::vector<TopKBuffer> &top) const {
+        const float *queries[QUERY_BLOCK_SIZE];
+        float dots[QUERY_BLOCK_SIZE];
+        for (size_t q0 = 0; q0 < num_queries; q0 += QUERY_BLOCK_SIZE) {
+            size_t block = std::min(num_queries, q0 + QUERY_BLOCK_SIZE) - q0;
+            for (size_t q = 0; q < block; q++)
+                queries[q] = (const float *) ((const char *) query_data + (q0 + q) * data_size_);
+            for (size_t i = begin; i < end; i++) {
+                const char *element = data_ + size_per_element_ * i;
+                const float *vector = (const float *) element;
+                size_t q = 0;
+                for (; q + 4 <= block; q += 4)
+                    inner_product_batch4_(queries + q, vector, dot_dim_, dots + q);
+                for (; q < block; q++)
+                    dots[q] = inner_product_(queries[q], vector, &dot_dim_);
+
+                for (q = 0; q < block; q++) {
+                    float dot = dots[q];
+                    if (dot_space_ == DOT_COSINE)
+                        dot *= queries[q][dot_dim_] * vector[dot_dim_];
+                    dist_t dist = 1.0f - dot;
+                    TopKBuffer &buffer = top[q0 + q];
+                    if (!buffer.accepts(dist))
+                        continue;
+                    labeltype label = *((labeltype *) (element + data_size_));
+                    if ((!isIdAllowed) || (*isIdAllowed)(label))
+                        buffer.push(dist, label);
+                }
+            }
+        }
+    }
+
+
+    void scanRange(
+        const void *query_data,
+        size_t num_queries,
+        size_t begin,
+        size_t end,
+        BaseFilterFunctor* isIdAllowed,
+        std::vector<TopKBuffer> &top) const {
+        if (dot_space_ != DOT_NONE) {
+            scanRangeDotProducts(query_data, num_queries, begin, end, isIdAllowed, top);
+            return;
+        }
+        for (size_t q0 = 0; q0 < num_queries; q0 += QUERY_BLOCK_SIZE) {
+            size_t q1 = std::min(num_queries, q0 + QUERY_BLOCK_SIZE);
+            for (size_t i0 = begin; i0 < end; i0 += ELEMENT_TILE_SIZE) {
+                size_t i1 = std::min(end, i0 + ELEMENT_TILE_SIZE);
+                for (size_t q = q0; q < q1; q++) {
+                    const char *query = (const char *) query_data + q * data_size_;
+                    TopKBuffer &buffer = top[q];
+                    for (size_t i = i0; i < i1; i++) {
+                        const char *element = data_ + size_per_element_ * i;
+                        dist_t dist = fstdistfunc_(query, element, dist_func_param_);
+                        if (!buffer.accepts(dist))
+                            continue;
+                        labeltype label = *((labeltype *) (element + data_size_));
+                        if ((!isIdAllowed) || (*isIdAllowed)(label))
+                            buffer.push(dist, label);
+                    }
+                }
+            }
+        }
+    }
 
 
     BruteforceSearch(SpaceInterface <dist_t> *s)
@@ -50,6 +191,7 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         fstdistfunc_ = s->get_dist_func();
         dist_func_param_ = s->get_dist_func_param();
         size_per_element_ = data_size_ + sizeof(labeltype);
+        selectDotProductSpace(s);
         data_ = (char *) malloc(maxElements * size_per_element_);
         if (data_ == nullptr)
             throw std::runtime_error("Not enough memory: BruteforceSearch failed to allocate data");
@@ -98,35 +240,104 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
     }
 
 
+    void resizeIndex(size_t new_max_elements) {
+        std::unique_lock<std::mutex> lock(index_lock);
+        if (new_max_elements < cur_element_count)
+            throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
+
+        char *data_new = (char *) realloc(data_, new_max_elements * size_per_element_);
+        if (data_new == nullptr)
+            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate data");
+        data_ = data_new;
+        maxelements_ = new_max_elements;
+    }
+
+
     std::priority_queue<std::pair<dist_t, labeltype >>
     searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
-        assert(k <= cur_element_count);
-        std::priority_queue<std::pair<dist_t, labeltype >> topResults;
-        if (cur_element_count == 0) return topResults;
-        for (int i = 0; i < k; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-            labeltype label = *((labeltype*) (data_ + size_per_element_ * i + data_size_));
-            if ((!isIdAllowed) || (*isIdAllowed)(label)) {
-                topResults.push(std::pair<dist_t, labeltype>(dist, label));
-            }
+        return std::move(searchKnnBatch(query_data, 1, k, isIdAllowed)[0]);
+    }
+
+
+    /*
+    * Exact search for `num_queries` queries stored contiguously in `query_data`.
+    * The stored vectors are scanned in tiles that are compared against a block of queries
+    * while they are in cache, each query keeps a bounded top-k buffer. With num_threads > 1
+    * the scan is partitioned across threads and the per-thread results are merged; the filter
+    * must then be safe to call concurrently.
+    */
+    std::vector<std::priority_queue<std::pair<dist_t, labeltype>>>
+    searchKnnBatch(
+        const void *query_data,
+        size_t num_queries,
+        size_t k,
+        BaseFilterFunctor* isIdAllowed = nullptr,
+        size_t num_threads = 1) const {
+        std::vector<std::priority_queue<std::pair<dist_t, labeltype>>> results(num_queries);
+        if (cur_element_count == 0 || num_queries == 0 || k == 0) return results;
+
+        num_threads = std::max((size_t) 1, std::min(num_threads, cur_element_count / MIN_ELEMENTS_PER_THREAD));
+        std::vector<std::vector<TopKBuffer>> partial(num_threads, std::vector<TopKBuffer>(num_queries, TopKBuffer(k)));
+        size_t chunk = (cur_element_count + num_threads - 1) / num_threads;
+
+        if (num_threads == 1) {
+            scanRange(query_data, num_queries, 0, cur_element_count, isIdAllowed, partial[0]);
+        } else {
+            ThreadPool::instance().run(num_threads, [&](size_t t) {
+                size_t begin = t * chunk;
+                size_t end = std::min(cur_element_count, begin + chunk);
+                scanRange(query_data, num_queries, begin, end, isIdAllowed, partial[t]);
+            });
         }
-        dist_t lastdist = topResults.empty() ? std::numeric_limits<dist_t>::max() : topResults.top().first;
-        for (int i = k; i < cur_element_count; i++) {
-            dist_t dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-            if (dist <= lastdist) {
-                labeltype label = *((labeltype *) (data_ + size_per_element_ * i + data_size_));
-                if ((!isIdAllowed) || (*isIdAllowed)(label)) {
-                    topResults.push(std::pair<dist_t, labeltype>(dist, label));
-                }
-                if (topResults.size() > k)
-                    topResults.pop();
 
-                if (!topResults.empty()) {
-                    lastdist = topResults.top().first;
-                }
+        for (size_t q = 0; q < num_queries; q++) {
+            TopKBuffer merged(k);
+            for (size_t t = 0; t < num_threads; t++) {
+                for (const auto &item : partial[t][q].items)
+                    merged.push(item.first, item.second);
             }
+            for (const auto &item : merged.items)
+                results[q].push(item);
+        }
+        return results;
+    }
+
+
+    /*
+    * Returns the elements within `radius` of the query, closest first, at most `max_results` of them.
+    * Once max_results elements are found the radius shrinks to the farthest of them.
+    */
+    std::vector<std::pair<dist_t, labeltype>>
+    searchRange(const void *query_data, dist_t radius, size_t max_results, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        if (cur_element_count == 0 || max_results == 0)
+            return std::vector<std::pair<dist_t, labeltype>>();
+
+        TopKBuffer top(max_results);
+        for (size_t i = 0; i < cur_element_count; i++) {
+            const char *element = data_ + size_per_element_ * i;
+            dist_t dist = fstdistfunc_(query_data, element, dist_func_param_);
+            if (dist > radius || !top.accepts(dist))
+                continue;
+            labeltype label = *((labeltype *) (element + data_size_));
+            if ((!isIdAllowed) || (*isIdAllowed)(label))
+                top.push(dist, label);
         }
-        return topResults;
+        std::sort_heap(top.items.begin(), top.items.end());
+        return top.items;
+    }
+
+
+    /*
+    * Returns the size of the vectors stored in an index image, read from its header, or 0 if the image
+    * is too short to hold a header.
+    */
+    static size_t getStoredDataSize(const std::vector<char>& buffer) {
+        // maxelements_, then size_per_element_
+        size_t fields[2];
+        if (buffer.size() < sizeof(fields))
+            return 0;
+        memcpy(fields, buffer.data(), sizeof(fields));
+        return fields[1] - sizeof(labeltype);
     }
 
 
@@ -151,12 +362,22 @@ class BruteforceSearch : public AlgorithmInterface<dist_t> {
         data_size_ = s->get_data_size();
         fstdistfunc_ = s->get_dist_func();
         dist_func_param_ = s->get_dist_func_param();
-        size_per_element_ = data_size_ + sizeof(labeltype);
+        selectDotProductSpace(s);
+        // the header and the labels are size_t, so images of wasm32 and wasm64 builds differ
+        if (size_per_element_ != data_size_ + sizeof(labeltype) || cur_element_count > maxelements_)
+            throw std::runtime_error("Index seems to be corrupted or was saved by a build with a different size_t width");
         data_ = (char *) malloc(maxelements_ * size_per_element_);
         if (data_ == nullptr)
             throw std::runtime_error("Not enough memory: loadIndex failed to allocate data");
 
         input.read(data_, maxelements_ * size_per_element_);
+
+        dict_external_to_internal.clear();
+        dict_external_to_internal.reserve(cur_element_count);
+        for (size_t i = 0; i < cur_element_count; i++) {
+            labeltype label = *((labeltype *) (data_ + size_per_element_ * i + data_size_));
+            dict_external_to_internal[label] = i;
+        }
     }
 };
 }  // namespace hnswlib
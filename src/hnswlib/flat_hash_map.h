@@ -0,0 +1,278 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* Open-addressing hash map with Robin Hood probing, used for the label and id lookups.
+* All entries live in one contiguous array, so there is no allocation per element.
+*
+* While the keys are exactly 0..N-1 (labels generated in order) the map stays in dense mode,
+* where the value of key k is simply stored at position k. The first insertion or erasure
+* that breaks the contiguity moves the entries into the hash table.
+*/
+template<typename key_t, typename value_t>
+class FlatHashMap {
+    struct Slot {
+        key_t key;
+        value_t value;
+        uint32_t dist;  // probe distance + 1, 0 means empty
+    };
+
+    static const size_t MIN_CAPACITY = 16;
+
+    bool dense_{true};
+    std::vector<value_t> dense_values_;
+
+    std::vector<Slot> slots_;
+    size_t size_{0};
+    size_t mask_{0};
+
+    static size_t hashKey(key_t key) {
+        // splitmix64 finalizer, labels are often sequential so the low bits need mixing
+        uint64_t x = (uint64_t) key;
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return (size_t) x;
+    }
+
+    size_t findSlot(key_t key) const {
+        if (slots_.empty())
+            return slots_.size();
+        size_t pos = hashKey(key) & mask_;
+        for (uint32_t dist = 1; slots_[pos].dist >= dist; dist++) {
+            if (slots_[pos].dist == dist && slots_[pos].key == key)
+                return pos;
+            pos = (pos + 1) & mask_;
+        }
+        return slots_.size();
+    }
+
+    // Inserts a key that is known to be absent, returns the position where it ended up
+    size_t insertSlot(key_t key, value_t value) {
+        Slot cur{key, value, 1};
+        size_t pos = hashKey(key) & mask_;
+        size_t result = slots_.size();
+        while (true) {
+            Slot &slot = slots_[pos];
+            if (slot.dist == 0) {
+                slot = cur;
+                return result == slots_.size() ? pos : result;
+            }
+            if (slot.dist < cur.dist) {
+                std::swap(slot, cur);
+                if (result == slots_.size())
+                    result = pos;
+            }
+            pos = (pos + 1) & mask_;
+            cur.dist++;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old_slots;
+        old_slots.swap(slots_);
+        slots_.assign(capacity, Slot{key_t(), value_t(), 0});
+        mask_ = capacity - 1;
+        for (const Slot &slot : old_slots) {
+            if (slot.dist)
+                insertSlot(slot.key, slot.value);
+        }
+    }
+
+    static size_t capacityFor(size_t size) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * 4 < size * 5)  // keep the load factor below 0.8
+            capacity <<= 1;
+        return capacity;
+    }
+
+    void leaveDenseMode() {
+        dense_ = false;
+        slots_.assign(capacityFor(size_ + 1), Slot{key_t(), value_t(), 0});
+        mask_ = slots_.size() - 1;
+        for (size_t i = 0; i < dense_values_.size(); i++)
+            insertSlot((key_t) i, dense_values_[i]);
+        std::vector<value_t>().swap(dense_values_);
+    }
+
+ public:
+    class const_iterator {
+        const FlatHashMap *map_;
+        size_t pos_;
+        std::pair<key_t, value_t> current_;
+
+        void settle() {
+            if (map_->dense_) {
+                if (pos_ < map_->dense_values_.size())
+                    current_ = std::pair<key_t, value_t>((key_t) pos_, map_->dense_values_[pos_]);
+                return;
+            }
+            while (pos_ < map_->slots_.size() && map_->slots_[pos_].dist == 0)
+                pos_++;
+            if (pos_ < map_->slots_.size())
+                current_ = std::pair<key_t, value_t>(map_->slots_[pos_].key, map_->slots_[pos_].value);
+        }
+
+     public:
+        const_iterator(const FlatHashMap *map, size_t pos) : map_(map), pos_(pos) {
+            settle();
+        }
+
+        const std::pair<key_t, value_t> &operator*() const { return current_; }
+        const std::pair<key_t, value_t> *operator->() const { return &current_; }
+
+        const_iterator &operator++() {
+            pos_++;
+            settle();
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const { return pos_ == other.pos_; }
+        bool operator!=(const const_iterator &other) const { return pos_ != other.pos_; }
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+
+    const_iterator end() const { return const_iterator(this, dense_ ? dense_values_.size() : slots_.size()); }
+
+    const_iterator find(key_t key) const {
+        if (dense_)
+            return const_iterator(this, (size_t) key < dense_values_.size() ? (size_t) key : dense_values_.size());
+        return const_iterator(this, findSlot(key));
+    }
+
+    size_t count(key_t key) const {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    bool isDense() const { return dense_; }
+
+    void reserve(size_t size) {
+        if (dense_) {
+            dense_values_.reserve(size);
+        } else if (capacityFor(size) > slots_.size()) {
+            rehash(capacityFor(size));
+        }
+    }
+
+    value_t &operator[](key_t key) {
+        if (dense_) {
+            if ((size_t) key < dense_values_.size())
+                return dense_values_[(size_t) key];
+            if ((size_t) key == dense_values_.size()) {
+                dense_values_.push_back(value_t());
+                size_++;
+                return dense_values_.back();
+            }
+            leaveDenseMode();
+        }
+
+        size_t pos = findSlot(key);
+        if (pos != slots_.size())
+            return slots_[pos].value;
+        if ((size_ + 1) * 5 > slots_.size() * 4)
+            rehash(slots_.size() * 2);
+        size_++;
+        return slots_[insertSlot(key, value_t())].value;
+    }
+
+    size_t erase(key_t key) {
+        if (dense_) {
+            if ((size_t) key >= dense_values_.size())
+                return 0;
+            if ((size_t) key + 1 == dense_values_.size()) {
+                dense_values_.pop_back();
+                size_--;
+                return 1;
+            }
+            leaveDenseMode();
+        }
+
+        size_t pos = findSlot(key);
+        if (pos == slots_.size())
+            return 0;
+
+        // backward shift deletion keeps the probe sequences intact without tombstones
+        size_t next = (pos + 1) & mask_;
+        while (slots_[next].dist > 1) {
+            slots_[pos] = slots_[next];
+            slots_[pos].dist--;
+            pos = next;
+            next = (next + 1) & mask_;
+        }
+        slots_[pos].dist = 0;
+        size_--;
+
+        // shrink so that iterating from begin() stays cheap after many erasures
+        if (slots_.size() > MIN_CAPACITY && size_ * 8 < slots_.size())
+            rehash(capacityFor(size_));
+        return 1;
+    }
+
+    void clear() {
+        dense_ = true;
+        std::vector<value_t>().swap(dense_values_);
+        std::vector<Slot>().swap(slots_);
+        size_ = 0;
+        mask_ = 0;
+    }
+};
+
+
+/*
+* Set counterpart of FlatHashMap.
+*/
+template<typename key_t>
+class FlatHashSet {
+    FlatHashMap<key_t, char> map_;
+
+ public:
+    class const_iterator {
+        typename FlatHashMap<key_t, char>::const_iterator it_;
+
+     public:
+        explicit const_iterator(typename FlatHashMap<key_t, char>::const_iterator it) : it_(it) {}
+
+        key_t operator*() const { return it_->first; }
+
+        const_iterator &operator++() {
+            ++it_;
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const { return it_ == other.it_; }
+        bool operator!=(const const_iterator &other) const { return it_ != other.it_; }
+    };
+
+    const_iterator begin() const { return const_iterator(map_.begin()); }
+
+    const_iterator end() const { return const_iterator(map_.end()); }
+
+    const_iterator find(key_t key) const { return const_iterator(map_.find(key)); }
+
+    size_t count(key_t key) const { return map_.count(key); }
+
+    size_t size() const { return map_.size(); }
+
+    bool empty() const { return map_.empty(); }
+
+    void insert(key_t key) { map_[key] = 1; }
+
+    size_t erase(key_t key) { return map_.erase(key); }
+
+    void clear() { map_.clear(); }
+};
+
+}  // namespace hnswlib
@@ -1,24 +1,54 @@
 #pragma once
 
 #include "visited_list_pool.h"
+#include "link_list_arena.h"
+#include "flat_hash_map.h"
+#include "thread_pool.h"
 #include "hnswlib.h"
 #include <atomic>
 #include <random>
 #include <stdlib.h>
 #include <assert.h>
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <set>
 #include <list>
+#include <deque>
+#include <thread>
 #include <sstream>
 
 namespace hnswlib {
 typedef unsigned int tableint;
 typedef unsigned int linklistsizeint;
 
+/*
+* Work done by a single searchKnn call.
+* ef is the effective size of the dynamic candidate list: the configured ef for a regular
+* search, and the smaller list a regular search would have stopped with when adaptive
+* early termination ended the search first.
+*/
+struct SearchStats {
+    size_t ef{0};
+    size_t hops{0};  // expansions over all levels
+    std::vector<size_t> level_hops;  // expansions per level, index 0 is the base layer
+    size_t distance_computations{0};
+    size_t visited{0};  // elements reached on the base layer
+    size_t filter_rejections{0};
+    size_t deleted_skips{0};
+    bool stopped_early{false};
+};
+
 template<typename dist_t>
 class HierarchicalNSW : public AlgorithmInterface<dist_t> {
  public:
     static const tableint MAX_LABEL_OPERATION_LOCKS = 65536;
     static const unsigned char DELETE_MARK = 0x01;
+    static const size_t SEGMENT_BYTES = 16 * 1024 * 1024;  // size of a full base layer segment
+    // images start with the magic and the format version, the older ones with offsetLevel0_, which is 0
+    static const size_t IMAGE_MAGIC = 0x57534e48;  // "HNSW"
+    static const unsigned int IMAGE_VERSION = 1;
 
     size_t max_elements_{0};
     mutable std::atomic<size_t> cur_element_count{0};  // current number of elements
@@ -30,34 +60,86 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     size_t maxM0_{0};
     size_t ef_construction_{0};
     size_t ef_{ 0 };
+    size_t early_stop_patience_{0};  // 0 disables adaptive early termination
+
+    // filtered searches pick a strategy by the estimated fraction of elements the filter allows
+    static const size_t SELECTIVITY_SAMPLES = 64;
+    static const size_t MAX_SELECTIVITY_SAMPLES = 1024;
+    float brute_force_selectivity_{0.02f};  // below: exact scan over the allowed elements
+    float two_hop_selectivity_{0.2f};  // below: traverse allowed elements only, bridging with two-hop expansion
 
     double mult_{0.0}, revSize_{0.0};
-    int maxlevel_{0};
+    std::atomic<int> maxlevel_{0};  // atomic with enterpoint_node_, lock-free searches read them while inserts raise them
 
     VisitedListPool *visited_list_pool_{nullptr};
+    bool owns_visited_list_pool_{true};
 
     // Locks operations with element by label value
     mutable std::vector<std::mutex> label_op_locks_;
+    std::vector<std::mutex> *shared_label_op_locks_{nullptr};  // used instead of label_op_locks_ when set
 
     std::mutex global;
-    std::vector<std::mutex> link_list_locks_;
+    std::deque<std::mutex> link_list_locks_;  // a deque grows without moving the existing locks
 
-    tableint enterpoint_node_{0};
+    std::atomic<tableint> enterpoint_node_{0};
 
     size_t size_links_level0_{0};
     size_t offsetData_{0}, offsetLevel0_{0}, label_offset_{ 0 };
 
-    char *data_level0_memory_{nullptr};
+    // The base layer is stored in segments of 2^segment_shift_ elements, so that growing the capacity
+    // adds segments instead of moving the existing elements. Only the last segment may be partial.
+    std::vector<char *> data_level0_segments_;
+    size_t segment_shift_{0};
+    size_t segment_mask_{0};
+    float growth_factor_{0.0f};  // above 1: a full index grows by this factor instead of rejecting inserts
     char **linkLists_{nullptr};
+    LinkListArena *link_list_arena_{nullptr};  // owns the blocks pointed to by linkLists_
+    bool owns_link_list_arena_{true};
     std::vector<int> element_levels_;  // keeps level of each element
 
+    // Set by buildFromBatch while the graph is not visible to readers: reverse links that do not fit
+    // into a full list are kept per element as (level, neighbor) and pruned once at the end, and a
+    // single-threaded build skips the link list locks.
+    std::vector<std::vector<std::pair<int, tableint>>> *deferred_links_{nullptr};
+    bool skip_link_locks_{false};
+
+    // Set by setLockFreeSearch. Writers bracket every change of the links or the vector of an element
+    // with the version stripe of the element, searches copy what they read and retry when the stripe
+    // changed meanwhile. The first VERSION_STRIPES versions cover the links, the others the vectors.
+    // Searches also register in one of two reader counts, so that growing the index can wait for the
+    // searches that may still use the arrays it replaced before freeing them.
+    static const size_t VERSION_STRIPES = 65536;
+    static const size_t UPDATE_CHUNK_SIZE = 1024;  // updated elements whose repair candidates updatePoints keeps at once
+    static const unsigned int VERSION_WRITERS_MASK = 0xff;  // writers in progress, the bits above count the writes
+    std::atomic<unsigned int> *element_versions_{nullptr};
+    mutable std::atomic<size_t> read_epoch_{0};
+    mutable std::atomic<size_t> active_reads_[2] = {{0}, {0}};
+
+    // The arrays searches index by internal id, published as one block that is never changed. A
+    // search loads it once after registering as a reader; resizeIndex publishes the new arrays in a
+    // new block and frees the old block and arrays after waitForReaders. Writers use the members.
+    struct Table {
+        std::vector<char *> segments;
+        char **link_lists;
+        const int *element_levels;
+    };
+    std::atomic<const Table *> table_{nullptr};
+
+    // Growing the capacity waits for the inserts and other accesses to the arrays outside of
+    // searches, which wait while it runs, see AccessGuard. Compacting also keeps the searches out,
+    // see ExclusiveGuard.
+    std::mutex resize_lock_;
+    mutable std::atomic<bool> resizing_{false};
+    mutable std::atomic<size_t> active_accesses_{0};
+    mutable std::atomic<bool> exclusive_{false};
+
     size_t data_size_{0};
 
     DISTFUNC<dist_t> fstdistfunc_;
     void *dist_func_param_{nullptr};
 
     mutable std::mutex label_lookup_lock;  // lock for label_lookup_
-    std::unordered_map<labeltype, tableint> label_lookup_;
+    FlatHashMap<labeltype, tableint> label_lookup_;
 
     std::default_random_engine level_generator_;
     std::default_random_engine update_probability_generator_;
@@ -68,7 +150,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     bool allow_replace_deleted_ = false;  // flag to replace deleted elements (marked as deleted) during insertions
 
     std::mutex deleted_elements_lock;  // lock for deleted_elements
-    std::unordered_set<tableint> deleted_elements;  // contains internal ids of deleted elements
+    FlatHashSet<tableint> deleted_elements;  // contains internal ids of deleted elements
 
 
     HierarchicalNSW(SpaceInterface<dist_t> *s) {
@@ -117,9 +199,9 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         label_offset_ = size_links_level0_ + data_size_;
         offsetLevel0_ = 0;
 
-        data_level0_memory_ = (char *) malloc(max_elements_ * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory");
+        initSegments();
+        std::vector<char *> retired_segments;
+        data_level0_segments_ = resizeSegments(0, max_elements_, retired_segments);
 
         cur_element_count = 0;
 
@@ -133,19 +215,67 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         if (linkLists_ == nullptr)
             throw std::runtime_error("Not enough memory: HierarchicalNSW failed to allocate linklists");
         size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
+        link_list_arena_ = new LinkListArena(size_links_per_element_);
         mult_ = 1 / log(1.0 * M_);
         revSize_ = 1.0 / mult_;
+        publishTable();
     }
 
 
     ~HierarchicalNSW() {
-        free(data_level0_memory_);
-        for (tableint i = 0; i < cur_element_count; i++) {
-            if (element_levels_[i] > 0)
-                free(linkLists_[i]);
+        if (owns_link_list_arena_) {
+            delete link_list_arena_;
+        } else {
+            // hand the blocks back so that other indexes sharing the arena can reuse them
+            for (tableint i = 0; i < cur_element_count; i++) {
+                if (element_levels_[i] > 0)
+                    link_list_arena_->deallocate(linkLists_[i], element_levels_[i]);
+            }
         }
+        for (char *segment : data_level0_segments_)
+            free(segment);
         free(linkLists_);
-        delete visited_list_pool_;
+        if (owns_visited_list_pool_)
+            delete visited_list_pool_;
+        delete[] element_versions_;
+        delete table_.load();
+    }
+
+
+    /*
+    * Makes the index allocate its upper-layer link lists from `arena` and take its label locks
+    * from `label_op_locks`, both owned by the caller and shared with other indexes.
+    * Only possible while the index is empty; the arena must be created for the same M and
+    * label_op_locks must hold MAX_LABEL_OPERATION_LOCKS mutexes.
+    */
+    void useSharedStorage(LinkListArena *arena, std::vector<std::mutex> *label_op_locks) {
+        if (cur_element_count != 0)
+            throw std::runtime_error("Shared storage can only be attached to an empty index");
+        if (arena->getSizeLinksPerElement() != size_links_per_element_)
+            throw std::runtime_error("The shared link list arena was created for a different M");
+        if (label_op_locks->size() != MAX_LABEL_OPERATION_LOCKS)
+            throw std::runtime_error("The shared label locks must hold MAX_LABEL_OPERATION_LOCKS mutexes");
+
+        if (owns_link_list_arena_)
+            delete link_list_arena_;
+        link_list_arena_ = arena;
+        owns_link_list_arena_ = false;
+
+        shared_label_op_locks_ = label_op_locks;
+        std::vector<std::mutex>().swap(label_op_locks_);
+    }
+
+
+    /*
+    * Replaces the visited-list pool with one owned by the caller, which may be shared with other
+    * indexes. The pool must have been reserved for max_elements_ elements, resizeIndex reserves
+    * it for the new capacity. Must not be called while a search is running.
+    */
+    void useSharedVisitedListPool(VisitedListPool *pool) {
+        if (owns_visited_list_pool_)
+            delete visited_list_pool_;
+        visited_list_pool_ = pool;
+        owns_visited_list_pool_ = false;
     }
 
 
@@ -162,32 +292,273 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Lets searches run without locks while other threads insert, update, delete or grow the index.
+    * Searches read a link list or a vector only while no writer changes it and growing the index
+    * frees the replaced arrays once the searches using them have ended. Costs a version check per
+    * visited element. Must not be toggled while other operations run; buildFromBatch and loading
+    * still need exclusive access, compact and shrinkToFit wait for the running operations.
+    */
+    void setLockFreeSearch(bool enabled) {
+        if (enabled == getLockFreeSearch())
+            return;
+        if (enabled) {
+            element_versions_ = new std::atomic<unsigned int>[2 * VERSION_STRIPES]();
+        } else {
+            delete[] element_versions_;
+            element_versions_ = nullptr;
+        }
+    }
+
+
+    bool getLockFreeSearch() const {
+        return element_versions_ != nullptr;
+    }
+
+
+    /*
+    * Enables adaptive early termination of the base layer search: once the current top-k
+    * has not improved for `patience` consecutive expansions the search stops, even if the
+    * candidate pool has not reached ef yet. ef stays the upper bound. 0 disables it.
+    */
+    void setEarlyStopPatience(size_t patience) {
+        early_stop_patience_ = patience;
+    }
+
+
+    void setFilterSelectivityThresholds(float brute_force_selectivity, float two_hop_selectivity) {
+        brute_force_selectivity_ = brute_force_selectivity;
+        two_hop_selectivity_ = two_hop_selectivity;
+    }
+
+
+    /*
+    * The number of labels the filter allows, for the filters that know it. It bounds the number
+    * of live elements they allow.
+    */
+    static bool getFilterSize(BaseFilterFunctor *isIdAllowed, size_t &size) {
+        LabelSetFilter *label_filter = dynamic_cast<LabelSetFilter *>(isIdAllowed);
+        if (label_filter) {
+            size = label_filter->size();
+            return true;
+        }
+        LabelBitmapFilter *bitmap_filter = dynamic_cast<LabelBitmapFilter *>(isIdAllowed);
+        if (bitmap_filter) {
+            size = bitmap_filter->size();
+            return true;
+        }
+        return false;
+    }
+
+
+    /*
+    * Estimates the fraction of the live elements that pass the filter. Exact for the filters that
+    * know their size, otherwise the filter is evaluated on a sample of the elements and
+    * upper_bound is set to the upper end of the 95% Wilson interval of the estimate. The sample
+    * grows while the estimate is below the exact scan threshold but the bound is not.
+    */
+    float estimateSelectivity(const Table &table, BaseFilterFunctor *isIdAllowed, float &upper_bound) const {
+        size_t count = cur_element_count;
+        size_t live = count - num_deleted_;
+        upper_bound = 1.0f;
+        if (!isIdAllowed || live == 0)
+            return 1.0f;
+
+        size_t size;
+        if (getFilterSize(isIdAllowed, size)) {
+            upper_bound = std::min(1.0f, (float) size / live);
+            return upper_bound;
+        }
+
+        // golden ratio sequence, so that the sample does not alias with periodic label patterns
+        size_t max_samples = std::min(count, (size_t) MAX_SELECTIVITY_SAMPLES);
+        size_t samples = std::min(count, (size_t) SELECTIVITY_SAMPLES);
+        size_t checked = 0, allowed = 0;
+        size_t i = 0;
+        while (true) {
+            for (; i < samples; i++) {
+                double position = i * 0.6180339887498949;
+                tableint id = (tableint) ((position - (size_t) position) * count);
+                if (isMarkedDeleted(table, id))
+                    continue;
+                checked++;
+                if ((*isIdAllowed)(getExternalLabel(table, id)))
+                    allowed++;
+            }
+            if (checked == 0)
+                return 1.0f;
+            const double z = 1.96;
+            double n = (double) checked;
+            double p = (double) allowed / checked;
+            double center = p + z * z / (2 * n);
+            double margin = z * sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+            upper_bound = (float) std::min(1.0, (center + margin) / (1 + z * z / n));
+            if (p >= brute_force_selectivity_ || upper_bound < brute_force_selectivity_ || samples == max_samples)
+                return (float) p;
+            samples = std::min(2 * samples, max_samples);
+        }
+    }
+
+
     inline std::mutex& getLabelOpMutex(labeltype label) const {
         // calculate hash
         size_t lock_id = label & (MAX_LABEL_OPERATION_LOCKS - 1);
+        if (shared_label_op_locks_)
+            return (*shared_label_op_locks_)[lock_id];
         return label_op_locks_[lock_id];
     }
 
 
+    inline char *getElementPtr(tableint internal_id) const {
+        return data_level0_segments_[internal_id >> segment_shift_] + (internal_id & segment_mask_) * size_data_per_element_;
+    }
+
+
     inline labeltype getExternalLabel(tableint internal_id) const {
         labeltype return_label;
-        memcpy(&return_label, (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), sizeof(labeltype));
+        memcpy(&return_label, (getElementPtr(internal_id) + label_offset_), sizeof(labeltype));
         return return_label;
     }
 
 
     inline void setExternalLabel(tableint internal_id, labeltype label) const {
-        memcpy((data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), &label, sizeof(labeltype));
+        memcpy((getElementPtr(internal_id) + label_offset_), &label, sizeof(labeltype));
     }
 
 
     inline labeltype *getExternalLabeLp(tableint internal_id) const {
-        return (labeltype *) (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_);
+        return (labeltype *) (getElementPtr(internal_id) + label_offset_);
+    }
+
+
+    /*
+    * Publishes the current arrays to the searches and returns the table they replace.
+    */
+    const Table *publishTable() {
+        return table_.exchange(new Table{data_level0_segments_, linkLists_, element_levels_.data()});
+    }
+
+
+    /*
+    * The accessors of the searches, which read the arrays through the table they loaded.
+    */
+    inline char *getElementPtr(const Table &table, tableint internal_id) const {
+        return table.segments[internal_id >> segment_shift_] + (internal_id & segment_mask_) * size_data_per_element_;
+    }
+
+
+    inline labeltype getExternalLabel(const Table &table, tableint internal_id) const {
+        labeltype return_label;
+        memcpy(&return_label, (getElementPtr(table, internal_id) + label_offset_), sizeof(labeltype));
+        return return_label;
+    }
+
+
+    inline char *getDataByInternalId(const Table &table, tableint internal_id) const {
+        return getElementPtr(table, internal_id) + offsetData_;
+    }
+
+
+    linklistsizeint *get_linklist_at_level(const Table &table, tableint internal_id, int level) const {
+        if (level == 0)
+            return (linklistsizeint *) (getElementPtr(table, internal_id) + offsetLevel0_);
+        return (linklistsizeint *) (table.link_lists[internal_id] + (level - 1) * size_links_per_element_);
+    }
+
+
+    bool isMarkedDeleted(const Table &table, tableint internal_id) const {
+        unsigned char *ll_cur = ((unsigned char *) get_linklist_at_level(table, internal_id, 0)) + 2;
+        return *ll_cur & DELETE_MARK;
     }
 
 
     inline char *getDataByInternalId(tableint internal_id) const {
-        return (data_level0_memory_ + internal_id * size_data_per_element_ + offsetData_);
+        return (getElementPtr(internal_id) + offsetData_);
+    }
+
+
+    /*
+    * Picks the segment size: the largest power of two number of elements that fits in SEGMENT_BYTES.
+    */
+    void initSegments() {
+        segment_shift_ = 0;
+        while ((((size_t) 2) << segment_shift_) * size_data_per_element_ <= SEGMENT_BYTES)
+            segment_shift_++;
+        segment_mask_ = ((size_t) 1 << segment_shift_) - 1;
+    }
+
+
+    /*
+    * Returns the segment table for a base layer capacity changed from old_max_elements to
+    * new_max_elements. Full segments are kept, a partial last segment is replaced by a resized
+    * copy. The segments left out of the new table are added to `retired` for the caller to free,
+    * the current table is not changed.
+    */
+    std::vector<char *> resizeSegments(size_t old_max_elements, size_t new_max_elements, std::vector<char *> &retired) const {
+        size_t segment_elements = (size_t) 1 << segment_shift_;
+        size_t num_segments = (new_max_elements + segment_elements - 1) >> segment_shift_;
+        std::vector<char *> segments(data_level0_segments_.begin(),
+                                     data_level0_segments_.begin() + std::min(num_segments, data_level0_segments_.size()));
+        std::vector<char *> allocated;
+        for (size_t i = 0; i < num_segments; i++) {
+            size_t begin = i << segment_shift_;
+            size_t capacity = std::min(segment_elements, new_max_elements - begin);
+            bool exists = i < segments.size();
+            size_t old_capacity = exists ? std::min(segment_elements, old_max_elements - begin) : 0;
+            if (capacity == old_capacity)
+                continue;
+            char *segment = (char *) malloc(capacity * size_data_per_element_);
+            if (segment == nullptr) {
+                for (char *unused : allocated)
+                    free(unused);
+                throw std::runtime_error("Not enough memory: failed to allocate base layer segment");
+            }
+            allocated.push_back(segment);
+            if (exists) {
+                memcpy(segment, segments[i], std::min(capacity, old_capacity) * size_data_per_element_);
+                segments[i] = segment;
+            } else {
+                segments.push_back(segment);
+            }
+        }
+        for (size_t i = 0; i < data_level0_segments_.size(); i++) {
+            if (i >= segments.size() || segments[i] != data_level0_segments_[i])
+                retired.push_back(data_level0_segments_[i]);
+        }
+        return segments;
+    }
+
+
+    /*
+    * With a growth factor above 1, inserting into a full index grows its capacity by that factor
+    * instead of failing. Concurrent inserts wait for the growth; searches may only run during it
+    * with lock-free search enabled.
+    */
+    void setGrowthFactor(float growth_factor) {
+        growth_factor_ = growth_factor;
+    }
+
+
+    float getGrowthFactor() const {
+        return growth_factor_;
+    }
+
+
+    /*
+    * Makes room for `count` more elements, growing by the growth factor when that is larger.
+    * Returns false if the index is full and growth is disabled. Threads that need room at the same
+    * time grow the index once.
+    */
+    bool reserveForInsert(size_t count) {
+        std::unique_lock <std::mutex> lock_resize(resize_lock_);
+        size_t needed = cur_element_count + count;
+        if (needed <= max_elements_)
+            return true;
+        if (growth_factor_ <= 1.0f)
+            return false;
+        size_t grown = (size_t) std::ceil(max_elements_ * (double) growth_factor_);
+        resizeIndexLocked(std::max(needed, grown));
+        return true;
     }
 
 
@@ -239,7 +610,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
             tableint curNodeNum = curr_el_pair.second;
 
-            std::unique_lock <std::mutex> lock(link_list_locks_[curNodeNum]);
+            std::unique_lock <std::mutex> lock = lockLinkList(curNodeNum);
 
             int *data;  // = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
             if (layer == 0) {
@@ -253,16 +624,21 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 #ifdef USE_SSE
             _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
             _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-            _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
-            _mm_prefetch(getDataByInternalId(*(datal + 1)), _MM_HINT_T0);
+            if (size > 0)  // the segment lookup must not see the stale ids past the end of the list
+                _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
+            if (size > 1)
+                _mm_prefetch(getDataByInternalId(*(datal + 1)), _MM_HINT_T0);
 #endif
 
             for (size_t j = 0; j < size; j++) {
                 tableint candidate_id = *(datal + j);
 //                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
-                _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
-                _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
+                // an upper-layer list may end its arena chunk, nothing is read past it
+                if (j + 1 < size) {
+                    _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
+                    _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
+                }
 #endif
                 if (visited_array[candidate_id] == visited_array_tag) continue;
                 visited_array[candidate_id] = visited_array_tag;
@@ -294,7 +670,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
     template <bool has_deletions, bool collect_metrics = false>
     std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
-    searchBaseLayerST(tableint ep_id, const void *data_point, size_t ef, BaseFilterFunctor* isIdAllowed = nullptr) const {
+    searchBaseLayerST(
+        const Table &table,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        BaseFilterFunctor* isIdAllowed = nullptr,
+        size_t k = 0,
+        SearchStats *stats = nullptr) const {
         VisitedList *vl = visited_list_pool_->getFreeVisitedList();
         vl_type *visited_array = vl->mass;
         vl_type visited_array_tag = vl->curV;
@@ -302,12 +685,35 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
 
+        // adaptive early termination keeps the distances of the current top-k
+        // and counts the expansions since they last changed
+        const bool early_stop = early_stop_patience_ > 0 && k > 0 && k < ef;
+        std::priority_queue<dist_t> top_k_dists;
+        size_t expansions_without_improvement = 0;
+        bool stopped_early = false;
+        size_t hops = 0;
+        size_t neighbors_scanned = 0;
+        size_t distance_computations = 0;
+        size_t visited = 1;
+        size_t filter_rejections = 0;
+        size_t deleted_skips = 0;
+        // one spare value for the prefetch of the next id
+        std::vector<linklistsizeint> links(element_versions_ ? maxM0_ + 2 : 0);
+
         dist_t lowerBound;
-        if ((!has_deletions || !isMarkedDeleted(ep_id)) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(ep_id)))) {
-            dist_t dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
+        if (has_deletions && isMarkedDeleted(table, ep_id)) {
+            deleted_skips++;
+        } else if (isIdAllowed && !(*isIdAllowed)(getExternalLabel(table, ep_id))) {
+            filter_rejections++;
+        }
+        if (deleted_skips + filter_rejections == 0) {
+            dist_t dist = readDistance(table, data_point, ep_id);
+            distance_computations++;
             lowerBound = dist;
             top_candidates.emplace(dist, ep_id);
             candidate_set.emplace(-dist, ep_id);
+            if (early_stop)
+                top_k_dists.push(dist);
         } else {
             lowerBound = std::numeric_limits<dist_t>::max();
             candidate_set.emplace(-lowerBound, ep_id);
@@ -325,45 +731,56 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             candidate_set.pop();
 
             tableint current_node_id = current_node_pair.second;
-            int *data = (int *) get_linklist0(current_node_id);
+            int *data = (int *) readLinkList(table, current_node_id, 0, links.data());
             size_t size = getListCount((linklistsizeint*)data);
 //                bool cur_node_deleted = isMarkedDeleted(current_node_id);
-            if (collect_metrics) {
-                metric_hops++;
-                metric_distance_computations+=size;
-            }
+            hops++;
+            neighbors_scanned += size;
+            bool improved = false;
 
 #ifdef USE_SSE
             _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
             _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-            _mm_prefetch(data_level0_memory_ + (*(data + 1)) * size_data_per_element_ + offsetData_, _MM_HINT_T0);
+            if (size > 0)  // the segment lookup must not see the stale ids past the end of the list
+                _mm_prefetch(getDataByInternalId(table, *(data + 1)), _MM_HINT_T0);
             _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
 #endif
 
             for (size_t j = 1; j <= size; j++) {
-                int candidate_id = *(data + j);
+                tableint candidate_id = *(data + j);
 //                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
                 _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
-                _mm_prefetch(data_level0_memory_ + (*(data + j + 1)) * size_data_per_element_ + offsetData_,
-                                _MM_HINT_T0);  ////////////
+                if (j < size)
+                    _mm_prefetch(getDataByInternalId(table, *(data + j + 1)), _MM_HINT_T0);  ////////////
 #endif
                 if (!(visited_array[candidate_id] == visited_array_tag)) {
                     visited_array[candidate_id] = visited_array_tag;
+                    visited++;
 
-                    char *currObj1 = (getDataByInternalId(candidate_id));
-                    dist_t dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
+                    dist_t dist = readDistance(table, data_point, candidate_id);
+                    distance_computations++;
 
                     if (top_candidates.size() < ef || lowerBound > dist) {
                         candidate_set.emplace(-dist, candidate_id);
 #ifdef USE_SSE
-                        _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
-                                        offsetLevel0_,  ///////////
+                        _mm_prefetch((char *) get_linklist_at_level(table, candidate_set.top().second, 0),  ///////////
                                         _MM_HINT_T0);  ////////////////////////
 #endif
 
-                        if ((!has_deletions || !isMarkedDeleted(candidate_id)) && ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(candidate_id))))
+                        if (has_deletions && isMarkedDeleted(table, candidate_id)) {
+                            deleted_skips++;
+                        } else if (isIdAllowed && !(*isIdAllowed)(getExternalLabel(table, candidate_id))) {
+                            filter_rejections++;
+                        } else {
                             top_candidates.emplace(dist, candidate_id);
+                            if (early_stop && (top_k_dists.size() < k || dist < top_k_dists.top())) {
+                                top_k_dists.push(dist);
+                                if (top_k_dists.size() > k)
+                                    top_k_dists.pop();
+                                improved = true;
+                            }
+                        }
 
                         if (top_candidates.size() > ef)
                             top_candidates.pop();
@@ -373,13 +790,324 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     }
                 }
             }
+
+            if (early_stop) {
+                expansions_without_improvement = improved ? 0 : expansions_without_improvement + 1;
+                if (expansions_without_improvement >= early_stop_patience_ && top_k_dists.size() == k) {
+                    stopped_early = !candidate_set.empty();
+                    break;
+                }
+            }
         }
 
         visited_list_pool_->releaseVisitedList(vl);
+
+        // the shared counters are updated once per search to keep contention low
+        if (collect_metrics) {
+            metric_hops += hops;
+            metric_distance_computations += neighbors_scanned;
+        }
+
+        if (stats) {
+            // the ef at which a regular search would have stopped at this frontier
+            // is the number of results closer than the best unexpanded candidate
+            stats->ef = top_candidates.size();
+            if (stopped_early) {
+                auto closer = top_candidates;
+                while (!closer.empty() && closer.top().first > -candidate_set.top().first)
+                    closer.pop();
+                stats->ef = std::max(closer.size(), k);
+            }
+            stats->hops += hops;
+            if (stats->level_hops.empty())
+                stats->level_hops.resize(1);
+            stats->level_hops[0] += hops;
+            stats->distance_computations += distance_computations;
+            stats->visited += visited;
+            stats->filter_rejections += filter_rejections;
+            stats->deleted_skips += deleted_skips;
+            stats->stopped_early = stopped_early;
+        }
         return top_candidates;
     }
 
 
+    /*
+    * Base layer search for selective filters: only allowed elements are expanded, so the search
+    * does not wander through regions the filter rejects. A rejected neighbor is bridged by
+    * considering its own neighbors instead (two-hop expansion, as in ACORN-1), which keeps the
+    * allowed subgraph connected. A rejected element reached as a second hop can still bridge
+    * later when it shows up as a direct neighbor; the filter runs at most once per element.
+    */
+    template <bool has_deletions>
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerFiltered(
+        const Table &table,
+        tableint ep_id,
+        const void *data_point,
+        size_t ef,
+        BaseFilterFunctor* isIdAllowed,
+        SearchStats *stats = nullptr) const {
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+        VisitedList *rl = visited_list_pool_->getFreeVisitedList();
+        vl_type *rejected_array = rl->mass;
+        vl_type rejected_array_tag = rl->curV;
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+        dist_t lowerBound = std::numeric_limits<dist_t>::max();
+        size_t hops = 0;
+        size_t neighbors_scanned = 0;
+        size_t distance_computations = 0;
+        size_t visited = 1;
+        size_t filter_rejections = 0;
+        size_t deleted_skips = 0;
+        std::vector<tableint> bridges;
+        std::vector<linklistsizeint> links(element_versions_ ? maxM0_ + 1 : 0);
+        std::vector<linklistsizeint> bridge_links(element_versions_ ? maxM0_ + 1 : 0);
+
+        auto allowed = [&](tableint id) {
+            if (rejected_array[id] == rejected_array_tag)
+                return false;
+            bool ok = (*isIdAllowed)(getExternalLabel(table, id));
+            if (!ok) {
+                rejected_array[id] = rejected_array_tag;
+                filter_rejections++;
+            }
+            return ok;
+        };
+
+        auto consider = [&](tableint id) {
+            dist_t dist = readDistance(table, data_point, id);
+            distance_computations++;
+            if (top_candidates.size() < ef || lowerBound > dist) {
+                candidate_set.emplace(-dist, id);
+                if (!has_deletions || !isMarkedDeleted(table, id))
+                    top_candidates.emplace(dist, id);
+                else
+                    deleted_skips++;
+                if (top_candidates.size() > ef)
+                    top_candidates.pop();
+                if (!top_candidates.empty())
+                    lowerBound = top_candidates.top().first;
+            }
+        };
+
+        visited_array[ep_id] = visited_array_tag;
+        if (allowed(ep_id))
+            consider(ep_id);
+        else
+            candidate_set.emplace(-std::numeric_limits<dist_t>::max(), ep_id);  // expanded once as a bridge
+
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            if ((-current_node_pair.first) > lowerBound && top_candidates.size() == ef)
+                break;
+            candidate_set.pop();
+
+            linklistsizeint *ll_cur = readLinkList(table, current_node_pair.second, 0, links.data());
+            size_t size = getListCount(ll_cur);
+            tableint *neighbors = (tableint *) (ll_cur + 1);
+            hops++;
+            neighbors_scanned += size;
+
+            // direct neighbors first, then the neighbors of rejected ones until the
+            // expansion has found as many allowed elements as a full neighbor list
+            size_t found = 0;
+            bridges.clear();
+            for (size_t j = 0; j < size; j++) {
+                tableint neighbor_id = neighbors[j];
+                if (visited_array[neighbor_id] == visited_array_tag)
+                    continue;
+                visited_array[neighbor_id] = visited_array_tag;
+                visited++;
+                if (allowed(neighbor_id)) {
+                    consider(neighbor_id);
+                    found++;
+                } else {
+                    bridges.push_back(neighbor_id);
+                }
+            }
+
+            for (size_t b = 0; b < bridges.size() && found < maxM0_; b++) {
+                linklistsizeint *ll_bridge = readLinkList(table, bridges[b], 0, bridge_links.data());
+                size_t bridge_size = getListCount(ll_bridge);
+                tableint *second_hop = (tableint *) (ll_bridge + 1);
+                neighbors_scanned += bridge_size;
+                for (size_t l = 0; l < bridge_size && found < maxM0_; l++) {
+                    tableint candidate_id = second_hop[l];
+                    if (visited_array[candidate_id] == visited_array_tag)
+                        continue;
+                    if (allowed(candidate_id)) {
+                        visited_array[candidate_id] = visited_array_tag;
+                        visited++;
+                        consider(candidate_id);
+                        found++;
+                    }
+                }
+            }
+        }
+
+        visited_list_pool_->releaseVisitedList(rl);
+        visited_list_pool_->releaseVisitedList(vl);
+        metric_hops += hops;
+        metric_distance_computations += neighbors_scanned;
+
+        if (stats) {
+            stats->ef = top_candidates.size();
+            stats->hops += hops;
+            if (stats->level_hops.empty())
+                stats->level_hops.resize(1);
+            stats->level_hops[0] += hops;
+            stats->distance_computations += distance_computations;
+            stats->visited += visited;
+            stats->filter_rejections += filter_rejections;
+            stats->deleted_skips += deleted_skips;
+        }
+        return top_candidates;
+    }
+
+
+    /*
+    * Exact search over the elements a very selective filter allows. A LabelSetFilter is
+    * resolved through the label lookup, other filters are evaluated on every element.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchAllowedExact(const Table &table, const void *data_point, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats *stats = nullptr) const {
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        size_t distance_computations = 0;
+        size_t filter_rejections = 0;
+        size_t deleted_skips = 0;
+
+        auto consider = [&](tableint id) {
+            if (isMarkedDeleted(table, id)) {
+                deleted_skips++;
+                return;
+            }
+            dist_t dist = readDistance(table, data_point, id);
+            distance_computations++;
+            if (top_candidates.size() < k || dist < top_candidates.top().first) {
+                top_candidates.emplace(dist, id);
+                if (top_candidates.size() > k)
+                    top_candidates.pop();
+            }
+        };
+
+        LabelSetFilter *label_filter = dynamic_cast<LabelSetFilter *>(isIdAllowed);
+        if (label_filter) {
+            std::vector<tableint> ids;
+            ids.reserve(label_filter->size());
+            {
+                std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+                for (labeltype label : label_filter->labels()) {
+                    auto search = label_lookup_.find(label);
+                    if (search != label_lookup_.end())
+                        ids.push_back(search->second);
+                }
+            }
+            for (tableint id : ids)
+                consider(id);
+        } else {
+            size_t count = cur_element_count;
+            for (tableint id = 0; id < count; id++) {
+                if ((*isIdAllowed)(getExternalLabel(table, id)))
+                    consider(id);
+                else
+                    filter_rejections++;
+            }
+        }
+
+        if (stats) {
+            stats->ef = k;
+            stats->distance_computations += distance_computations;
+            stats->visited += distance_computations + deleted_skips;
+            stats->filter_rejections += filter_rejections;
+            stats->deleted_skips += deleted_skips;
+        }
+        return top_candidates;
+    }
+
+
+    /*
+    * Base layer search that collects every element within `radius` of the query, up to the
+    * `max_results` closest ones. Like the regular search it keeps an ef sized pool to decide
+    * which candidates are worth expanding, but it does not stop while the frontier is still
+    * inside the radius. Once max_results elements are found the radius shrinks to the farthest
+    * of them. Returns the results as a max-heap on distance.
+    */
+    template <bool has_deletions>
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchBaseLayerRange(
+        const Table &table,
+        tableint ep_id,
+        const void *data_point,
+        dist_t radius,
+        size_t max_results,
+        BaseFilterFunctor* isIdAllowed = nullptr) const {
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> results;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+        const size_t ef = std::max(ef_, (size_t) 1);
+        size_t hops = 0;
+        size_t neighbors_scanned = 0;
+        std::vector<linklistsizeint> links(element_versions_ ? maxM0_ + 1 : 0);
+
+        auto consider = [&](tableint id, dist_t dist) {
+            candidate_set.emplace(-dist, id);
+            top_candidates.emplace(dist, id);
+            if (top_candidates.size() > ef)
+                top_candidates.pop();
+            if (dist <= radius && (!has_deletions || !isMarkedDeleted(table, id)) &&
+                ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(table, id)))) {
+                results.emplace(dist, id);
+                if (results.size() > max_results)
+                    results.pop();
+                if (results.size() == max_results)
+                    radius = results.top().first;
+            }
+        };
+
+        consider(ep_id, readDistance(table, data_point, ep_id));
+        visited_array[ep_id] = visited_array_tag;
+
+        while (!candidate_set.empty()) {
+            dist_t candidate_dist = -candidate_set.top().first;
+            dist_t lowerBound = top_candidates.top().first;
+            if (candidate_dist > radius && candidate_dist > lowerBound && top_candidates.size() == ef)
+                break;
+            tableint current_node_id = candidate_set.top().second;
+            candidate_set.pop();
+
+            int *data = (int *) readLinkList(table, current_node_id, 0, links.data());
+            size_t size = getListCount((linklistsizeint*)data);
+            hops++;
+            neighbors_scanned += size;
+
+            for (size_t j = 1; j <= size; j++) {
+                tableint candidate_id = *(data + j);
+                if (visited_array[candidate_id] == visited_array_tag)
+                    continue;
+                visited_array[candidate_id] = visited_array_tag;
+
+                dist_t dist = readDistance(table, data_point, candidate_id);
+                if (dist <= radius || top_candidates.size() < ef || dist < top_candidates.top().first)
+                    consider(candidate_id, dist);
+            }
+        }
+
+        visited_list_pool_->releaseVisitedList(vl);
+        metric_hops += hops;
+        metric_distance_computations += neighbors_scanned;
+        return results;
+    }
+
+
     void getNeighborsByHeuristic2(
             std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates,
     const size_t M) {
@@ -423,13 +1151,15 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
-    linklistsizeint *get_linklist0(tableint internal_id) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+    std::unique_lock <std::mutex> lockLinkList(tableint internal_id) {
+        if (skip_link_locks_)
+            return std::unique_lock <std::mutex>(link_list_locks_[internal_id], std::defer_lock);
+        return std::unique_lock <std::mutex>(link_list_locks_[internal_id]);
     }
 
 
-    linklistsizeint *get_linklist0(tableint internal_id, char *data_level0_memory_) const {
-        return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+    linklistsizeint *get_linklist0(tableint internal_id) const {
+        return (linklistsizeint *) (getElementPtr(internal_id) + offsetLevel0_);
     }
 
 
@@ -443,6 +1173,228 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    std::atomic<unsigned int> *linksVersion(tableint internal_id) const {
+        return element_versions_ ? &element_versions_[internal_id & (VERSION_STRIPES - 1)] : nullptr;
+    }
+
+
+    std::atomic<unsigned int> *dataVersion(tableint internal_id) const {
+        return element_versions_ ? &element_versions_[VERSION_STRIPES + (internal_id & (VERSION_STRIPES - 1))] : nullptr;
+    }
+
+
+    /*
+    * Brackets a change that searches may read concurrently, the writer still holds the usual locks.
+    * Both do nothing unless lock-free search is enabled.
+    */
+    static void beginElementWrite(std::atomic<unsigned int> *version) {
+        if (!version)
+            return;
+        version->fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+
+    static void endElementWrite(std::atomic<unsigned int> *version) {
+        if (version)
+            version->fetch_add(VERSION_WRITERS_MASK, std::memory_order_release);
+    }
+
+
+    static unsigned int beginElementRead(const std::atomic<unsigned int> *version) {
+        unsigned int value = version->load(std::memory_order_acquire);
+        while (value & VERSION_WRITERS_MASK) {
+            std::this_thread::yield();
+            value = version->load(std::memory_order_acquire);
+        }
+        return value;
+    }
+
+
+    static bool endElementRead(const std::atomic<unsigned int> *version, unsigned int value) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version->load(std::memory_order_relaxed) == value;
+    }
+
+
+    /*
+    * Returns the link list of the element at the level for a search. With lock-free search the list
+    * is copied to buffer, which holds maxM0_ + 1 values, while no writer changes it; the copy has the
+    * layout of the stored list. Otherwise the stored list is returned.
+    */
+    linklistsizeint *readLinkList(const Table &table, tableint internal_id, int level, linklistsizeint *buffer) const {
+        linklistsizeint *ll = get_linklist_at_level(table, internal_id, level);
+        std::atomic<unsigned int> *version = linksVersion(internal_id);
+        if (!version)
+            return ll;
+        size_t capacity = level ? maxM_ : maxM0_;
+        while (true) {
+            unsigned int value = beginElementRead(version);
+            buffer[0] = ll[0];
+            size_t size = std::min((size_t) getListCount(buffer), capacity);
+            memcpy(buffer + 1, ll + 1, size * sizeof(tableint));
+            if (endElementRead(version, value))
+                return buffer;
+        }
+    }
+
+
+    /*
+    * Distance from the query to the vector of the element, recomputed if an update of the vector
+    * overlapped with it under lock-free search.
+    */
+    dist_t readDistance(const Table &table, const void *query_data, tableint internal_id) const {
+        std::atomic<unsigned int> *version = dataVersion(internal_id);
+        if (!version)
+            return fstdistfunc_(query_data, getDataByInternalId(table, internal_id), dist_func_param_);
+        while (true) {
+            unsigned int value = beginElementRead(version);
+            dist_t dist = fstdistfunc_(query_data, getDataByInternalId(table, internal_id), dist_func_param_);
+            if (endElementRead(version, value))
+                return dist;
+        }
+    }
+
+
+    /*
+    * Copies the vector of the element to buffer, which holds data_size_ bytes, without a concurrent
+    * update of the vector under lock-free search.
+    */
+    void readData(const Table &table, tableint internal_id, char *buffer) const {
+        std::atomic<unsigned int> *version = dataVersion(internal_id);
+        while (true) {
+            unsigned int value = version ? beginElementRead(version) : 0;
+            memcpy(buffer, getDataByInternalId(table, internal_id), data_size_);
+            if (!version || endElementRead(version, value))
+                return;
+        }
+    }
+
+
+    /*
+    * Registers a search under lock-free search, so that resizeIndex does not free the arrays the
+    * search may still read, and then loads the table of the arrays. A resize that publishes a newer
+    * table waits for the search, so no element the search can reach lies beyond its table.
+    */
+    class ReadGuard {
+        const HierarchicalNSW *index_{nullptr};
+        size_t slot_{0};
+        const Table *table_{nullptr};
+
+     public:
+        explicit ReadGuard(const HierarchicalNSW *index) {
+            if (index->element_versions_) {
+                index_ = index;
+                while (true) {
+                    size_t epoch = index->read_epoch_.load();
+                    slot_ = epoch & 1;
+                    index->active_reads_[slot_].fetch_add(1);
+                    if (index->read_epoch_.load() == epoch && !index->exclusive_.load())
+                        break;
+                    index->active_reads_[slot_].fetch_sub(1);
+                    while (index->exclusive_.load())
+                        std::this_thread::yield();
+                }
+            }
+            table_ = index->table_.load();
+        }
+
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+
+        const Table &table() const {
+            return *table_;
+        }
+
+        ~ReadGuard() {
+            if (index_)
+                index_->active_reads_[slot_].fetch_sub(1);
+        }
+    };
+
+
+    /*
+    * Waits until the searches that started before the call have ended. New searches register in
+    * the other reader count, so the wait ends even while searches keep coming.
+    */
+    void waitForReaders() const {
+        if (!element_versions_)
+            return;
+        size_t epoch = read_epoch_.fetch_add(1);
+        while (active_reads_[epoch & 1].load() != 0)
+            std::this_thread::yield();
+    }
+
+
+    /*
+    * Registers an insert or another access to the arrays outside of searches, so that growing the
+    * capacity waits for it to end; the access waits while the capacity grows. Must not be held
+    * while calling reserveForInsert or resizeIndex.
+    */
+    class AccessGuard {
+        const HierarchicalNSW *index_;
+        bool entered_{false};
+
+     public:
+        explicit AccessGuard(const HierarchicalNSW *index) : index_(index) {
+            enter();
+        }
+
+        AccessGuard(const AccessGuard &) = delete;
+        AccessGuard &operator=(const AccessGuard &) = delete;
+
+        void enter() {
+            while (true) {
+                index_->active_accesses_.fetch_add(1);
+                if (!index_->resizing_.load())
+                    break;
+                index_->active_accesses_.fetch_sub(1);
+                while (index_->resizing_.load())
+                    std::this_thread::yield();
+            }
+            entered_ = true;
+        }
+
+        void leave() {
+            if (entered_)
+                index_->active_accesses_.fetch_sub(1);
+            entered_ = false;
+        }
+
+        ~AccessGuard() {
+            leave();
+        }
+    };
+
+
+    /*
+    * Gives one thread sole access to the index for changes made in place, like renumbering the
+    * elements: takes resize_lock_, waits for the accesses as growing the capacity does, and then
+    * keeps new searches out and waits for the running ones under lock-free search.
+    */
+    class ExclusiveGuard {
+        HierarchicalNSW *index_;
+        std::unique_lock<std::mutex> lock_resize_;
+
+     public:
+        explicit ExclusiveGuard(HierarchicalNSW *index) : index_(index), lock_resize_(index->resize_lock_) {
+            index_->resizing_ = true;
+            while (index_->active_accesses_.load() != 0)
+                std::this_thread::yield();
+            index_->exclusive_ = true;
+            index_->waitForReaders();
+        }
+
+        ExclusiveGuard(const ExclusiveGuard &) = delete;
+        ExclusiveGuard &operator=(const ExclusiveGuard &) = delete;
+
+        ~ExclusiveGuard() {
+            index_->exclusive_ = false;
+            index_->resizing_ = false;
+        }
+    };
+
+
     tableint mutuallyConnectNewElement(
         const void *data_point,
         tableint cur_c,
@@ -479,20 +1431,22 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             if (*ll_cur && !isUpdate) {
                 throw std::runtime_error("The newly inserted element should have blank link list");
             }
-            setListCount(ll_cur, selectedNeighbors.size());
             tableint *data = (tableint *) (ll_cur + 1);
             for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
                 if (data[idx] && !isUpdate)
                     throw std::runtime_error("Possible memory corruption");
                 if (level > element_levels_[selectedNeighbors[idx]])
                     throw std::runtime_error("Trying to make a link on a non-existent level");
-
-                data[idx] = selectedNeighbors[idx];
             }
+            beginElementWrite(linksVersion(cur_c));
+            setListCount(ll_cur, selectedNeighbors.size());
+            for (size_t idx = 0; idx < selectedNeighbors.size(); idx++)
+                data[idx] = selectedNeighbors[idx];
+            endElementWrite(linksVersion(cur_c));
         }
 
         for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
-            std::unique_lock <std::mutex> lock(link_list_locks_[selectedNeighbors[idx]]);
+            std::unique_lock <std::mutex> lock = lockLinkList(selectedNeighbors[idx]);
 
             linklistsizeint *ll_other;
             if (level == 0)
@@ -524,8 +1478,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             // If cur_c is already present in the neighboring connections of `selectedNeighbors[idx]` then no need to modify any connections or run the heuristics.
             if (!is_cur_c_present) {
                 if (sz_link_list_other < Mcurmax) {
+                    beginElementWrite(linksVersion(selectedNeighbors[idx]));
                     data[sz_link_list_other] = cur_c;
                     setListCount(ll_other, sz_link_list_other + 1);
+                    endElementWrite(linksVersion(selectedNeighbors[idx]));
+                } else if (deferred_links_) {
+                    (*deferred_links_)[selectedNeighbors[idx]].emplace_back(level, cur_c);
                 } else {
                     // finding the "weakest" element to replace it with the new one
                     dist_t d_max = fstdistfunc_(getDataByInternalId(cur_c), getDataByInternalId(selectedNeighbors[idx]),
@@ -542,6 +1500,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
                     getNeighborsByHeuristic2(candidates, Mcurmax);
 
+                    beginElementWrite(linksVersion(selectedNeighbors[idx]));
                     int indx = 0;
                     while (candidates.size() > 0) {
                         data[indx] = candidates.top().second;
@@ -550,6 +1509,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     }
 
                     setListCount(ll_other, indx);
+                    endElementWrite(linksVersion(selectedNeighbors[idx]));
                     // Nearest K:
                     /*int indx = -1;
                     for (int j = 0; j < sz_link_list_other; j++) {
@@ -566,58 +1526,391 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             }
         }
 
-        return next_closest_entry_point;
+        return next_closest_entry_point;
+    }
+
+
+    /*
+    * Changes the capacity of the index. The inserts, updates and deletions in progress finish first
+    * and the new ones wait for the resize. Searches may run concurrently when lock-free search is
+    * enabled, the replaced arrays are freed once the searches that loaded them have ended.
+    */
+    void resizeIndex(size_t new_max_elements) {
+        std::unique_lock <std::mutex> lock_resize(resize_lock_);
+        resizeIndexLocked(new_max_elements);
+    }
+
+
+    /*
+    * resizeIndex with resize_lock_ held.
+    */
+    void resizeIndexLocked(size_t new_max_elements) {
+        resizing_ = true;
+        while (active_accesses_.load() != 0)
+            std::this_thread::yield();
+        try {
+            resizeArrays(new_max_elements);
+        } catch (...) {
+            resizing_ = false;
+            throw;
+        }
+        resizing_ = false;
+    }
+
+
+    /*
+    * Replaces the arrays with ones for new_max_elements elements and publishes them to the searches.
+    */
+    void resizeArrays(size_t new_max_elements) {
+        if (new_max_elements < cur_element_count)
+            throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
+
+        // Grow or shrink the base layer by whole segments
+        std::vector<char *> retired_segments;
+        std::vector<char *> segments = resizeSegments(max_elements_, new_max_elements, retired_segments);
+
+        // Reallocate all other layers
+        char **link_lists = (char **) malloc(sizeof(void *) * new_max_elements);
+        if (link_lists == nullptr) {
+            for (size_t i = 0; i < segments.size(); i++) {
+                if (i >= data_level0_segments_.size() || segments[i] != data_level0_segments_[i])
+                    free(segments[i]);
+            }
+            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate other layers");
+        }
+        memcpy(link_lists, linkLists_, sizeof(void *) * std::min(max_elements_, new_max_elements));
+
+        std::vector<int> element_levels(new_max_elements);
+        std::copy_n(element_levels_.begin(), std::min(max_elements_, new_max_elements), element_levels.begin());
+
+        // the visited lists are replaced as they are handed out, a shared pool only ever grows
+        visited_list_pool_->reserve(new_max_elements);
+
+        while (link_list_locks_.size() < new_max_elements)
+            link_list_locks_.emplace_back();
+        while (link_list_locks_.size() > new_max_elements)
+            link_list_locks_.pop_back();
+
+        // the swapped out arrays stay valid for the searches that loaded the old table
+        data_level0_segments_.swap(segments);
+        element_levels_.swap(element_levels);
+        std::swap(linkLists_, link_lists);
+        max_elements_ = new_max_elements;
+        const Table *retired_table = publishTable();
+
+        waitForReaders();
+        delete retired_table;
+        for (char *segment : retired_segments)
+            free(segment);
+        free(link_lists);
+    }
+
+
+    /*
+    * Physically removes the elements marked as deleted. Links that pointed to a deleted element are
+    * repaired with the heuristic from the live elements reachable through it, and the remaining
+    * elements are renumbered densely. If shrink_to_fit is set, the capacity is reduced to the
+    * number of remaining elements and the link lists are repacked; otherwise the freed slots and
+    * link blocks are kept for reuse by later insertions. Returns the number of bytes released,
+    * which is 0 without shrink_to_fit. Waits for the other operations on the index, which wait
+    * until it is done.
+    */
+    size_t compact(bool shrink_to_fit = true) {
+        ExclusiveGuard exclusive(this);
+        if (num_deleted_ == 0) {
+            if (shrink_to_fit && max_elements_ > cur_element_count)
+                return shrinkToFitExclusive();
+            return 0;
+        }
+
+        size_t element_count = cur_element_count;
+        for (tableint i = 0; i < element_count; i++) {
+            if (isMarkedDeleted(i))
+                continue;
+            for (int level = 0; level <= element_levels_[i]; level++)
+                repairConnectionsForCompact(i, level);
+        }
+
+        // Pick a new entry point on the highest level that still has a live element
+        tableint new_enterpoint = enterpoint_node_;
+        int new_maxlevel = maxlevel_;
+        if (isMarkedDeleted(enterpoint_node_)) {
+            new_maxlevel = -1;
+            for (tableint i = 0; i < element_count; i++) {
+                if (!isMarkedDeleted(i) && element_levels_[i] > new_maxlevel) {
+                    new_maxlevel = element_levels_[i];
+                    new_enterpoint = i;
+                }
+            }
+        }
+
+        std::vector<tableint> new_ids(element_count);
+        tableint live_count = 0;
+        for (tableint i = 0; i < element_count; i++) {
+            if (!isMarkedDeleted(i))
+                new_ids[i] = live_count++;
+        }
+
+        for (tableint i = 0; i < element_count; i++) {
+            if (isMarkedDeleted(i)) {
+                if (element_levels_[i] > 0)
+                    link_list_arena_->deallocate(linkLists_[i], element_levels_[i]);
+                continue;
+            }
+
+            tableint new_id = new_ids[i];
+            if (new_id != i) {
+                memcpy(getElementPtr(new_id), getElementPtr(i), size_data_per_element_);
+                linkLists_[new_id] = linkLists_[i];
+                element_levels_[new_id] = element_levels_[i];
+            }
+
+            for (int level = 0; level <= element_levels_[new_id]; level++) {
+                linklistsizeint *ll = get_linklist_at_level(new_id, level);
+                size_t size = getListCount(ll);
+                tableint *data = (tableint *) (ll + 1);
+                for (size_t j = 0; j < size; j++)
+                    data[j] = new_ids[data[j]];
+            }
+        }
+        for (size_t i = live_count; i < element_count; i++)
+            element_levels_[i] = 0;
+
+        {
+            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+            label_lookup_.clear();
+            label_lookup_.reserve(live_count);
+            for (tableint i = 0; i < live_count; i++)
+                label_lookup_[getExternalLabel(i)] = i;
+        }
+        {
+            std::unique_lock <std::mutex> lock_deleted_elements(deleted_elements_lock);
+            deleted_elements.clear();
+        }
+
+        cur_element_count = live_count;
+        num_deleted_ = 0;
+        if (live_count == 0) {
+            enterpoint_node_ = -1;
+            maxlevel_ = -1;
+        } else {
+            enterpoint_node_ = new_ids[new_enterpoint];
+            maxlevel_ = new_maxlevel;
+        }
+
+        if (shrink_to_fit)
+            return shrinkToFitExclusive();
+        return 0;
+    }
+
+
+    /*
+    * Replaces the links of a live element that point to deleted elements. The candidates are the live
+    * neighbours plus the live elements reachable through chains of deleted neighbours.
+    */
+    void repairConnectionsForCompact(tableint internalId, int level) {
+        linklistsizeint *ll_cur = get_linklist_at_level(internalId, level);
+        size_t size = getListCount(ll_cur);
+        tableint *data = (tableint *) (ll_cur + 1);
+
+        bool has_deleted = false;
+        for (size_t j = 0; j < size; j++) {
+            if (isMarkedDeleted(data[j])) {
+                has_deleted = true;
+                break;
+            }
+        }
+        if (!has_deleted)
+            return;
+
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+        std::vector<tableint> deleted_frontier;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+        visited_array[internalId] = visited_array_tag;
+
+        auto add_candidate = [&](tableint cand) {
+            if (visited_array[cand] == visited_array_tag)
+                return;
+            visited_array[cand] = visited_array_tag;
+            if (isMarkedDeleted(cand)) {
+                deleted_frontier.push_back(cand);
+                return;
+            }
+            dist_t dist = fstdistfunc_(getDataByInternalId(internalId), getDataByInternalId(cand), dist_func_param_);
+            candidates.emplace(dist, cand);
+            if (candidates.size() > ef_construction_)
+                candidates.pop();
+        };
+
+        for (size_t j = 0; j < size; j++)
+            add_candidate(data[j]);
+        while (!deleted_frontier.empty()) {
+            tableint deleted_id = deleted_frontier.back();
+            deleted_frontier.pop_back();
+            linklistsizeint *ll_deleted = get_linklist_at_level(deleted_id, level);
+            size_t size_deleted = getListCount(ll_deleted);
+            tableint *data_deleted = (tableint *) (ll_deleted + 1);
+            for (size_t j = 0; j < size_deleted; j++)
+                add_candidate(data_deleted[j]);
+        }
+        visited_list_pool_->releaseVisitedList(vl);
+
+        getNeighborsByHeuristic2(candidates, level == 0 ? maxM0_ : maxM_);
+
+        size_t new_size = candidates.size();
+        setListCount(ll_cur, new_size);
+        for (size_t idx = 0; idx < new_size; idx++) {
+            data[idx] = candidates.top().second;
+            candidates.pop();
+        }
     }
 
 
-    void resizeIndex(size_t new_max_elements) {
-        if (new_max_elements < cur_element_count)
-            throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
+    /*
+    * Reduces the capacity to the current number of elements and repacks the link lists, returns
+    * the number of bytes released. Waits for the other operations on the index like compact.
+    */
+    size_t shrinkToFit() {
+        ExclusiveGuard exclusive(this);
+        return shrinkToFitExclusive();
+    }
+
+
+    /*
+    * shrinkToFit with an ExclusiveGuard held.
+    */
+    size_t shrinkToFitExclusive() {
+        size_t released = repackLinkLists();
+        size_t new_max_elements = std::max<size_t>(cur_element_count, 1);
+        if (new_max_elements >= max_elements_)
+            return released;
+        size_t bytes_before = getArrayBytes();
+        resizeArrays(new_max_elements);
+        return released + bytes_before - getArrayBytes();
+    }
 
-        delete visited_list_pool_;
-        visited_list_pool_ = new VisitedListPool(1, new_max_elements);
 
-        element_levels_.resize(new_max_elements);
+    /*
+    * Bytes held by the arrays sized by the capacity: the base layer segments, the link list
+    * pointers, the element levels and the link list locks.
+    */
+    size_t getArrayBytes() const {
+        size_t bytes = 0;
+        for (size_t i = 0; i < data_level0_segments_.size(); i++) {
+            size_t begin = i << segment_shift_;
+            bytes += std::min(segment_mask_ + 1, max_elements_ - begin) * size_data_per_element_;
+        }
+        bytes += max_elements_ * sizeof(void *);
+        bytes += element_levels_.capacity() * sizeof(int);
+        bytes += link_list_locks_.size() * sizeof(std::mutex);
+        return bytes;
+    }
 
-        std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
 
-        // Reallocate base layer
-        char * data_level0_memory_new = (char *) realloc(data_level0_memory_, new_max_elements * size_data_per_element_);
-        if (data_level0_memory_new == nullptr)
-            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate base layer");
-        data_level0_memory_ = data_level0_memory_new;
+    /*
+    * Copies the upper-layer link lists into a new arena sized for them, so that the chunks holding
+    * the free blocks of removed elements are released. Returns the number of bytes released, 0 if
+    * the arena is shared with other indexes or would not get smaller. Needs an ExclusiveGuard.
+    */
+    size_t repackLinkLists() {
+        if (!owns_link_list_arena_)
+            return 0;
+        size_t total_size = 0;
+        for (tableint i = 0; i < cur_element_count; i++)
+            total_size += size_links_per_element_ * element_levels_[i];
+
+        std::unique_ptr<LinkListArena> arena(new LinkListArena(size_links_per_element_));
+        arena->reserve(total_size);
+        if (arena->getBytesReserved() >= link_list_arena_->getBytesReserved())
+            return 0;
+        for (tableint i = 0; i < cur_element_count; i++) {
+            if (element_levels_[i] == 0)
+                continue;
+            char *block = arena->allocate(element_levels_[i]);
+            memcpy(block, linkLists_[i], size_links_per_element_ * element_levels_[i]);
+            linkLists_[i] = block;
+        }
+        size_t released = link_list_arena_->getBytesReserved() - arena->getBytesReserved();
+        delete link_list_arena_;
+        link_list_arena_ = arena.release();
+        return released;
+    }
 
-        // Reallocate all other layers
-        char ** linkLists_new = (char **) realloc(linkLists_, sizeof(void *) * new_max_elements);
-        if (linkLists_new == nullptr)
-            throw std::runtime_error("Not enough memory: resizeIndex failed to allocate other layers");
-        linkLists_ = linkLists_new;
 
-        max_elements_ = new_max_elements;
+    /*
+    * Returns the size of the vectors stored in an index image, read from its header, or 0 if the image
+    * is too short to hold a header.
+    */
+    static size_t getStoredDataSize(const std::vector<char>& buffer) {
+        // magic, version, then offsetLevel0_, max_elements_, cur_element_count, size_data_per_element_,
+        // label_offset_ and offsetData_
+        size_t fields[6];
+        size_t offset = 0;
+        if (buffer.size() >= sizeof(size_t) && *(const size_t *) buffer.data() == IMAGE_MAGIC)
+            offset = sizeof(size_t) + sizeof(unsigned int);
+        if (buffer.size() < offset + sizeof(fields))
+            return 0;
+        memcpy(fields, buffer.data() + offset, sizeof(fields));
+        return fields[4] - fields[5];
     }
 
 
+    /*
+    * Writes the index image: the header, the base layer, the levels of the elements and then all the
+    * upper-layer link lists back to back in element order, so that loading reads them in one block.
+    */
     std::vector<char> saveIndexToBuffer() {
         std::stringstream output;
+        size_t magic = IMAGE_MAGIC;
+        unsigned int version = IMAGE_VERSION;
+        writeBinaryPOD(output, magic);
+        writeBinaryPOD(output, version);
         writeBinaryPOD(output, offsetLevel0_);
         writeBinaryPOD(output, max_elements_);
         writeBinaryPOD(output, cur_element_count);
         writeBinaryPOD(output, size_data_per_element_);
         writeBinaryPOD(output, label_offset_);
         writeBinaryPOD(output, offsetData_);
-        writeBinaryPOD(output, maxlevel_);
-        writeBinaryPOD(output, enterpoint_node_);
+        int maxlevel = maxlevel_;
+        tableint enterpoint_node = enterpoint_node_;
+        writeBinaryPOD(output, maxlevel);
+        writeBinaryPOD(output, enterpoint_node);
         writeBinaryPOD(output, maxM_);
         writeBinaryPOD(output, maxM0_);
         writeBinaryPOD(output, M_);
         writeBinaryPOD(output, mult_);
         writeBinaryPOD(output, ef_construction_);
-        output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+        for (size_t begin = 0; begin < cur_element_count; begin += segment_mask_ + 1) {
+            size_t count = std::min(segment_mask_ + 1, cur_element_count - begin);
+            output.write(data_level0_segments_[begin >> segment_shift_], count * size_data_per_element_);
+        }
+        output.write((const char *) element_levels_.data(), cur_element_count * sizeof(int));
+
+        // the lists are already back to back after loading or repacking, otherwise they are gathered
+        size_t upper_size = 0;
+        bool contiguous = true;
+        const char *first = nullptr;
         for (size_t i = 0; i < cur_element_count; i++) {
-            unsigned int linkListSize = element_levels_[i] > 0 ? size_links_per_element_ * element_levels_[i] : 0;
-            writeBinaryPOD(output, linkListSize);
-            if (linkListSize)
-                output.write(linkLists_[i], linkListSize);
+            if (element_levels_[i] == 0)
+                continue;
+            if (!first)
+                first = linkLists_[i];
+            contiguous = contiguous && linkLists_[i] == first + upper_size;
+            upper_size += size_links_per_element_ * element_levels_[i];
+        }
+        if (contiguous) {
+            output.write(first, upper_size);
+        } else {
+            std::vector<char> upper(upper_size);
+            size_t offset = 0;
+            for (size_t i = 0; i < cur_element_count; i++) {
+                size_t size = size_links_per_element_ * element_levels_[i];
+                memcpy(upper.data() + offset, linkLists_[i], size);
+                offset += size;
+            }
+            output.write(upper.data(), upper_size);
         }
         std::string str = output.str();
         return std::vector<char>(str.begin(), str.end());
@@ -633,7 +1926,18 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         std::streampos total_filesize = input.tellg();
         input.seekg(0, input.beg);
 
-        readBinaryPOD(input, offsetLevel0_);
+        // the images without a version store the upper-layer link lists one by one, each after its size
+        size_t magic;
+        unsigned int version = 0;
+        readBinaryPOD(input, magic);
+        if (magic == IMAGE_MAGIC) {
+            readBinaryPOD(input, version);
+            if (version != IMAGE_VERSION)
+                throw std::runtime_error("Index was saved in an unsupported format version " + std::to_string(version));
+            readBinaryPOD(input, offsetLevel0_);
+        } else {
+            offsetLevel0_ = magic;
+        }
         readBinaryPOD(input, max_elements_);
         readBinaryPOD(input, cur_element_count);
 
@@ -641,8 +1945,12 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         readBinaryPOD(input, size_data_per_element_);
         readBinaryPOD(input, label_offset_);
         readBinaryPOD(input, offsetData_);
-        readBinaryPOD(input, maxlevel_);
-        readBinaryPOD(input, enterpoint_node_);
+        int maxlevel;
+        tableint enterpoint_node;
+        readBinaryPOD(input, maxlevel);
+        readBinaryPOD(input, enterpoint_node);
+        maxlevel_ = maxlevel;
+        enterpoint_node_ = enterpoint_node;
 
         readBinaryPOD(input, maxM_);
         readBinaryPOD(input, maxM0_);
@@ -650,15 +1958,39 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         readBinaryPOD(input, mult_);
         readBinaryPOD(input, ef_construction_);
 
+        // the header and the labels are size_t, so images of wasm32 and wasm64 builds differ
+        if (label_offset_ + sizeof(labeltype) != size_data_per_element_ || offsetData_ >= label_offset_)
+            throw std::runtime_error("Index seems to be corrupted or was saved by a build with a different size_t width");
+
         data_size_ = s->get_data_size();
         fstdistfunc_ = s->get_dist_func();
         dist_func_param_ = s->get_dist_func_param();
+        if (label_offset_ - offsetData_ != data_size_)
+            throw std::runtime_error("Index was saved with a different space or dimension");
+
+        size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
+
+        size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
 
         auto pos = input.tellg();
 
         /// Optional - check if index is ok:
+        size_t total_link_lists_size = 0;
+        std::vector<int> levels;
         input.seekg(cur_element_count * size_data_per_element_, input.cur);
-        for (size_t i = 0; i < cur_element_count; i++) {
+        if (version) {
+            levels.resize(cur_element_count);
+            input.read((char *) levels.data(), cur_element_count * sizeof(int));
+            if (!input)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            for (int level : levels) {
+                if (level < 0 || level > maxlevel_)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                total_link_lists_size += size_links_per_element_ * level;
+            }
+            input.seekg(total_link_lists_size, input.cur);
+        }
+        for (size_t i = 0; !version && i < cur_element_count; i++) {
             if (input.tellg() < 0 || input.tellg() >= total_filesize) {
                 throw std::runtime_error("Index seems to be corrupted or unsupported");
             }
@@ -667,6 +1999,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             readBinaryPOD(input, linkListSize);
             if (linkListSize != 0) {
                 input.seekg(linkListSize, input.cur);
+                total_link_lists_size += linkListSize;
             }
         }
 
@@ -679,26 +2012,53 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
         input.seekg(pos, input.beg);
 
-        data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);
-        if (data_level0_memory_ == nullptr)
-            throw std::runtime_error("Not enough memory: loadIndex failed to allocate level0");
-        input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
+        for (char *segment : data_level0_segments_)
+            free(segment);
+        data_level0_segments_.clear();
+        initSegments();
+        std::vector<char *> retired_segments;
+        data_level0_segments_ = resizeSegments(0, max_elements, retired_segments);
+        for (size_t begin = 0; begin < cur_element_count; begin += segment_mask_ + 1) {
+            size_t count = std::min(segment_mask_ + 1, cur_element_count - begin);
+            input.read(data_level0_segments_[begin >> segment_shift_], count * size_data_per_element_);
+        }
 
-        size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
+        std::deque<std::mutex>(max_elements).swap(link_list_locks_);
 
-        size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
-        std::vector<std::mutex>(max_elements).swap(link_list_locks_);
+        // all upper-layer link lists of the image are placed in one chunk
+        if (owns_link_list_arena_)
+            delete link_list_arena_;
+        link_list_arena_ = new LinkListArena(size_links_per_element_);
+        owns_link_list_arena_ = true;
+        link_list_arena_->reserve(total_link_lists_size);
         std::vector<std::mutex>(MAX_LABEL_OPERATION_LOCKS).swap(label_op_locks_);
+        shared_label_op_locks_ = nullptr;
 
+        if (owns_visited_list_pool_)
+            delete visited_list_pool_;
         visited_list_pool_ = new VisitedListPool(1, max_elements);
+        owns_visited_list_pool_ = true;
 
         linkLists_ = (char **) malloc(sizeof(void *) * max_elements);
         if (linkLists_ == nullptr)
             throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklists");
         element_levels_ = std::vector<int>(max_elements);
+        delete publishTable();
         revSize_ = 1.0 / mult_;
         ef_ = 10;
-        for (size_t i = 0; i < cur_element_count; i++) {
+        label_lookup_.reserve(cur_element_count);
+        if (version) {
+            std::copy(levels.begin(), levels.end(), element_levels_.begin());
+            input.seekg(cur_element_count * sizeof(int), input.cur);
+            char *block = link_list_arena_->allocateRegion(total_link_lists_size);
+            input.read(block, total_link_lists_size);
+            for (size_t i = 0; i < cur_element_count; i++) {
+                label_lookup_[getExternalLabel(i)] = i;
+                linkLists_[i] = element_levels_[i] ? block : nullptr;
+                block += size_links_per_element_ * element_levels_[i];
+            }
+        }
+        for (size_t i = 0; !version && i < cur_element_count; i++) {
             label_lookup_[getExternalLabel(i)] = i;
             unsigned int linkListSize;
             readBinaryPOD(input, linkListSize);
@@ -707,9 +2067,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                 linkLists_[i] = nullptr;
             } else {
                 element_levels_[i] = linkListSize / size_links_per_element_;
-                linkLists_[i] = (char *) malloc(linkListSize);
-                if (linkLists_[i] == nullptr)
-                    throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklist");
+                linkLists_[i] = link_list_arena_->allocate(element_levels_[i]);
                 input.read(linkLists_[i], linkListSize);
             }
         }
@@ -729,7 +2087,8 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     std::vector<data_t> getDataByLabel(labeltype label) const {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
-        
+        AccessGuard access_guard(this);
+
         std::unique_lock <std::mutex> lock_table(label_lookup_lock);
         auto search = label_lookup_.find(label);
         if (search == label_lookup_.end() || isMarkedDeleted(search->second)) {
@@ -756,6 +2115,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     void markDelete(labeltype label) {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
+        AccessGuard access_guard(this);
 
         std::unique_lock <std::mutex> lock_table(label_lookup_lock);
         auto search = label_lookup_.find(label);
@@ -798,6 +2158,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     void unmarkDelete(labeltype label) {
         // lock all operations with element by label
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
+        AccessGuard access_guard(this);
 
         std::unique_lock <std::mutex> lock_table(label_lookup_lock);
         auto search = label_lookup_.find(label);
@@ -855,6 +2216,16 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     * If replacement of deleted elements is enabled: replaces previously deleted point if any, updating it with new point
     */
     void addPoint(const void *data_point, labeltype label, bool replace_deleted = false) {
+        addPoint(data_point, label, replace_deleted, nullptr);
+    }
+
+
+    /*
+    * Same as addPoint, but reports through replaced_label the label of the deleted element whose place was taken.
+    * Returns false if no deleted element was replaced.
+    * If the label itself belongs to a deleted element, its own place is reused.
+    */
+    bool addPoint(const void *data_point, labeltype label, bool replace_deleted, labeltype *replaced_label) {
         if ((allow_replace_deleted_ == false) && (replace_deleted == true)) {
             throw std::runtime_error("Replacement of deleted elements is disabled in constructor");
         }
@@ -863,14 +2234,34 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         std::unique_lock <std::mutex> lock_label(getLabelOpMutex(label));
         if (!replace_deleted) {
             addPoint(data_point, label, -1);
-            return;
+            return false;
+        }
+        // left before adding the point, which may grow the index
+        AccessGuard access_guard(this);
+
+        // an existing element is updated in place, a deleted one gets its own place back
+        bool is_existing = false;
+        tableint internal_id_existing = 0;
+        {
+            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+            auto search = label_lookup_.find(label);
+            if (search != label_lookup_.end()) {
+                is_existing = true;
+                internal_id_existing = search->second;
+            }
         }
+        if (is_existing && !isMarkedDeleted(internal_id_existing)) {
+            access_guard.leave();
+            addPoint(data_point, label, -1);
+            return false;
+        }
+
         // check if there is vacant place
         tableint internal_id_replaced;
         std::unique_lock <std::mutex> lock_deleted_elements(deleted_elements_lock);
         bool is_vacant_place = !deleted_elements.empty();
         if (is_vacant_place) {
-            internal_id_replaced = *deleted_elements.begin();
+            internal_id_replaced = is_existing ? internal_id_existing : *deleted_elements.begin();
             deleted_elements.erase(internal_id_replaced);
         }
         lock_deleted_elements.unlock();
@@ -878,26 +2269,143 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         // if there is no vacant place then add or update point
         // else add point to vacant place
         if (!is_vacant_place) {
+            access_guard.leave();
             addPoint(data_point, label, -1);
-        } else {
-            // we assume that there are no concurrent operations on deleted element
-            labeltype label_replaced = getExternalLabel(internal_id_replaced);
-            setExternalLabel(internal_id_replaced, label);
+            return false;
+        }
+
+        // we assume that there are no concurrent operations on deleted element
+        labeltype label_replaced = getExternalLabel(internal_id_replaced);
+        setExternalLabel(internal_id_replaced, label);
+
+        std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+        label_lookup_.erase(label_replaced);
+        label_lookup_[label] = internal_id_replaced;
+        lock_table.unlock();
+
+        unmarkDeletedInternal(internal_id_replaced);
+        updatePoint(data_point, internal_id_replaced, 1.0);
+
+        if (replaced_label)
+            *replaced_label = label_replaced;
+        return true;
+    }
+
+
+    /*
+    * Bulk load of an empty index: adds `count` points stored back to back, `labels[i]` being the label
+    * of the i-th point. The points are inserted by `num_threads` threads. Reverse links that do not fit
+    * into a full neighbor list are collected and each such list is pruned once at the end, instead of
+    * on every insertion. A single-threaded build also skips the link list locks, so the index must not
+    * be searched or modified until the call returns.
+    */
+    void buildFromBatch(const void *data, const labeltype *labels, size_t count, size_t num_threads = 1) {
+        if (cur_element_count != 0)
+            throw std::runtime_error("buildFromBatch can only be used on an empty index");
+        if (count == 0)
+            return;
+        if (!reserveForInsert(count))
+            throw std::runtime_error("The number of elements exceeds the specified limit");
+
+        const char *points = (const char *) data;
+        std::vector<std::vector<std::pair<int, tableint>>> deferred_links(max_elements_);
+        num_threads = std::max((size_t) 1, std::min(num_threads, count));
+        deferred_links_ = &deferred_links;
+        skip_link_locks_ = num_threads == 1;
+        try {
+            // the first element becomes the enter point, the others can then be added in any order
+            addPoint(points, labels[0], -1);
+            parallelFor(1, count, num_threads, [&](size_t i) {
+                std::unique_lock <std::mutex> lock_label(getLabelOpMutex(labels[i]));
+                addPoint(points + i * data_size_, labels[i], -1);
+            });
+            deferred_links_ = nullptr;
+            parallelFor(0, cur_element_count, num_threads, [&](size_t i) {
+                pruneDeferredLinks((tableint) i, deferred_links[i]);
+            });
+        } catch (...) {
+            deferred_links_ = nullptr;
+            skip_link_locks_ = false;
+            throw;
+        }
+        skip_link_locks_ = false;
+    }
+
+
+    /*
+    * Merges the reverse links deferred by buildFromBatch into the element's lists,
+    * keeping the neighbors chosen by the heuristic.
+    */
+    void pruneDeferredLinks(tableint internal_id, std::vector<std::pair<int, tableint>> &links) {
+        if (links.empty())
+            return;
+        std::sort(links.begin(), links.end());
+        const char *point = getDataByInternalId(internal_id);
+        for (size_t first = 0; first < links.size();) {
+            int level = links[first].first;
+            size_t last = first;
+            while (last < links.size() && links[last].first == level)
+                last++;
+
+            linklistsizeint *ll = get_linklist_at_level(internal_id, level);
+            size_t size = getListCount(ll);
+            tableint *data = (tableint *) (ll + 1);
+            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+            for (size_t j = 0; j < size; j++)
+                candidates.emplace(fstdistfunc_(point, getDataByInternalId(data[j]), dist_func_param_), data[j]);
+            for (size_t j = first; j < last; j++) {
+                tableint neighbor = links[j].second;
+                if (j > first && neighbor == links[j - 1].second)
+                    continue;
+                if (std::find(data, data + size, neighbor) != data + size)
+                    continue;
+                candidates.emplace(fstdistfunc_(point, getDataByInternalId(neighbor), dist_func_param_), neighbor);
+            }
+
+            getNeighborsByHeuristic2(candidates, level ? maxM_ : maxM0_);
+            size_t indx = 0;
+            while (candidates.size() > 0) {
+                data[indx++] = candidates.top().second;
+                candidates.pop();
+            }
+            setListCount(ll, indx);
+            first = last;
+        }
+        std::vector<std::pair<int, tableint>>().swap(links);
+    }
 
-            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
-            label_lookup_.erase(label_replaced);
-            label_lookup_[label] = internal_id_replaced;
-            lock_table.unlock();
 
-            unmarkDeletedInternal(internal_id_replaced);
-            updatePoint(data_point, internal_id_replaced, 1.0);
+    /*
+    * Calls fn(i) for every i in [begin, end), spread over num_threads threads of the shared
+    * ThreadPool. The first exception thrown stops the remaining calls and is rethrown.
+    */
+    template <typename Function>
+    static void parallelFor(size_t begin, size_t end, size_t num_threads, Function fn) {
+        if (num_threads <= 1) {
+            for (size_t i = begin; i < end; i++)
+                fn(i);
+            return;
         }
+
+        std::atomic<size_t> next(begin);
+        ThreadPool::instance().run(num_threads, [&](size_t) {
+            for (size_t i = next++; i < end; i = next++) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    next = end;
+                    throw;
+                }
+            }
+        });
     }
 
 
     void updatePoint(const void *dataPoint, tableint internalId, float updateNeighborProbability) {
         // update the feature vector associated with existing point with new vector
+        beginElementWrite(dataVersion(internalId));
         memcpy(getDataByInternalId(internalId), dataPoint, data_size_);
+        endElementWrite(dataVersion(internalId));
 
         int maxLevelCopy = maxlevel_;
         tableint entryPointCopy = enterpoint_node_;
@@ -960,12 +2468,14 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     linklistsizeint *ll_cur;
                     ll_cur = get_linklist_at_level(neigh, layer);
                     size_t candSize = candidates.size();
+                    beginElementWrite(linksVersion(neigh));
                     setListCount(ll_cur, candSize);
                     tableint *data = (tableint *) (ll_cur + 1);
                     for (size_t idx = 0; idx < candSize; idx++) {
                         data[idx] = candidates.top().second;
                         candidates.pop();
                     }
+                    endElementWrite(linksVersion(neigh));
                 }
             }
         }
@@ -974,6 +2484,135 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
+    /*
+    * Replaces the vectors of `count` existing elements, `labels[i]` being the label of the i-th point
+    * stored back to back in `data`. Gives the graph updatePoint would, but repairs each neighbor list
+    * once per chunk of updates: a neighbor linked to several updated elements is repaired once, from
+    * the union of their candidates, instead of once per updated element. The repairs and the
+    * reconnection of the updated elements run on `num_threads` threads. Throws before changing
+    * anything if a label is missing or marked deleted; a label given twice keeps its last vector.
+    */
+    void updatePoints(const void *data, const labeltype *labels, size_t count, float repair_probability,
+                      size_t num_threads = 1) {
+        AccessGuard access_guard(this);
+        const char *points = (const char *) data;
+        std::vector<std::pair<tableint, const char *>> updates;
+        {
+            std::unordered_map<tableint, size_t> positions;
+            std::unique_lock <std::mutex> lock_table(label_lookup_lock);
+            for (size_t i = 0; i < count; i++) {
+                auto search = label_lookup_.find(labels[i]);
+                if (search == label_lookup_.end() || isMarkedDeleted(search->second))
+                    throw std::runtime_error("Label not found");
+                positions[search->second] = i;
+            }
+            for (auto &position : positions)
+                updates.emplace_back(position.first, points + position.second * data_size_);
+        }
+        std::sort(updates.begin(), updates.end());
+
+        // the candidates are kept for one chunk at a time, and later chunks are repaired on the graph
+        // the earlier ones left, like consecutive updatePoint calls
+        for (size_t begin = 0; begin < updates.size(); begin += UPDATE_CHUNK_SIZE) {
+            size_t end = std::min(updates.size(), begin + UPDATE_CHUNK_SIZE);
+            updatePointsChunk(updates.data() + begin, end - begin, repair_probability, num_threads);
+        }
+    }
+
+
+    void updatePointsChunk(const std::pair<tableint, const char *> *updates, size_t count, float repair_probability,
+                           size_t num_threads) {
+        for (size_t i = 0; i < count; i++) {
+            beginElementWrite(dataVersion(updates[i].first));
+            memcpy(getDataByInternalId(updates[i].first), updates[i].second, data_size_);
+            endElementWrite(dataVersion(updates[i].first));
+        }
+        if (cur_element_count == 1)
+            return;
+
+        int maxLevelCopy = maxlevel_;
+        tableint entryPointCopy = enterpoint_node_;
+
+        // per updated element and level: the candidates updatePoint would use, the element, its
+        // neighbors and the neighbors of the sampled ones, and which of the neighbors were sampled
+        std::vector<std::vector<std::vector<tableint>>> sCands(count);
+        std::vector<std::map<tableint, std::vector<size_t>>> affected(maxLevelCopy + 1);
+        std::uniform_real_distribution<float> distribution(0.0, 1.0);
+        for (size_t i = 0; i < count; i++) {
+            tableint internalId = updates[i].first;
+            for (int layer = 0; layer <= element_levels_[internalId]; layer++) {
+                std::vector<tableint> listOneHop = getConnectionsWithLock(internalId, layer);
+                std::vector<tableint> sCand;
+                if (!listOneHop.empty())
+                    sCand.push_back(internalId);
+                for (tableint elOneHop : listOneHop) {
+                    sCand.push_back(elOneHop);
+                    if (distribution(update_probability_generator_) > repair_probability)
+                        continue;
+                    affected[layer][elOneHop].push_back(i);
+                    std::vector<tableint> listTwoHop = getConnectionsWithLock(elOneHop, layer);
+                    sCand.insert(sCand.end(), listTwoHop.begin(), listTwoHop.end());
+                }
+                std::sort(sCand.begin(), sCand.end());
+                sCand.erase(std::unique(sCand.begin(), sCand.end()), sCand.end());
+                sCands[i].push_back(std::move(sCand));
+            }
+        }
+
+        std::vector<std::pair<int, const std::pair<const tableint, std::vector<size_t>> *>> repairs;
+        for (int layer = 0; layer <= maxLevelCopy; layer++) {
+            for (auto &neigh : affected[layer])
+                repairs.emplace_back(layer, &neigh);
+        }
+
+        parallelFor(0, repairs.size(), num_threads, [&](size_t r) {
+            int layer = repairs[r].first;
+            tableint neigh = repairs[r].second->first;
+            const std::vector<size_t> &sources = repairs[r].second->second;
+            std::vector<tableint> merged;
+            if (sources.size() > 1) {
+                for (size_t i : sources)
+                    merged.insert(merged.end(), sCands[i][layer].begin(), sCands[i][layer].end());
+                std::sort(merged.begin(), merged.end());
+                merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+            }
+            const std::vector<tableint> &sCand = sources.size() > 1 ? merged : sCands[sources[0]][layer];
+
+            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+            size_t elementsToKeep = std::min(ef_construction_, sCand.size() - 1);  // sCand holds neigh
+            for (tableint cand : sCand) {
+                if (cand == neigh)
+                    continue;
+                dist_t distance = fstdistfunc_(getDataByInternalId(neigh), getDataByInternalId(cand), dist_func_param_);
+                if (candidates.size() < elementsToKeep) {
+                    candidates.emplace(distance, cand);
+                } else if (distance < candidates.top().first) {
+                    candidates.pop();
+                    candidates.emplace(distance, cand);
+                }
+            }
+            getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_);
+
+            std::unique_lock <std::mutex> lock(link_list_locks_[neigh]);
+            linklistsizeint *ll_cur = get_linklist_at_level(neigh, layer);
+            size_t candSize = candidates.size();
+            beginElementWrite(linksVersion(neigh));
+            setListCount(ll_cur, candSize);
+            tableint *ll_data = (tableint *) (ll_cur + 1);
+            for (size_t idx = 0; idx < candSize; idx++) {
+                ll_data[idx] = candidates.top().second;
+                candidates.pop();
+            }
+            endElementWrite(linksVersion(neigh));
+        });
+
+        parallelFor(0, count, num_threads, [&](size_t i) {
+            tableint internalId = updates[i].first;
+            repairConnectionsForUpdate(updates[i].second, entryPointCopy, internalId, element_levels_[internalId], maxLevelCopy);
+        });
+    }
+
+
     void repairConnectionsForUpdate(
         const void *dataPoint,
         tableint entryPointInternalId,
@@ -993,11 +2632,13 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     int size = getListCount(data);
                     tableint *datal = (tableint *) (data + 1);
 #ifdef USE_SSE
-                    _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
+                    if (size > 0)
+                        _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
 #endif
                     for (int i = 0; i < size; i++) {
 #ifdef USE_SSE
-                        _mm_prefetch(getDataByInternalId(*(datal + i + 1)), _MM_HINT_T0);
+                        if (i + 1 < size)
+                            _mm_prefetch(getDataByInternalId(*(datal + i + 1)), _MM_HINT_T0);
 #endif
                         tableint cand = datal[i];
                         dist_t d = fstdistfunc_(dataPoint, getDataByInternalId(cand), dist_func_param_);
@@ -1055,6 +2696,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
     tableint addPoint(const void *data_point, labeltype label, int level) {
         tableint cur_c = 0;
+        AccessGuard access_guard(this);
         {
             // Checking if the element with the same label already exists
             // if so, updating it *instead* of creating a new element.
@@ -1078,7 +2720,13 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             }
 
             if (cur_element_count >= max_elements_) {
-                throw std::runtime_error("The number of elements exceeds the specified limit");
+                // the growth waits for the other inserts and, with lock-free search, for the searches,
+                // one of which may be waiting for the label lookup lock
+                lock_table.unlock();
+                access_guard.leave();
+                if (!reserveForInsert(1))
+                    throw std::runtime_error("The number of elements exceeds the specified limit");
+                return addPoint(data_point, label, level);
             }
 
             cur_c = cur_element_count;
@@ -1086,7 +2734,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             label_lookup_[label] = cur_c;
         }
 
-        std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
+        std::unique_lock <std::mutex> lock_el = lockLinkList(cur_c);
         int curlevel = getRandomLevel(mult_);
         if (level > 0)
             curlevel = level;
@@ -1100,17 +2748,15 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
         tableint currObj = enterpoint_node_;
         tableint enterpoint_copy = enterpoint_node_;
 
-        memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+        memset(getElementPtr(cur_c) + offsetLevel0_, 0, size_data_per_element_);
 
         // Initialisation of the data and label
         memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
         memcpy(getDataByInternalId(cur_c), data_point, data_size_);
 
         if (curlevel) {
-            linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
-            if (linkLists_[cur_c] == nullptr)
-                throw std::runtime_error("Not enough memory: addPoint failed to allocate linklist");
-            memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+            linkLists_[cur_c] = link_list_arena_->allocate(curlevel);
+            memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel);
         }
 
         if ((signed)currObj != -1) {
@@ -1121,7 +2767,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
                     while (changed) {
                         changed = false;
                         unsigned int *data;
-                        std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
+                        std::unique_lock <std::mutex> lock = lockLinkList(currObj);
                         data = get_linklist(currObj, level);
                         int size = getListCount(data);
 
@@ -1163,6 +2809,7 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
 
         // Releasing lock for the maximum level
         if (curlevel > maxlevelcopy) {
+            // the store releases the links of the new enter point to the searches reaching it
             enterpoint_node_ = cur_c;
             maxlevel_ = curlevel;
         }
@@ -1170,31 +2817,44 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     }
 
 
-    std::priority_queue<std::pair<dist_t, labeltype >>
-    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
-        std::priority_queue<std::pair<dist_t, labeltype >> result;
-        if (cur_element_count == 0) return result;
-
-        tableint currObj = enterpoint_node_;
-        dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
-
-        for (int level = maxlevel_; level > 0; level--) {
+    /*
+    * Greedy descent from the enter point through the upper levels,
+    * returns the element to start the base layer search from, or -1 while
+    * a concurrent first insert has not published the enter point yet.
+    */
+    tableint searchUpperLayers(const Table &table, const void *query_data, SearchStats *stats = nullptr) const {
+        // an insert may replace the enter point meanwhile, the descent starts from the level of the one read
+        tableint enterpoint = enterpoint_node_;
+        if (enterpoint == (tableint) -1)
+            return enterpoint;
+        int maxlevel = std::min(maxlevel_.load(), table.element_levels[enterpoint]);
+        if (stats && stats->level_hops.size() < (size_t) maxlevel + 1)
+            stats->level_hops.resize(maxlevel + 1);
+        tableint currObj = enterpoint;
+        dist_t curdist = readDistance(table, query_data, enterpoint);
+        size_t upper_hops = 0;
+        size_t upper_neighbors_scanned = 0;
+        std::vector<linklistsizeint> links(element_versions_ ? maxM_ + 1 : 0);
+
+        for (int level = maxlevel; level > 0; level--) {
             bool changed = true;
             while (changed) {
                 changed = false;
                 unsigned int *data;
 
-                data = (unsigned int *) get_linklist(currObj, level);
+                data = (unsigned int *) readLinkList(table, currObj, level, links.data());
                 int size = getListCount(data);
-                metric_hops++;
-                metric_distance_computations+=size;
+                upper_hops++;
+                upper_neighbors_scanned += size;
+                if (stats)
+                    stats->level_hops[level]++;
 
                 tableint *datal = (tableint *) (data + 1);
                 for (int i = 0; i < size; i++) {
                     tableint cand = datal[i];
                     if (cand < 0 || cand > max_elements_)
                         throw std::runtime_error("cand error");
-                    dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
+                    dist_t d = readDistance(table, query_data, cand);
 
                     if (d < curdist) {
                         curdist = d;
@@ -1205,27 +2865,367 @@ class HierarchicalNSW : public AlgorithmInterface<dist_t> {
             }
         }
 
+        metric_hops += upper_hops;
+        metric_distance_computations += upper_neighbors_scanned;
+        if (stats) {
+            stats->hops += upper_hops;
+            stats->distance_computations += upper_neighbors_scanned + 1;
+        }
+        return currObj;
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        return searchKnn(query_data, k, isIdAllowed, nullptr);
+    }
+
+
+    /*
+    * Same as searchKnn, additionally reporting the work done for this query in `stats`.
+    */
+    std::priority_queue<std::pair<dist_t, labeltype >>
+    searchKnn(const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats *stats) const {
+        std::priority_queue<std::pair<dist_t, labeltype >> result;
+        if (stats)
+            *stats = SearchStats();
+        if (cur_element_count == 0) return result;
+        ReadGuard read_guard(this);
+        const Table &table = read_guard.table();
+
+        auto top_candidates = searchKnnInternal(table, query_data, k, isIdAllowed, stats);
+        while (top_candidates.size() > 0) {
+            std::pair<dist_t, tableint> rez = top_candidates.top();
+            result.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(table, rez.second)));
+            top_candidates.pop();
+        }
+        return result;
+    }
+
+
+    /*
+    * The k closest elements to the query as a max-heap of (distance, internal id), for searchKnn
+    * and the searches built on it. The caller holds a ReadGuard.
+    */
+    std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+    searchKnnInternal(const Table &table, const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed, SearchStats *stats) const {
+        if (stats)
+            stats->level_hops.assign(std::max(maxlevel_.load(), 0) + 1, 0);
+
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
-        if (num_deleted_) {
-            top_candidates = searchBaseLayerST<true, true>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
+        // the exact scan costs a filter call per element, a sampled estimate only picks it when
+        // even the upper end of its confidence interval is below the threshold
+        float upper_bound;
+        float selectivity = estimateSelectivity(table, isIdAllowed, upper_bound);
+        if (upper_bound < brute_force_selectivity_) {
+            top_candidates = searchAllowedExact(table, query_data, k, isIdAllowed, stats);
         } else {
-            top_candidates = searchBaseLayerST<false, true>(
-                    currObj, query_data, std::max(ef_, k), isIdAllowed);
+            tableint currObj = searchUpperLayers(table, query_data, stats);
+            if (currObj == (tableint) -1)
+                return top_candidates;
+            bool done = false;
+            if (selectivity < two_hop_selectivity_) {
+                if (num_deleted_) {
+                    top_candidates = searchBaseLayerFiltered<true>(
+                            table, currObj, query_data, std::max(ef_, k), isIdAllowed, stats);
+                } else {
+                    top_candidates = searchBaseLayerFiltered<false>(
+                            table, currObj, query_data, std::max(ef_, k), isIdAllowed, stats);
+                }
+                // the two-hop traversal dies out when no allowed element is near the enter point,
+                // the regular search then walks through the rejected region instead, unless all
+                // the allowed elements have been found already
+                size_t size;
+                done = top_candidates.size() >= k ||
+                       (getFilterSize(isIdAllowed, size) && size <= top_candidates.size());
+            }
+            if (!done && num_deleted_) {
+                top_candidates = searchBaseLayerST<true, true>(
+                        table, currObj, query_data, std::max(ef_, k), isIdAllowed, k, stats);
+            } else if (!done) {
+                top_candidates = searchBaseLayerST<false, true>(
+                        table, currObj, query_data, std::max(ef_, k), isIdAllowed, k, stats);
+            }
         }
 
         while (top_candidates.size() > k) {
             top_candidates.pop();
         }
-        while (top_candidates.size() > 0) {
-            std::pair<dist_t, tableint> rez = top_candidates.top();
-            result.push(std::pair<dist_t, labeltype>(rez.first, getExternalLabel(rez.second)));
+        return top_candidates;
+    }
+
+
+    /*
+    * Returns k of the fetch_k closest elements to the query, picked one at a time by maximal
+    * marginal relevance: the next pick is the candidate with the highest
+    * lambda * sim(query, candidate) - (1 - lambda) * max sim(candidate, picked), with sim = -distance.
+    * lambda = 1 is the plain k-NN order, lower values favor candidates unlike those already picked.
+    * Returns (distance to the query, label) pairs in the order picked. The candidate vectors are
+    * copied out once and each pick only updates the distance to the last picked one, so the
+    * reranking costs k * fetch_k distance computations.
+    */
+    std::vector<std::pair<dist_t, labeltype>>
+    searchKnnDiverse(const void *query_data, size_t k, size_t fetch_k, float lambda,
+                     BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<dist_t, labeltype>> result;
+        if (cur_element_count == 0 || k == 0) return result;
+        ReadGuard read_guard(this);
+        const Table &table = read_guard.table();
+
+        auto top_candidates = searchKnnInternal(table, query_data, std::max(k, fetch_k), isIdAllowed, nullptr);
+        size_t n = top_candidates.size();
+        std::vector<char> vectors(n * data_size_);
+        std::vector<dist_t> relevance(n);
+        std::vector<labeltype> labels(n);
+        for (size_t i = n; i > 0; i--) {
+            tableint id = top_candidates.top().second;
+            readData(table, id, vectors.data() + (i - 1) * data_size_);
+            relevance[i - 1] = top_candidates.top().first;
+            labels[i - 1] = getExternalLabel(table, id);
             top_candidates.pop();
         }
+
+        // distance of each candidate to the closest picked one, the candidates left are [picked, n)
+        std::vector<dist_t> diversity(n, std::numeric_limits<dist_t>::max());
+        std::vector<size_t> order(n);
+        for (size_t i = 0; i < n; i++)
+            order[i] = i;
+        result.reserve(std::min(k, n));
+        for (size_t picked = 0; picked < n && picked < k; picked++) {
+            size_t best = picked;
+            if (picked > 0) {
+                const char *last = vectors.data() + order[picked - 1] * data_size_;
+                dist_t best_score = std::numeric_limits<dist_t>::lowest();
+                for (size_t i = picked; i < n; i++) {
+                    size_t c = order[i];
+                    dist_t dist = fstdistfunc_(last, vectors.data() + c * data_size_, dist_func_param_);
+                    diversity[c] = std::min(diversity[c], dist);
+                    dist_t score = (1 - lambda) * diversity[c] - lambda * relevance[c];
+                    if (score > best_score) {
+                        best_score = score;
+                        best = i;
+                    }
+                }
+            }
+            std::swap(order[picked], order[best]);
+            result.emplace_back(relevance[order[picked]], labels[order[picked]]);
+        }
+        return result;
+    }
+
+
+    /*
+    * Returns the elements within `radius` of the query, closest first, at most `max_results` of them.
+    */
+    std::vector<std::pair<dist_t, labeltype>>
+    searchRange(const void *query_data, dist_t radius, size_t max_results, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<dist_t, labeltype>> result;
+        if (cur_element_count == 0 || max_results == 0) return result;
+        ReadGuard read_guard(this);
+        const Table &table = read_guard.table();
+
+        tableint currObj = searchUpperLayers(table, query_data);
+        if (currObj == (tableint) -1)
+            return result;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> found;
+        if (num_deleted_) {
+            found = searchBaseLayerRange<true>(table, currObj, query_data, radius, max_results, isIdAllowed);
+        } else {
+            found = searchBaseLayerRange<false>(table, currObj, query_data, radius, max_results, isIdAllowed);
+        }
+
+        result.resize(found.size());
+        for (size_t i = found.size(); i > 0; i--) {
+            result[i - 1] = std::pair<dist_t, labeltype>(found.top().first, getExternalLabel(table, found.top().second));
+            found.pop();
+        }
+        return result;
+    }
+
+
+    /*
+    * Searches for the `k_groups` groups closest to the query, `groupOf` giving the group of each label,
+    * a group being as close as its closest element. Unlike searchKnn, the base layer search keeps
+    * expanding while fewer than k_groups groups are found or a candidate is closer than the k-th group,
+    * and at most group_size elements of a group count towards ef, so that a few large groups near the
+    * query do not crowd out the others. Returns the groups found, closest first, each with its up to
+    * `group_size` closest elements found as (distance, label) pairs, closest first. More than k_groups
+    * groups may be returned, the later ones are less reliable.
+    */
+    std::vector<std::pair<labeltype, std::vector<std::pair<dist_t, labeltype>>>>
+    searchKnnGrouped(const void *query_data, size_t k_groups, size_t group_size, BaseGroupFunctor &groupOf,
+                     BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::vector<std::pair<labeltype, std::vector<std::pair<dist_t, labeltype>>>> result;
+        if (cur_element_count == 0 || k_groups == 0 || group_size == 0) return result;
+        ReadGuard read_guard(this);
+        const Table &table = read_guard.table();
+
+        tableint ep_id = searchUpperLayers(table, query_data);
+        if (ep_id == (tableint) -1)
+            return result;
+
+        VisitedList *vl = visited_list_pool_->getFreeVisitedList();
+        vl_type *visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
+
+        // the elements counting towards ef, a set so that members pushed out of their group can leave it
+        std::set<std::pair<dist_t, tableint>> top_candidates;
+        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidate_set;
+        // per group found the distance of its closest element and its closest elements as a max-heap,
+        // and the groups ordered by their closest element
+        std::unordered_map<labeltype, std::pair<dist_t, std::priority_queue<std::pair<dist_t, tableint>>>> groups;
+        std::set<std::pair<dist_t, labeltype>> closest_groups;
+        dist_t kth_group = std::numeric_limits<dist_t>::max();
+        const size_t ef = std::max(ef_, k_groups);
+        std::vector<linklistsizeint> links(element_versions_ ? maxM0_ + 1 : 0);
+        size_t hops = 0;
+        size_t neighbors_scanned = 0;
+
+        // the distance up to which candidates are worth expanding: the farther of the k-th group and
+        // the ef-th element, unbounded while fewer are found
+        auto bound = [&]() {
+            if (top_candidates.size() < ef)
+                return std::numeric_limits<dist_t>::max();
+            return std::max(kth_group, top_candidates.rbegin()->first);
+        };
+
+        auto consider = [&](tableint id, dist_t dist) {
+            if (dist >= bound())
+                return;
+            candidate_set.emplace(-dist, id);
+            if (isMarkedDeleted(table, id))
+                return;
+            labeltype label = getExternalLabel(table, id);
+            if (isIdAllowed && !(*isIdAllowed)(label))
+                return;
+            labeltype group = groupOf(label);
+            auto found = groups.emplace(group, std::make_pair(std::numeric_limits<dist_t>::max(),
+                                                              std::priority_queue<std::pair<dist_t, tableint>>()));
+            dist_t &closest = found.first->second.first;
+            auto &hits = found.first->second.second;
+            if (hits.size() == group_size && dist >= hits.top().first)
+                return;
+            hits.emplace(dist, id);
+            // only the closest elements of each group count towards ef, so one large group cannot fill it
+            top_candidates.emplace(dist, id);
+            if (hits.size() > group_size) {
+                top_candidates.erase(hits.top());
+                hits.pop();
+            }
+            if (top_candidates.size() > ef)
+                top_candidates.erase(std::prev(top_candidates.end()));
+            if (dist < closest) {
+                if (!found.second)
+                    closest_groups.erase(std::make_pair(closest, group));
+                closest = dist;
+                closest_groups.emplace(dist, group);
+                if (closest_groups.size() >= k_groups)
+                    kth_group = std::next(closest_groups.begin(), k_groups - 1)->first;
+            }
+        };
+
+        consider(ep_id, readDistance(table, query_data, ep_id));
+        visited_array[ep_id] = visited_array_tag;
+
+        while (!candidate_set.empty()) {
+            std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+            if (-current_node_pair.first > bound())
+                break;
+            candidate_set.pop();
+
+            int *data = (int *) readLinkList(table, current_node_pair.second, 0, links.data());
+            size_t size = getListCount((linklistsizeint*)data);
+            hops++;
+            neighbors_scanned += size;
+            for (size_t j = 1; j <= size; j++) {
+                tableint candidate_id = *(data + j);
+                if (visited_array[candidate_id] == visited_array_tag)
+                    continue;
+                visited_array[candidate_id] = visited_array_tag;
+                consider(candidate_id, readDistance(table, query_data, candidate_id));
+            }
+        }
+
+        visited_list_pool_->releaseVisitedList(vl);
+        metric_hops += hops;
+        metric_distance_computations += neighbors_scanned;
+
+        result.reserve(closest_groups.size());
+        for (auto &closest : closest_groups) {
+            auto &hits = groups[closest.second].second;
+            std::vector<std::pair<dist_t, labeltype>> members(hits.size());
+            for (size_t i = members.size(); i > 0; i--) {
+                members[i - 1] = std::make_pair(hits.top().first, getExternalLabel(table, hits.top().second));
+                hits.pop();
+            }
+            result.emplace_back(closest.second, std::move(members));
+        }
         return result;
     }
 
 
+    /*
+    * Picks the smallest early termination patience at which the search still returns at least
+    * `target_recall` of the top-k found by the full ef search, using up to `num_samples` stored
+    * elements as queries. A sample always finds itself first, so its own label is left out of
+    * both result sets. The chosen patience is applied and returned; 0 (disabled) is chosen when
+    * no patience below ef reaches the target, and when k >= ef since the search then collects
+    * all ef candidates anyway. Must not run concurrently with searches.
+    */
+    size_t tuneEarlyStopPatience(float target_recall, size_t k, size_t num_samples = 100) {
+        early_stop_patience_ = 0;
+        if (k == 0 || k >= ef_ || num_samples == 0)
+            return 0;
+
+        std::vector<tableint> samples;
+        size_t step = std::max((size_t) 1, (size_t) cur_element_count / num_samples);
+        for (tableint id = 0; id < cur_element_count && samples.size() < num_samples; id += step) {
+            if (!isMarkedDeleted(id))
+                samples.push_back(id);
+        }
+
+        // the k nearest labels to the sample other than its own, searching one more to make up for it
+        auto neighbors = [&](tableint sample) {
+            labeltype self = getExternalLabel(sample);
+            std::vector<labeltype> labels;
+            auto knn = searchKnn(getDataByInternalId(sample), k + 1);
+            for (; !knn.empty(); knn.pop()) {
+                if (knn.top().second != self)
+                    labels.push_back(knn.top().second);
+            }
+            // labels came farthest first, drop the extra farthest one when the sample was not found
+            if (labels.size() > k)
+                labels.erase(labels.begin());
+            std::sort(labels.begin(), labels.end());
+            return labels;
+        };
+
+        std::vector<std::vector<labeltype>> reference(samples.size());
+        for (size_t i = 0; i < samples.size(); i++)
+            reference[i] = neighbors(samples[i]);
+
+        size_t chosen = 0;
+        for (size_t patience = 1; patience < ef_; patience *= 2) {
+            early_stop_patience_ = patience;
+            size_t hits = 0, total = 0;
+            for (size_t i = 0; i < samples.size(); i++) {
+                std::vector<labeltype> found = neighbors(samples[i]);
+                total += reference[i].size();
+                for (labeltype label : found) {
+                    if (std::binary_search(reference[i].begin(), reference[i].end(), label))
+                        hits++;
+                }
+            }
+            if (hits >= target_recall * total) {
+                chosen = patience;
+                break;
+            }
+        }
+        early_stop_patience_ = chosen;
+        return chosen;
+    }
+
+
     void checkIntegrity() {
         int connections_checked = 0;
         std::vector <int > inbound_connections_num(cur_element_count, 0);
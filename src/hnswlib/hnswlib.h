@@ -2,15 +2,38 @@
 #ifndef NO_MANUAL_VECTORIZATION
 #if (defined(__SSE__) || _M_IX86_FP > 0 || defined(_M_AMD64) || defined(_M_X64))
 #define USE_SSE
+#if defined(__GNUC__) && !defined(NO_RUNTIME_DISPATCH)
+// GCC and clang compile each kernel for its own instruction set and the spaces pick
+// the best one the CPU supports when they are constructed, so one portable binary
+// runs the AVX2 and AVX-512 kernels on the hosts that have them
+#define USE_RUNTIME_DISPATCH
+#define USE_AVX
+#define USE_AVX2_FMA
+#define USE_AVX512
+#define USE_AVX512_VNNI
+#else
 #ifdef __AVX__
 #define USE_AVX
+#if defined(__AVX2__) && defined(__FMA__)
+#define USE_AVX2_FMA
+#endif
 #ifdef __AVX512F__
 #define USE_AVX512
+#if defined(__AVX512BW__) && defined(__AVX512VNNI__)
+#define USE_AVX512_VNNI
+#endif
+#endif
 #endif
 #endif
 #endif
 #endif
 
+#if defined(USE_RUNTIME_DISPATCH)
+#define HNSWLIB_TARGET(features) __attribute__((target(features)))
+#else
+#define HNSWLIB_TARGET(features)
+#endif
+
 #if defined(USE_AVX) || defined(USE_SSE)
 #ifdef _MSC_VER
 #include <intrin.h>
@@ -35,7 +58,7 @@ static uint64_t xgetbv(unsigned int index) {
 }
 #endif
 
-#if defined(USE_AVX512)
+#if defined(USE_AVX)
 #include <immintrin.h>
 #endif
 
@@ -105,6 +128,39 @@ static bool AVX512Capable() {
     }
     return HW_AVX512F && avx512Supported;
 }
+
+static bool AVX2FMACapable() {
+    if (!AVXCapable()) return false;
+
+    int cpuInfo[4];
+
+    // CPU support
+    cpuid(cpuInfo, 0, 0);
+    int nIds = cpuInfo[0];
+    if (nIds < 0x00000007)
+        return false;
+
+    cpuid(cpuInfo, 0x00000001, 0);
+    bool HW_FMA = (cpuInfo[2] & ((int)1 << 12)) != 0;
+
+    cpuid(cpuInfo, 0x00000007, 0);
+    bool HW_AVX2 = (cpuInfo[1] & ((int)1 << 5)) != 0;
+
+    // the OS support is the one checked by AVXCapable
+    return HW_FMA && HW_AVX2;
+}
+
+static bool AVX512VNNICapable() {
+    if (!AVX512Capable()) return false;
+
+    int cpuInfo[4];
+
+    // CPU support, the OS support is the one checked by AVX512Capable
+    cpuid(cpuInfo, 0x00000007, 0);
+    bool HW_AVX512BW = (cpuInfo[1] & ((int)1 << 30)) != 0;
+    bool HW_AVX512VNNI = (cpuInfo[2] & ((int)1 << 11)) != 0;
+    return HW_AVX512BW && HW_AVX512VNNI;
+}
 #endif
 
 #include <queue>
@@ -121,6 +177,13 @@ class BaseFilterFunctor {
     virtual bool operator()(hnswlib::labeltype id) { return true; }
 };
 
+// Maps a label to the group it belongs to, e.g. a chunk to its document, for grouped searches
+class BaseGroupFunctor {
+ public:
+    virtual labeltype operator()(hnswlib::labeltype id) = 0;
+    virtual ~BaseGroupFunctor() {}
+};
+
 template <typename T>
 class pairGreater {
  public:
@@ -192,7 +255,14 @@ AlgorithmInterface<dist_t>::searchKnnCloserFirst(const void* query_data, size_t
 }
 }  // namespace hnswlib
 
+#include "label_filter.h"
 #include "space_l2.h"
 #include "space_ip.h"
+#include "space_cosine.h"
+#include "thread_pool.h"
 #include "bruteforce.h"
 #include "hnswalg.h"
+#include "nn_descent.h"
+#include "partitioned_index.h"
+#include "sparse_index.h"
+#include "attribute_store.h"
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "flat_hash_map.h"
+#include <algorithm>
+#include <bitset>
+#include <memory>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* Filter that allows an explicit set of labels. Unlike an opaque functor its cardinality
+* is known, so searches can tell how selective it is and pick a strategy up front.
+*/
+class LabelSetFilter : public BaseFilterFunctor {
+    std::vector<labeltype> labels_;
+    FlatHashSet<labeltype> allowed_;
+
+ public:
+    explicit LabelSetFilter(const std::vector<labeltype> &labels) {
+        for (labeltype label : labels) {
+            if (allowed_.count(label) == 0) {
+                allowed_.insert(label);
+                labels_.push_back(label);
+            }
+        }
+    }
+
+    bool operator()(labeltype id) override {
+        return allowed_.count(id) != 0;
+    }
+
+    size_t size() const {
+        return labels_.size();
+    }
+
+    const std::vector<labeltype> &labels() const {
+        return labels_;
+    }
+};
+
+
+/*
+* Set of small integers as a bitmap, such as generated labels or the rows of an AttributeStore.
+* Integers outside the bitmap are not in the set.
+*/
+class LabelBitmap {
+    std::vector<uint64_t> words_;
+
+ public:
+    bool test(labeltype label) const {
+        size_t word = label >> 6;
+        return word < words_.size() && (words_[word] >> (label & 63)) & 1;
+    }
+
+    void set(labeltype label) {
+        size_t word = label >> 6;
+        if (word >= words_.size())
+            words_.resize(word + 1, 0);
+        words_[word] |= (uint64_t) 1 << (label & 63);
+    }
+
+    void reset(labeltype label) {
+        size_t word = label >> 6;
+        if (word < words_.size())
+            words_[word] &= ~((uint64_t) 1 << (label & 63));
+    }
+
+    void intersectWith(const LabelBitmap &other) {
+        if (words_.size() > other.words_.size())
+            words_.resize(other.words_.size());
+        for (size_t i = 0; i < words_.size(); i++)
+            words_[i] &= other.words_[i];
+    }
+
+    void unionWith(const LabelBitmap &other) {
+        if (words_.size() < other.words_.size())
+            words_.resize(other.words_.size(), 0);
+        for (size_t i = 0; i < other.words_.size(); i++)
+            words_[i] |= other.words_[i];
+    }
+
+    void subtract(const LabelBitmap &other) {
+        size_t size = std::min(words_.size(), other.words_.size());
+        for (size_t i = 0; i < size; i++)
+            words_[i] &= ~other.words_[i];
+    }
+
+    size_t count() const {
+        size_t count = 0;
+        for (uint64_t word : words_)
+            count += std::bitset<64>(word).count();
+        return count;
+    }
+
+    void clear() {
+        words_.clear();
+    }
+};
+
+
+/*
+* Filter that allows the labels of a bitmap, with the cardinality known up front like LabelSetFilter.
+* The bitmap holds the labels themselves, or with a row map the rows the labels are mapped to.
+*/
+class LabelBitmapFilter : public BaseFilterFunctor {
+    std::shared_ptr<const LabelBitmap> bitmap_;
+    std::shared_ptr<const FlatHashMap<labeltype, uint32_t>> rows_;
+    size_t size_;
+
+ public:
+    explicit LabelBitmapFilter(std::shared_ptr<const LabelBitmap> bitmap,
+                               std::shared_ptr<const FlatHashMap<labeltype, uint32_t>> rows = nullptr)
+        : bitmap_(std::move(bitmap)), rows_(std::move(rows)), size_(bitmap_->count()) {}
+
+    bool operator()(labeltype id) override {
+        if (!rows_)
+            return bitmap_->test(id);
+        auto row = rows_->find(id);
+        return row != rows_->end() && bitmap_->test(row->second);
+    }
+
+    size_t size() const {
+        return size_;
+    }
+};
+
+}  // namespace hnswlib
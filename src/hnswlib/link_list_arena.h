@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace hnswlib {
+///////////////////////////////////////////////////////////
+//
+// Slab allocator for the upper-layer link lists. A block for an
+// element on level L takes L * size_links_per_element bytes, carved
+// from large chunks that are only released when the arena is destroyed.
+// Released blocks are kept on a free list per level for reuse.
+//
+/////////////////////////////////////////////////////////
+
+class LinkListArena {
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    size_t size_links_per_element_;
+    size_t chunk_size_;
+    std::vector<char *> chunks_;
+    char *cur_{nullptr};
+    size_t cur_left_{0};
+    size_t bytes_reserved_{0};
+    std::vector<std::vector<char *>> free_lists_;  // free blocks by level
+    std::mutex guard_;
+
+    void addChunk(size_t min_size) {
+        size_t size = std::max(chunk_size_, min_size);
+        char *chunk = (char *) malloc(size);
+        if (chunk == nullptr)
+            throw std::runtime_error("Not enough memory: LinkListArena failed to allocate chunk");
+        chunks_.push_back(chunk);
+        cur_ = chunk;
+        cur_left_ = size;
+        bytes_reserved_ += size;
+    }
+
+ public:
+    LinkListArena(size_t size_links_per_element, size_t chunk_size = DEFAULT_CHUNK_SIZE)
+        : size_links_per_element_(size_links_per_element), chunk_size_(chunk_size) {
+    }
+
+    /*
+    * Makes sure that the next allocations totalling `bytes` are served from a single chunk.
+    */
+    void reserve(size_t bytes) {
+        std::unique_lock <std::mutex> lock(guard_);
+        if (bytes > cur_left_)
+            addChunk(bytes);
+    }
+
+    char *allocate(int level) {
+        size_t size = size_links_per_element_ * level;
+        std::unique_lock <std::mutex> lock(guard_);
+        if ((size_t) level < free_lists_.size() && !free_lists_[level].empty()) {
+            char *block = free_lists_[level].back();
+            free_lists_[level].pop_back();
+            return block;
+        }
+        if (size > cur_left_)
+            addChunk(size);
+        char *block = cur_;
+        cur_ += size;
+        cur_left_ -= size;
+        return block;
+    }
+
+    /*
+    * Allocates `bytes` contiguous bytes for blocks the caller places back to back, e.g. all the
+    * link lists of a loaded index. The blocks can be deallocated one by one later.
+    */
+    char *allocateRegion(size_t bytes) {
+        std::unique_lock <std::mutex> lock(guard_);
+        if (bytes > cur_left_)
+            addChunk(bytes);
+        char *region = cur_;
+        cur_ += bytes;
+        cur_left_ -= bytes;
+        return region;
+    }
+
+    void deallocate(char *block, int level) {
+        std::unique_lock <std::mutex> lock(guard_);
+        if ((size_t) level >= free_lists_.size())
+            free_lists_.resize(level + 1);
+        free_lists_[level].push_back(block);
+    }
+
+    size_t getSizeLinksPerElement() const {
+        return size_links_per_element_;
+    }
+
+    size_t getBytesReserved() const {
+        return bytes_reserved_;
+    }
+
+    ~LinkListArena() {
+        for (char *chunk : chunks_)
+            free(chunk);
+    }
+};
+}  // namespace hnswlib
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace hnswlib {
+///////////////////////////////////////////////////////////
+//
+// Offline construction of a HierarchicalNSW index. Each layer is
+// built from an approximate kNN graph of its elements computed with
+// NN-Descent (Dong et al., 2011), then pruned with the same heuristic
+// incremental insertion uses and completed with reverse links. The
+// result is a regular index: it can be searched, extended with
+// addPoint and saved like one built by insertion.
+//
+/////////////////////////////////////////////////////////
+
+template<typename dist_t>
+class NNDescentBuilder {
+    typedef std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>,
+        typename HierarchicalNSW<dist_t>::CompareByFirst> CandidateQueue;
+
+    // layers with at most this many elements are linked by brute force
+    static const size_t BRUTE_FORCE_THRESHOLD = 1024;
+
+    struct Neighbor {
+        dist_t dist;
+        tableint id;  // position within the layer
+        bool is_new;
+
+        bool operator<(const Neighbor &other) const {
+            return dist < other.dist;
+        }
+    };
+
+    struct NeighborList {
+        std::vector<Neighbor> items;  // ascending by distance, at most k
+        std::mutex lock;
+    };
+
+    size_t k_;
+    size_t max_iterations_;
+    float sample_rate_;
+    float min_update_rate_;
+    size_t random_seed_;
+
+    /*
+    * Tries to add `id` at `dist` to the list, returns 1 if the list changed.
+    */
+    static size_t insertNeighbor(NeighborList &list, size_t k, tableint id, dist_t dist) {
+        std::unique_lock <std::mutex> lock(list.lock);
+        std::vector<Neighbor> &items = list.items;
+        if (items.size() == k && dist >= items.back().dist)
+            return 0;
+        for (const Neighbor &item : items) {
+            if (item.id == id)
+                return 0;
+        }
+        Neighbor neighbor{dist, id, true};
+        items.insert(std::upper_bound(items.begin(), items.end(), neighbor), neighbor);
+        if (items.size() > k)
+            items.pop_back();
+        return 1;
+    }
+
+    /*
+    * Approximate k nearest neighbors of every element of `ids`, as positions within `ids`,
+    * closest first. Small layers are computed exactly.
+    */
+    std::vector<std::vector<Neighbor>> computeKnnGraph(
+        HierarchicalNSW<dist_t> &index, const std::vector<tableint> &ids, size_t max_k, size_t num_threads) const {
+        const size_t n = ids.size();
+        const size_t k = std::min(max_k, n - 1);
+        std::vector<NeighborList> graph(n);
+        auto dist = [&](size_t a, size_t b) {
+            return index.fstdistfunc_(index.getDataByInternalId(ids[a]), index.getDataByInternalId(ids[b]), index.dist_func_param_);
+        };
+
+        if (n <= BRUTE_FORCE_THRESHOLD) {
+            HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+                for (size_t b = 0; b < n; b++) {
+                    if (a != b)
+                        insertNeighbor(graph[a], k, (tableint) b, dist(a, b));
+                }
+            });
+        } else {
+            HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+                std::mt19937 generator(random_seed_ + a);
+                std::uniform_int_distribution<size_t> random_position(0, n - 1);
+                while (graph[a].items.size() < k) {
+                    size_t b = random_position(generator);
+                    if (b != a)
+                        insertNeighbor(graph[a], k, (tableint) b, dist(a, b));
+                }
+            });
+
+            const size_t sample_size = std::max((size_t) 1, (size_t) (sample_rate_ * k));
+            std::vector<std::vector<tableint>> new_candidates(n), old_candidates(n);
+            std::vector<std::mutex> candidate_locks(n);
+            for (size_t iteration = 0; iteration < max_iterations_; iteration++) {
+                // sample the new neighbors to join, marking them as old, and add the reverse edges
+                HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+                    std::vector<tableint> sampled_new, sampled_old;
+                    {
+                        std::unique_lock <std::mutex> lock(graph[a].lock);
+                        for (Neighbor &neighbor : graph[a].items) {
+                            if (!neighbor.is_new) {
+                                sampled_old.push_back(neighbor.id);
+                            } else if (sampled_new.size() < sample_size) {
+                                sampled_new.push_back(neighbor.id);
+                                neighbor.is_new = false;
+                            }
+                        }
+                    }
+                    {
+                        std::unique_lock <std::mutex> lock(candidate_locks[a]);
+                        new_candidates[a].insert(new_candidates[a].end(), sampled_new.begin(), sampled_new.end());
+                        old_candidates[a].insert(old_candidates[a].end(), sampled_old.begin(), sampled_old.end());
+                    }
+                    for (tableint b : sampled_new) {
+                        std::unique_lock <std::mutex> lock(candidate_locks[b]);
+                        new_candidates[b].push_back((tableint) a);
+                    }
+                    for (tableint b : sampled_old) {
+                        std::unique_lock <std::mutex> lock(candidate_locks[b]);
+                        old_candidates[b].push_back((tableint) a);
+                    }
+                });
+
+                // local join: the candidates of an element are likely neighbors of each other
+                std::vector<size_t> updates(n, 0);
+                HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+                    std::vector<tableint> &fresh = new_candidates[a];
+                    std::vector<tableint> &old = old_candidates[a];
+                    std::mt19937 generator(random_seed_ + iteration * n + a);
+                    // the reverse edges can make the lists long, they are cut to twice the sample
+                    for (std::vector<tableint> *candidates : {&fresh, &old}) {
+                        std::sort(candidates->begin(), candidates->end());
+                        candidates->erase(std::unique(candidates->begin(), candidates->end()), candidates->end());
+                        if (candidates->size() > 2 * sample_size) {
+                            std::shuffle(candidates->begin(), candidates->end(), generator);
+                            candidates->resize(2 * sample_size);
+                        }
+                    }
+
+                    size_t count = 0;
+                    for (size_t i = 0; i < fresh.size(); i++) {
+                        for (size_t j = i + 1; j < fresh.size(); j++) {
+                            dist_t d = dist(fresh[i], fresh[j]);
+                            count += insertNeighbor(graph[fresh[i]], k, fresh[j], d);
+                            count += insertNeighbor(graph[fresh[j]], k, fresh[i], d);
+                        }
+                        for (tableint other : old) {
+                            if (other == fresh[i])
+                                continue;
+                            dist_t d = dist(fresh[i], other);
+                            count += insertNeighbor(graph[fresh[i]], k, other, d);
+                            count += insertNeighbor(graph[other], k, fresh[i], d);
+                        }
+                    }
+                    updates[a] = count;
+                    std::vector<tableint>().swap(fresh);
+                    std::vector<tableint>().swap(old);
+                });
+
+                size_t total_updates = 0;
+                for (size_t count : updates)
+                    total_updates += count;
+                if (total_updates <= min_update_rate_ * n * k)
+                    break;
+            }
+        }
+
+        std::vector<std::vector<Neighbor>> result(n);
+        for (size_t a = 0; a < n; a++)
+            result[a].swap(graph[a].items);
+        return result;
+    }
+
+
+    /*
+    * Links the elements of one layer: every element keeps the neighbors chosen by the heuristic
+    * among its kNN and reverse kNN, then asks each of them for a link back.
+    */
+    void linkLayer(HierarchicalNSW<dist_t> &index, const std::vector<tableint> &ids, int level, size_t k, size_t num_threads) const {
+        const size_t n = ids.size();
+        if (n < 2)
+            return;
+        const size_t max_links = level ? index.maxM_ : index.maxM0_;
+        std::vector<std::vector<Neighbor>> knn = computeKnnGraph(index, ids, k, num_threads);
+
+        std::vector<std::vector<Neighbor>> reverse(n);
+        for (size_t a = 0; a < n; a++) {
+            for (const Neighbor &neighbor : knn[a])
+                reverse[neighbor.id].push_back(Neighbor{neighbor.dist, (tableint) a, false});
+        }
+
+        HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+            CandidateQueue candidates;
+            for (const Neighbor &neighbor : knn[a])
+                candidates.emplace(neighbor.dist, ids[neighbor.id]);
+            for (const Neighbor &neighbor : reverse[a]) {
+                bool is_known = std::any_of(knn[a].begin(), knn[a].end(),
+                                            [&](const Neighbor &other) { return other.id == neighbor.id; });
+                if (!is_known)
+                    candidates.emplace(neighbor.dist, ids[neighbor.id]);
+            }
+            index.getNeighborsByHeuristic2(candidates, index.M_);
+
+            linklistsizeint *ll = index.get_linklist_at_level(ids[a], level);
+            tableint *data = (tableint *) (ll + 1);
+            size_t size = 0;
+            while (candidates.size() > 0) {
+                data[size++] = candidates.top().second;
+                candidates.pop();
+            }
+            index.setListCount(ll, size);
+        });
+
+        std::vector<std::vector<tableint>> selected(n);
+        for (size_t a = 0; a < n; a++) {
+            linklistsizeint *ll = index.get_linklist_at_level(ids[a], level);
+            tableint *data = (tableint *) (ll + 1);
+            selected[a].assign(data, data + index.getListCount(ll));
+        }
+
+        HierarchicalNSW<dist_t>::parallelFor(0, n, num_threads, [&](size_t a) {
+            const tableint cur_c = ids[a];
+            for (tableint other : selected[a]) {
+                std::unique_lock <std::mutex> lock(index.link_list_locks_[other]);
+                linklistsizeint *ll = index.get_linklist_at_level(other, level);
+                size_t size = index.getListCount(ll);
+                tableint *data = (tableint *) (ll + 1);
+                if (std::find(data, data + size, cur_c) != data + size)
+                    continue;
+                if (size < max_links) {
+                    data[size] = cur_c;
+                    index.setListCount(ll, size + 1);
+                    continue;
+                }
+
+                const char *point = index.getDataByInternalId(other);
+                CandidateQueue candidates;
+                candidates.emplace(index.fstdistfunc_(point, index.getDataByInternalId(cur_c), index.dist_func_param_), cur_c);
+                for (size_t j = 0; j < size; j++)
+                    candidates.emplace(index.fstdistfunc_(point, index.getDataByInternalId(data[j]), index.dist_func_param_), data[j]);
+                index.getNeighborsByHeuristic2(candidates, max_links);
+                size_t indx = 0;
+                while (candidates.size() > 0) {
+                    data[indx++] = candidates.top().second;
+                    candidates.pop();
+                }
+                index.setListCount(ll, indx);
+            }
+        });
+    }
+
+ public:
+    /*
+    * k: the number of neighbors NN-Descent keeps per element, 0 for the base layer capacity (2 * M).
+    * The iterations stop after max_iterations or once fewer than min_update_rate * n * k
+    * neighbors changed. sample_rate is the share of the new neighbors joined per iteration.
+    */
+    NNDescentBuilder(
+        size_t k = 0,
+        size_t max_iterations = 10,
+        float sample_rate = 0.5f,
+        float min_update_rate = 0.001f,
+        size_t random_seed = 100)
+        : k_(k),
+            max_iterations_(max_iterations),
+            sample_rate_(sample_rate),
+            min_update_rate_(min_update_rate),
+            random_seed_(random_seed) {
+    }
+
+
+    /*
+    * Builds an empty index from `count` points stored back to back, `labels[i]` being the label of
+    * the i-th point. The levels are drawn as incremental insertion would draw them. The index must
+    * not be used until the call returns.
+    */
+    void build(HierarchicalNSW<dist_t> &index, const void *data, const labeltype *labels, size_t count, size_t num_threads = 1) {
+        if (index.cur_element_count != 0)
+            throw std::runtime_error("The offline builder can only be used on an empty index");
+        if (count == 0)
+            return;
+        if (!index.reserveForInsert(count))
+            throw std::runtime_error("The number of elements exceeds the specified limit");
+
+        std::vector<labeltype> sorted_labels(labels, labels + count);
+        std::sort(sorted_labels.begin(), sorted_labels.end());
+        if (std::adjacent_find(sorted_labels.begin(), sorted_labels.end()) != sorted_labels.end())
+            throw std::runtime_error("The labels given to the offline builder must be unique");
+
+        const size_t k = k_ ? k_ : index.maxM0_;
+        const char *points = (const char *) data;
+        int maxlevel = 0;
+        tableint enterpoint = 0;
+        for (size_t i = 0; i < count; i++) {
+            tableint cur_c = (tableint) i;
+            index.label_lookup_[labels[i]] = cur_c;
+
+            memset(index.getElementPtr(cur_c) + index.offsetLevel0_, 0, index.size_data_per_element_);
+            memcpy(index.getExternalLabeLp(cur_c), &labels[i], sizeof(labeltype));
+            memcpy(index.getDataByInternalId(cur_c), points + i * index.data_size_, index.data_size_);
+
+            int level = index.getRandomLevel(index.mult_);
+            index.element_levels_[cur_c] = level;
+            if (level) {
+                index.linkLists_[cur_c] = index.link_list_arena_->allocate(level);
+                memset(index.linkLists_[cur_c], 0, index.size_links_per_element_ * level);
+            }
+            if (level > maxlevel || i == 0) {
+                maxlevel = level;
+                enterpoint = cur_c;
+            }
+            index.cur_element_count++;
+        }
+
+        for (int level = 0; level <= maxlevel; level++) {
+            std::vector<tableint> ids;
+            for (size_t i = 0; i < count; i++) {
+                if (index.element_levels_[i] >= level)
+                    ids.push_back((tableint) i);
+            }
+            linkLayer(index, ids, level, k, num_threads);
+        }
+
+        index.enterpoint_node_ = enterpoint;
+        index.maxlevel_ = maxlevel;
+    }
+};
+
+}  // namespace hnswlib
@@ -0,0 +1,227 @@
+#pragma once
+
+#include "flat_hash_map.h"
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace hnswlib {
+typedef size_t partitionkey;
+
+/*
+* Container for many small logical indexes, e.g. one per tenant, addressed by a partition key.
+* A partition starts as a brute-force index and is rebuilt as an HNSW graph once it holds
+* `promote_threshold` elements. All graphs allocate their upper layers from one link-list arena,
+* share one visited-list pool and one set of label locks, so an idle partition costs little
+* more than its vectors.
+*
+* Every operation takes the container lock, so calls are serialized across partitions.
+*/
+template<typename dist_t>
+class PartitionedIndex {
+    static const size_t MIN_FLAT_CAPACITY = 16;
+    static constexpr float GRAPH_GROWTH_FACTOR = 2.0f;
+
+    struct Partition {
+        BruteforceSearch<dist_t> *flat{nullptr};
+        HierarchicalNSW<dist_t> *graph{nullptr};
+    };
+
+    SpaceInterface<dist_t> *space_;
+    size_t M_;
+    size_t ef_construction_;
+    size_t random_seed_;
+    size_t promote_threshold_;
+    size_t ef_{10};
+
+    FlatHashMap<partitionkey, Partition> partitions_;
+
+    VisitedListPool *visited_list_pool_{nullptr};  // grows with the largest graph
+    LinkListArena *link_list_arena_{nullptr};
+    std::vector<std::mutex> label_op_locks_;
+
+    mutable std::mutex partitions_lock_;
+
+    HierarchicalNSW<dist_t> *createGraph(size_t max_elements) {
+        HierarchicalNSW<dist_t> *graph = new HierarchicalNSW<dist_t>(
+            space_, max_elements, M_, ef_construction_, random_seed_, true);
+        graph->useSharedStorage(link_list_arena_, &label_op_locks_);
+        visited_list_pool_->reserve(max_elements);
+        graph->useSharedVisitedListPool(visited_list_pool_);
+        graph->setGrowthFactor(GRAPH_GROWTH_FACTOR);
+        graph->setEf(ef_);
+        return graph;
+    }
+
+    void promote(Partition &partition) {
+        BruteforceSearch<dist_t> *flat = partition.flat;
+        HierarchicalNSW<dist_t> *graph = createGraph(2 * flat->cur_element_count);
+        for (size_t i = 0; i < flat->cur_element_count; i++) {
+            const char *element = flat->data_ + flat->size_per_element_ * i;
+            graph->addPoint(element, *((labeltype *) (element + flat->data_size_)));
+        }
+        partition.graph = graph;
+        partition.flat = nullptr;
+        delete flat;
+    }
+
+    static void destroy(Partition &partition) {
+        delete partition.flat;
+        delete partition.graph;
+        partition.flat = nullptr;
+        partition.graph = nullptr;
+    }
+
+ public:
+    PartitionedIndex(
+        SpaceInterface<dist_t> *s,
+        size_t promote_threshold = 1000,
+        size_t M = 16,
+        size_t ef_construction = 200,
+        size_t random_seed = 100)
+        : space_(s),
+            M_(M),
+            ef_construction_(ef_construction),
+            random_seed_(random_seed),
+            promote_threshold_(std::max(promote_threshold, (size_t) 1)),
+            label_op_locks_(HierarchicalNSW<dist_t>::MAX_LABEL_OPERATION_LOCKS) {
+        link_list_arena_ = new LinkListArena(M_ * sizeof(tableint) + sizeof(linklistsizeint));
+        visited_list_pool_ = new VisitedListPool(1, 0);
+    }
+
+
+    ~PartitionedIndex() {
+        // the graphs hand their blocks back to the arena, so they go first
+        for (auto it = partitions_.begin(); it != partitions_.end(); ++it) {
+            Partition partition = it->second;
+            destroy(partition);
+        }
+        delete visited_list_pool_;
+        delete link_list_arena_;
+    }
+
+
+    /*
+    * Adds the point to the partition, creating the partition if needed. Updates the point if the
+    * label is already in that partition. Labels only have to be unique within a partition.
+    */
+    void addPoint(partitionkey key, const void *data_point, labeltype label) {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        Partition &partition = partitions_[key];
+
+        if (partition.graph) {
+            partition.graph->addPoint(data_point, label, true);
+            return;
+        }
+
+        if (!partition.flat)
+            partition.flat = new BruteforceSearch<dist_t>(space_, std::min((size_t) MIN_FLAT_CAPACITY, promote_threshold_));
+        BruteforceSearch<dist_t> *flat = partition.flat;
+        if (flat->cur_element_count == flat->maxelements_ && flat->dict_external_to_internal.count(label) == 0)
+            flat->resizeIndex(std::min(2 * flat->maxelements_, promote_threshold_));
+        flat->addPoint(data_point, label);
+        if (flat->cur_element_count >= promote_threshold_)
+            promote(partition);
+    }
+
+
+    /*
+    * Removes the point from the partition. Flat partitions drop it right away, graphs mark it
+    * deleted and reuse its place for the next insertion.
+    */
+    void removePoint(partitionkey key, labeltype label) {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        if (partitions_.count(key) == 0)
+            throw std::runtime_error("Partition not found");
+        Partition &partition = partitions_[key];
+        if (partition.graph) {
+            partition.graph->markDelete(label);
+            return;
+        }
+        if (partition.flat->dict_external_to_internal.count(label) == 0)
+            throw std::runtime_error("Label not found");
+        partition.flat->removePoint(label);
+    }
+
+
+    std::priority_queue<std::pair<dist_t, labeltype>>
+    searchKnn(partitionkey key, const void *query_data, size_t k, BaseFilterFunctor* isIdAllowed = nullptr) const {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        auto search = partitions_.find(key);
+        if (search == partitions_.end())
+            return std::priority_queue<std::pair<dist_t, labeltype>>();
+        const Partition &partition = search->second;
+        if (partition.graph)
+            return partition.graph->searchKnn(query_data, k, isIdAllowed);
+        return partition.flat->searchKnn(query_data, k, isIdAllowed);
+    }
+
+
+    void dropPartition(partitionkey key) {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        if (partitions_.count(key) == 0)
+            return;
+        destroy(partitions_[key]);
+        partitions_.erase(key);
+    }
+
+
+    void setEf(size_t ef) {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        ef_ = ef;
+        for (auto it = partitions_.begin(); it != partitions_.end(); ++it) {
+            if (it->second.graph)
+                it->second.graph->setEf(ef);
+        }
+    }
+
+
+    size_t getEf() const {
+        return ef_;
+    }
+
+
+    size_t getPromoteThreshold() const {
+        return promote_threshold_;
+    }
+
+
+    size_t getNumPartitions() const {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        return partitions_.size();
+    }
+
+
+    std::vector<partitionkey> getPartitionKeys() const {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        std::vector<partitionkey> keys;
+        keys.reserve(partitions_.size());
+        for (auto it = partitions_.begin(); it != partitions_.end(); ++it)
+            keys.push_back(it->first);
+        return keys;
+    }
+
+
+    /*
+    * Returns the number of live elements in the partition, 0 if it does not exist.
+    */
+    size_t getPartitionSize(partitionkey key) const {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        auto search = partitions_.find(key);
+        if (search == partitions_.end())
+            return 0;
+        const Partition &partition = search->second;
+        if (partition.graph)
+            return partition.graph->cur_element_count - partition.graph->num_deleted_;
+        return partition.flat->cur_element_count;
+    }
+
+
+    bool isPromoted(partitionkey key) const {
+        std::unique_lock <std::mutex> lock(partitions_lock_);
+        auto search = partitions_.find(key);
+        return search != partitions_.end() && search->second.graph != nullptr;
+    }
+};
+
+}  // namespace hnswlib
@@ -0,0 +1,75 @@
+#pragma once
+#include "hnswlib.h"
+#include <cmath>
+
+namespace hnswlib {
+
+/*
+* Cosine distance that keeps the original vectors. Every point is stored as its dim values
+* followed by its inverse norm, so the distance is one dot product scaled by two precomputed
+* factors, and getDataByLabel still returns the vector as it was given.
+* Points and queries are passed to the index in that layout, see preparePoint.
+*/
+class CosineSpace : public SpaceInterface<float> {
+    struct DistParam {
+        size_t dim;  // first, the index reads the dimension from the parameter
+        DISTFUNC<float> inner_product;
+    };
+
+    DistParam param_;
+    size_t data_size_;
+
+    static float
+    CosineDistance(const void *pVect1v, const void *pVect2v, const void *param_ptr) {
+        const DistParam *param = (const DistParam *) param_ptr;
+        const float *pVect1 = (const float *) pVect1v;
+        const float *pVect2 = (const float *) pVect2v;
+        float res = param->inner_product(pVect1, pVect2, &param->dim);
+        return 1.0f - res * pVect1[param->dim] * pVect2[param->dim];
+    }
+
+ public:
+    CosineSpace(size_t dim) {
+        param_.dim = dim;
+        param_.inner_product = selectInnerProductFunc(dim);
+        data_size_ = (dim + 1) * sizeof(float);
+    }
+
+    size_t get_data_size() {
+        return data_size_;
+    }
+
+    DISTFUNC<float> get_dist_func() {
+        return CosineDistance;
+    }
+
+    void *get_dist_func_param() {
+        return &param_;
+    }
+
+    size_t get_dim() const {
+        return param_.dim;
+    }
+
+    /*
+    * Returns 1 / |vector|, or 0 for the zero vector so that its distance to everything is 1.
+    */
+    float inverseNorm(const float *vector) const {
+        float norm = std::sqrt(param_.inner_product(vector, vector, &param_.dim));
+        return norm > 0.0f ? 1.0f / norm : 0.0f;
+    }
+
+    /*
+    * Writes the vector in the stored layout to point, which holds get_data_size() bytes.
+    * vector and point may be the same buffer.
+    */
+    void preparePoint(const float *vector, float *point) const {
+        if (point != vector)
+            memcpy(point, vector, param_.dim * sizeof(float));
+        point[param_.dim] = inverseNorm(point);
+    }
+
+    ~CosineSpace() {}
+};
+
+}  // namespace hnswlib
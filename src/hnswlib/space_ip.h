@@ -21,6 +21,7 @@ InnerProductDistance(const void *pVect1, const void *pVect2, const void *qty_ptr
 #if defined(USE_AVX)
 
 // Favor using AVX if available.
+HNSWLIB_TARGET("avx")
 static float
 InnerProductSIMD4ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float PORTABLE_ALIGN32 TmpRes[8];
@@ -143,9 +144,9 @@ InnerProductDistanceSIMD4ExtSSE(const void *pVect1v, const void *pVect2v, const
 
 #if defined(USE_AVX512)
 
+HNSWLIB_TARGET("avx512f")
 static float
 InnerProductSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
-    float PORTABLE_ALIGN64 TmpRes[16];
     float *pVect1 = (float *) pVect1v;
     float *pVect2 = (float *) pVect2v;
     size_t qty = *((size_t *) qty_ptr);
@@ -164,13 +165,17 @@ InnerProductSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void
         pVect1 += 16;
         __m512 v2 = _mm512_loadu_ps(pVect2);
         pVect2 += 16;
-        sum512 = _mm512_add_ps(sum512, _mm512_mul_ps(v1, v2));
+        sum512 = _mm512_fmadd_ps(v1, v2, sum512);
     }
 
-    _mm512_store_ps(TmpRes, sum512);
-    float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7] + TmpRes[8] + TmpRes[9] + TmpRes[10] + TmpRes[11] + TmpRes[12] + TmpRes[13] + TmpRes[14] + TmpRes[15];
-
-    return sum;
+    // the halves are added through memory, the 512-bit extract intrinsics warn on GCC 12
+    alignas(64) float partial[16];
+    _mm512_store_ps(partial, sum512);
+    __m256 sum256 = _mm256_add_ps(_mm256_load_ps(partial), _mm256_load_ps(partial + 8));
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
 }
 
 static float
@@ -180,8 +185,47 @@ InnerProductDistanceSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, co
 
 #endif
 
+#if defined(USE_AVX2_FMA)
+
+// Two accumulators hide the latency of the fused multiply-add.
+HNSWLIB_TARGET("avx2,fma")
+static float
+InnerProductSIMD16ExtAVX2FMA(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    float *pVect1 = (float *) pVect1v;
+    float *pVect2 = (float *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+
+    size_t qty16 = qty / 16;
+
+    const float *pEnd1 = pVect1 + 16 * qty16;
+
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    while (pVect1 < pEnd1) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1), _mm256_loadu_ps(pVect2), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(pVect1 + 8), _mm256_loadu_ps(pVect2 + 8), sum1);
+        pVect1 += 16;
+        pVect2 += 16;
+    }
+
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
+}
+
+static float
+InnerProductDistanceSIMD16ExtAVX2FMA(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    return 1.0f - InnerProductSIMD16ExtAVX2FMA(pVect1v, pVect2v, qty_ptr);
+}
+
+#endif
+
 #if defined(USE_AVX)
 
+HNSWLIB_TARGET("avx")
 static float
 InnerProductSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float PORTABLE_ALIGN32 TmpRes[8];
@@ -285,8 +329,36 @@ static DISTFUNC<float> InnerProductSIMD4Ext = InnerProductSIMD4ExtSSE;
 static DISTFUNC<float> InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtSSE;
 static DISTFUNC<float> InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtSSE;
 
+// picks the widest kernels the CPU supports
+static void selectInnerProductSIMDExt() {
+    InnerProductSIMD16Ext = InnerProductSIMD16ExtSSE;
+    InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtSSE;
+    InnerProductSIMD4Ext = InnerProductSIMD4ExtSSE;
+    InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtSSE;
+#if defined(USE_AVX)
+    if (AVXCapable()) {
+        InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
+        InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
+        InnerProductSIMD4Ext = InnerProductSIMD4ExtAVX;
+        InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtAVX;
+    }
+#endif
+#if defined(USE_AVX2_FMA)
+    if (AVX2FMACapable()) {
+        InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX2FMA;
+        InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX2FMA;
+    }
+#endif
+#if defined(USE_AVX512)
+    if (AVX512Capable()) {
+        InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX512;
+        InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX512;
+    }
+#endif
+}
+
 static float
-InnerProductDistanceSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+InnerProductSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
     size_t qty16 = qty >> 4 << 4;
     float res = InnerProductSIMD16Ext(pVect1v, pVect2v, &qty16);
@@ -295,11 +367,16 @@ InnerProductDistanceSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v,
 
     size_t qty_left = qty - qty16;
     float res_tail = InnerProduct(pVect1, pVect2, &qty_left);
-    return 1.0f - (res + res_tail);
+    return res + res_tail;
 }
 
 static float
-InnerProductDistanceSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+InnerProductDistanceSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    return 1.0f - InnerProductSIMD16ExtResiduals(pVect1v, pVect2v, qty_ptr);
+}
+
+static float
+InnerProductSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
     size_t qty4 = qty >> 2 << 2;
 
@@ -310,9 +387,98 @@ InnerProductDistanceSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v,
     float *pVect2 = (float *) pVect2v + qty4;
     float res_tail = InnerProduct(pVect1, pVect2, &qty_left);
 
-    return 1.0f - (res + res_tail);
+    return res + res_tail;
+}
+
+static float
+InnerProductDistanceSIMD4ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    return 1.0f - InnerProductSIMD4ExtResiduals(pVect1v, pVect2v, qty_ptr);
+}
+#endif
+
+// picks the fastest kernel for the plain inner product of two vectors of the given dimension
+static DISTFUNC<float> selectInnerProductFunc(size_t dim) {
+#if defined(USE_AVX) || defined(USE_SSE) || defined(USE_AVX512)
+    selectInnerProductSIMDExt();
+
+    if (dim % 16 == 0)
+        return InnerProductSIMD16Ext;
+    else if (dim % 4 == 0)
+        return InnerProductSIMD4Ext;
+    else if (dim > 16)
+        return InnerProductSIMD16ExtResiduals;
+    else if (dim > 4)
+        return InnerProductSIMD4ExtResiduals;
+#endif
+    return InnerProduct;
+}
+
+// Dot products of four vectors with one vector of qty values, the blocked kernel of the exact
+// search: each value of pVect is loaded once for the four products.
+typedef void (*INNERPRODUCTBATCHFUNC)(const float *const *pVects, const float *pVect, size_t qty, float *out);
+
+static void
+InnerProductBatch4(const float *const *pVects, const float *pVect, size_t qty, float *out) {
+    const float *p0 = pVects[0], *p1 = pVects[1], *p2 = pVects[2], *p3 = pVects[3];
+    float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    for (size_t i = 0; i < qty; i++) {
+        float value = pVect[i];
+        sum0 += p0[i] * value;
+        sum1 += p1[i] * value;
+        sum2 += p2[i] * value;
+        sum3 += p3[i] * value;
+    }
+    out[0] = sum0;
+    out[1] = sum1;
+    out[2] = sum2;
+    out[3] = sum3;
+}
+
+#if defined(USE_AVX2_FMA)
+
+HNSWLIB_TARGET("avx2,fma")
+static float
+HorizontalSumAVX(__m256 sum) {
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
+}
+
+HNSWLIB_TARGET("avx2,fma")
+static void
+InnerProductBatch4AVX2FMA(const float *const *pVects, const float *pVect, size_t qty, float *out) {
+    const float *p0 = pVects[0], *p1 = pVects[1], *p2 = pVects[2], *p3 = pVects[3];
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps();
+    __m256 sum3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= qty; i += 8) {
+        __m256 value = _mm256_loadu_ps(pVect + i);
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(p0 + i), value, sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(p1 + i), value, sum1);
+        sum2 = _mm256_fmadd_ps(_mm256_loadu_ps(p2 + i), value, sum2);
+        sum3 = _mm256_fmadd_ps(_mm256_loadu_ps(p3 + i), value, sum3);
+    }
+    const float *tails[4] = {p0 + i, p1 + i, p2 + i, p3 + i};
+    InnerProductBatch4(tails, pVect + i, qty - i, out);
+    out[0] += HorizontalSumAVX(sum0);
+    out[1] += HorizontalSumAVX(sum1);
+    out[2] += HorizontalSumAVX(sum2);
+    out[3] += HorizontalSumAVX(sum3);
 }
+
+#endif
+
+// picks the fastest blocked kernel the CPU supports
+static INNERPRODUCTBATCHFUNC selectInnerProductBatch4Func() {
+#if defined(USE_AVX2_FMA)
+    if (AVX2FMACapable())
+        return InnerProductBatch4AVX2FMA;
 #endif
+    return InnerProductBatch4;
+}
 
 class InnerProductSpace : public SpaceInterface<float> {
     DISTFUNC<float> fstdistfunc_;
@@ -323,26 +489,7 @@ class InnerProductSpace : public SpaceInterface<float> {
     InnerProductSpace(size_t dim) {
         fstdistfunc_ = InnerProductDistance;
 #if defined(USE_AVX) || defined(USE_SSE) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX512;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX512;
-        } else if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #elif defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD16Ext = InnerProductSIMD16ExtAVX;
-            InnerProductDistanceSIMD16Ext = InnerProductDistanceSIMD16ExtAVX;
-        }
-    #endif
-    #if defined(USE_AVX)
-        if (AVXCapable()) {
-            InnerProductSIMD4Ext = InnerProductSIMD4ExtAVX;
-            InnerProductDistanceSIMD4Ext = InnerProductDistanceSIMD4ExtAVX;
-        }
-    #endif
+        selectInnerProductSIMDExt();
 
         if (dim % 16 == 0)
             fstdistfunc_ = InnerProductDistanceSIMD16Ext;
@@ -22,12 +22,12 @@ L2Sqr(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
 #if defined(USE_AVX512)
 
 // Favor using AVX512 if available.
+HNSWLIB_TARGET("avx512f")
 static float
 L2SqrSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float *pVect1 = (float *) pVect1v;
     float *pVect2 = (float *) pVect2v;
     size_t qty = *((size_t *) qty_ptr);
-    float PORTABLE_ALIGN64 TmpRes[16];
     size_t qty16 = qty >> 4;
 
     const float *pEnd1 = pVect1 + (qty16 << 4);
@@ -41,22 +41,59 @@ L2SqrSIMD16ExtAVX512(const void *pVect1v, const void *pVect2v, const void *qty_p
         v2 = _mm512_loadu_ps(pVect2);
         pVect2 += 16;
         diff = _mm512_sub_ps(v1, v2);
-        // sum = _mm512_fmadd_ps(diff, diff, sum);
-        sum = _mm512_add_ps(sum, _mm512_mul_ps(diff, diff));
+        sum = _mm512_fmadd_ps(diff, diff, sum);
     }
 
-    _mm512_store_ps(TmpRes, sum);
-    float res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] +
-            TmpRes[7] + TmpRes[8] + TmpRes[9] + TmpRes[10] + TmpRes[11] + TmpRes[12] +
-            TmpRes[13] + TmpRes[14] + TmpRes[15];
+    // the halves are added through memory, the 512-bit extract intrinsics warn on GCC 12
+    alignas(64) float partial[16];
+    _mm512_store_ps(partial, sum);
+    __m256 sum256 = _mm256_add_ps(_mm256_load_ps(partial), _mm256_load_ps(partial + 8));
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
+}
+#endif
 
-    return (res);
+#if defined(USE_AVX2_FMA)
+
+// Two accumulators hide the latency of the fused multiply-add.
+HNSWLIB_TARGET("avx2,fma")
+static float
+L2SqrSIMD16ExtAVX2FMA(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
+    float *pVect1 = (float *) pVect1v;
+    float *pVect2 = (float *) pVect2v;
+    size_t qty = *((size_t *) qty_ptr);
+    size_t qty16 = qty >> 4;
+
+    const float *pEnd1 = pVect1 + (qty16 << 4);
+
+    __m256 diff0, diff1;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+
+    while (pVect1 < pEnd1) {
+        diff0 = _mm256_sub_ps(_mm256_loadu_ps(pVect1), _mm256_loadu_ps(pVect2));
+        diff1 = _mm256_sub_ps(_mm256_loadu_ps(pVect1 + 8), _mm256_loadu_ps(pVect2 + 8));
+        sum0 = _mm256_fmadd_ps(diff0, diff0, sum0);
+        sum1 = _mm256_fmadd_ps(diff1, diff1, sum1);
+        pVect1 += 16;
+        pVect2 += 16;
+    }
+
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    sum128 = _mm_hadd_ps(sum128, sum128);
+    return _mm_cvtss_f32(sum128);
 }
+
 #endif
 
 #if defined(USE_AVX)
 
 // Favor using AVX if available.
+HNSWLIB_TARGET("avx")
 static float
 L2SqrSIMD16ExtAVX(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     float *pVect1 = (float *) pVect1v;
@@ -146,6 +183,23 @@ L2SqrSIMD16ExtSSE(const void *pVect1v, const void *pVect2v, const void *qty_ptr)
 #if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
 static DISTFUNC<float> L2SqrSIMD16Ext = L2SqrSIMD16ExtSSE;
 
+// the widest kernel the CPU supports
+static DISTFUNC<float> selectL2SqrSIMD16Ext() {
+#if defined(USE_AVX512)
+    if (AVX512Capable())
+        return L2SqrSIMD16ExtAVX512;
+#endif
+#if defined(USE_AVX2_FMA)
+    if (AVX2FMACapable())
+        return L2SqrSIMD16ExtAVX2FMA;
+#endif
+#if defined(USE_AVX)
+    if (AVXCapable())
+        return L2SqrSIMD16ExtAVX;
+#endif
+    return L2SqrSIMD16ExtSSE;
+}
+
 static float
 L2SqrSIMD16ExtResiduals(const void *pVect1v, const void *pVect2v, const void *qty_ptr) {
     size_t qty = *((size_t *) qty_ptr);
@@ -214,15 +268,7 @@ class L2Space : public SpaceInterface<float> {
     L2Space(size_t dim) {
         fstdistfunc_ = L2Sqr;
 #if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-    #if defined(USE_AVX512)
-        if (AVX512Capable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX512;
-        else if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #elif defined(USE_AVX)
-        if (AVXCapable())
-            L2SqrSIMD16Ext = L2SqrSIMD16ExtAVX;
-    #endif
+        L2SqrSIMD16Ext = selectL2SqrSIMD16Ext();
 
         if (dim % 16 == 0)
             fstdistfunc_ = L2SqrSIMD16Ext;
@@ -291,6 +337,69 @@ static int L2SqrI(const void* __restrict pVect1, const void* __restrict pVect2,
     return (res);
 }
 
+#if defined(USE_AVX2_FMA)
+
+// The bytes are widened to 16 bits so that the differences keep their sign.
+HNSWLIB_TARGET("avx2")
+static int
+L2SqrISIMD16ExtAVX2(const void *__restrict pVect1, const void *__restrict pVect2, const void *__restrict qty_ptr) {
+    size_t qty = *((size_t *) qty_ptr);
+    const unsigned char *a = (const unsigned char *) pVect1;
+    const unsigned char *b = (const unsigned char *) pVect2;
+    int PORTABLE_ALIGN32 TmpRes[8];
+    size_t qty16 = qty >> 4 << 4;
+
+    __m256i sum = _mm256_setzero_si256();
+    for (size_t i = 0; i < qty16; i += 16) {
+        __m256i va = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (a + i)));
+        __m256i vb = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (b + i)));
+        __m256i diff = _mm256_sub_epi16(va, vb);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+    }
+
+    _mm256_store_si256((__m256i *) TmpRes, sum);
+    int res = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] + TmpRes[6] + TmpRes[7];
+    for (size_t i = qty16; i < qty; i++)
+        res += (a[i] - b[i]) * (a[i] - b[i]);
+    return res;
+}
+
+#endif
+
+#if defined(USE_AVX512_VNNI)
+
+// VNNI fuses the multiply and the accumulation of the 16-bit differences.
+HNSWLIB_TARGET("avx512f,avx512bw,avx512vnni")
+static int
+L2SqrISIMD32ExtAVX512VNNI(const void *__restrict pVect1, const void *__restrict pVect2, const void *__restrict qty_ptr) {
+    size_t qty = *((size_t *) qty_ptr);
+    const unsigned char *a = (const unsigned char *) pVect1;
+    const unsigned char *b = (const unsigned char *) pVect2;
+    size_t qty32 = qty >> 5 << 5;
+
+    __m512i sum = _mm512_setzero_si512();
+    for (size_t i = 0; i < qty32; i += 32) {
+        __m512i va = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *) (a + i)));
+        __m512i vb = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *) (b + i)));
+        __m512i diff = _mm512_sub_epi16(va, vb);
+        sum = _mm512_dpwssd_epi32(sum, diff, diff);
+    }
+
+    alignas(64) int partial[16];
+    _mm512_store_si512((void *) partial, sum);
+    __m256i sum256 = _mm256_add_epi32(_mm256_load_si256((const __m256i *) partial),
+                                      _mm256_load_si256((const __m256i *) (partial + 8)));
+    __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum256), _mm256_extracti128_si256(sum256, 1));
+    sum128 = _mm_hadd_epi32(sum128, sum128);
+    sum128 = _mm_hadd_epi32(sum128, sum128);
+    int res = _mm_cvtsi128_si32(sum128);
+    for (size_t i = qty32; i < qty; i++)
+        res += (a[i] - b[i]) * (a[i] - b[i]);
+    return res;
+}
+
+#endif
+
 class L2SpaceI : public SpaceInterface<int> {
     DISTFUNC<int> fstdistfunc_;
     size_t data_size_;
@@ -303,6 +412,15 @@ class L2SpaceI : public SpaceInterface<int> {
         } else {
             fstdistfunc_ = L2SqrI;
         }
+        // the later kernels are the wider ones
+#if defined(USE_AVX2_FMA)
+        if (dim >= 16 && AVX2FMACapable())
+            fstdistfunc_ = L2SqrISIMD16ExtAVX2;
+#endif
+#if defined(USE_AVX512_VNNI)
+        if (dim >= 32 && AVX512VNNICapable())
+            fstdistfunc_ = L2SqrISIMD32ExtAVX512VNNI;
+#endif
         dim_ = dim;
         data_size_ = dim * sizeof(unsigned char);
     }
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+namespace hnswlib {
+typedef uint32_t termid;
+
+/*
+* Inverted index over sparse vectors, e.g. BM25 or learned term weights, in the label space of
+* the vector indexes. Each term keeps a posting list of (label, impact) sorted by label and the
+* largest impact in it, and the score of a point is the sum of query weight * impact over the
+* shared terms. Top-k searches use MaxScore: the lists that alone cannot lift a point into the
+* current top-k are only probed for the points found through the others.
+*
+* Impacts and query weights must be non-negative. Every operation takes the index lock.
+*/
+class SparseIndex {
+    struct Posting {
+        labeltype label;
+        float impact;
+
+        bool operator<(const Posting &other) const {
+            return label < other.label;
+        }
+    };
+
+    struct PostingList {
+        std::vector<Posting> postings;
+        float max_impact{0};
+    };
+
+    struct Cursor {
+        const Posting *current;
+        const Posting *end;
+        float weight;
+        float bound;
+    };
+
+    std::unordered_map<termid, PostingList> terms_;
+    // the terms of each point, to remove it from the posting lists
+    std::unordered_map<labeltype, std::vector<std::pair<termid, float>>> points_;
+
+    mutable std::mutex lock_;
+
+    /*
+    * Sums the weights of duplicate terms and drops the terms that do not count.
+    */
+    static std::vector<std::pair<termid, float>> mergeTerms(const termid *terms, const float *weights, size_t count) {
+        std::vector<std::pair<termid, float>> merged;
+        merged.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            if (!(weights[i] >= 0))
+                throw std::runtime_error("Sparse weights must be non-negative");
+            merged.emplace_back(terms[i], weights[i]);
+        }
+        std::sort(merged.begin(), merged.end());
+        size_t size = 0;
+        for (size_t i = 0; i < merged.size(); i++) {
+            if (size > 0 && merged[size - 1].first == merged[i].first)
+                merged[size - 1].second += merged[i].second;
+            else
+                merged[size++] = merged[i];
+        }
+        merged.resize(size);
+        merged.erase(std::remove_if(merged.begin(), merged.end(),
+                                    [](const std::pair<termid, float> &term) { return term.second == 0; }),
+                     merged.end());
+        return merged;
+    }
+
+    void removePointLocked(labeltype label) {
+        auto found = points_.find(label);
+        if (found == points_.end())
+            return;
+        for (const auto &term : found->second) {
+            auto list = terms_.find(term.first);
+            std::vector<Posting> &postings = list->second.postings;
+            auto posting = std::lower_bound(postings.begin(), postings.end(), Posting{label, 0});
+            postings.erase(posting);
+            if (postings.empty()) {
+                terms_.erase(list);
+            } else if (term.second == list->second.max_impact) {
+                float max_impact = 0;
+                for (const Posting &p : postings)
+                    max_impact = std::max(max_impact, p.impact);
+                list->second.max_impact = max_impact;
+            }
+        }
+        points_.erase(found);
+    }
+
+ public:
+    /*
+    * Sets the sparse vector of the label, replacing the one it had.
+    */
+    void addPoint(const termid *terms, const float *weights, size_t count, labeltype label) {
+        std::vector<std::pair<termid, float>> merged = mergeTerms(terms, weights, count);
+        std::unique_lock<std::mutex> lock(lock_);
+        removePointLocked(label);
+        if (merged.empty())
+            return;
+        for (const auto &term : merged) {
+            PostingList &list = terms_[term.first];
+            // labels mostly come in increasing order, the others are inserted in place
+            if (list.postings.empty() || list.postings.back().label < label)
+                list.postings.push_back(Posting{label, term.second});
+            else
+                list.postings.insert(std::lower_bound(list.postings.begin(), list.postings.end(), Posting{label, 0}),
+                                     Posting{label, term.second});
+            list.max_impact = std::max(list.max_impact, term.second);
+        }
+        points_[label] = std::move(merged);
+    }
+
+
+    /*
+    * Removes the sparse vector of the label, returns false if it has none.
+    */
+    bool removePoint(labeltype label) {
+        std::unique_lock<std::mutex> lock(lock_);
+        if (points_.count(label) == 0)
+            return false;
+        removePointLocked(label);
+        return true;
+    }
+
+
+    size_t getCurrentElementCount() const {
+        std::unique_lock<std::mutex> lock(lock_);
+        return points_.size();
+    }
+
+
+    void clear() {
+        std::unique_lock<std::mutex> lock(lock_);
+        terms_.clear();
+        points_.clear();
+    }
+
+
+    /*
+    * Returns the k points with the highest scores for the query as (score, label) pairs, highest
+    * first. Points sharing no term with the query are never returned.
+    */
+    std::vector<std::pair<float, labeltype>>
+    searchKnn(const termid *terms, const float *weights, size_t count, size_t k,
+              BaseFilterFunctor *isIdAllowed = nullptr) const {
+        std::vector<std::pair<float, labeltype>> result;
+        std::vector<std::pair<termid, float>> query = mergeTerms(terms, weights, count);
+        if (k == 0 || query.empty())
+            return result;
+        std::unique_lock<std::mutex> lock(lock_);
+
+        std::vector<Cursor> cursors;
+        cursors.reserve(query.size());
+        for (const auto &term : query) {
+            auto list = terms_.find(term.first);
+            if (list == terms_.end())
+                continue;
+            const std::vector<Posting> &postings = list->second.postings;
+            cursors.push_back(Cursor{postings.data(), postings.data() + postings.size(), term.second,
+                                     term.second * list->second.max_impact});
+        }
+        // lists with the lowest bounds first, upper_bounds[i] bounds the score from lists 0..i
+        std::sort(cursors.begin(), cursors.end(),
+                  [](const Cursor &a, const Cursor &b) { return a.bound < b.bound; });
+        std::vector<float> upper_bounds(cursors.size());
+        float sum = 0;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            sum += cursors[i].bound;
+            upper_bounds[i] = sum;
+        }
+
+        // min-heap of the top-k found, threshold is the k-th score once k are found
+        std::priority_queue<std::pair<float, labeltype>, std::vector<std::pair<float, labeltype>>,
+                            std::greater<std::pair<float, labeltype>>> top;
+        float threshold = 0;
+        // lists before first_essential are only probed
+        size_t first_essential = 0;
+
+        while (first_essential < cursors.size()) {
+            labeltype label = 0;
+            bool found = false;
+            for (size_t i = first_essential; i < cursors.size(); i++) {
+                if (cursors[i].current != cursors[i].end && (!found || cursors[i].current->label < label)) {
+                    label = cursors[i].current->label;
+                    found = true;
+                }
+            }
+            if (!found)
+                break;
+
+            float score = 0;
+            for (size_t i = first_essential; i < cursors.size(); i++) {
+                Cursor &cursor = cursors[i];
+                if (cursor.current != cursor.end && cursor.current->label == label) {
+                    score += cursor.weight * cursor.current->impact;
+                    cursor.current++;
+                }
+            }
+            if (isIdAllowed && !(*isIdAllowed)(label))
+                continue;
+            bool full = top.size() == k;
+            for (size_t i = first_essential; i > 0; i--) {
+                if (full && score + upper_bounds[i - 1] <= threshold)
+                    break;
+                Cursor &cursor = cursors[i - 1];
+                cursor.current = std::lower_bound(cursor.current, cursor.end, Posting{label, 0});
+                if (cursor.current != cursor.end && cursor.current->label == label)
+                    score += cursor.weight * cursor.current->impact;
+            }
+            if (full && score <= threshold)
+                continue;
+
+            top.emplace(score, label);
+            if (top.size() > k)
+                top.pop();
+            if (top.size() == k) {
+                threshold = top.top().first;
+                while (first_essential < cursors.size() && upper_bounds[first_essential] <= threshold)
+                    first_essential++;
+            }
+        }
+
+        result.resize(top.size());
+        for (size_t i = top.size(); i > 0; i--) {
+            result[i - 1] = top.top();
+            top.pop();
+        }
+        return result;
+    }
+
+
+    void saveToStream(std::ostream &output) const {
+        std::unique_lock<std::mutex> lock(lock_);
+        size_t count = points_.size();
+        writeBinaryPOD(output, count);
+        for (const auto &point : points_) {
+            writeBinaryPOD(output, point.first);
+            uint32_t size = (uint32_t) point.second.size();
+            writeBinaryPOD(output, size);
+            output.write((const char *) point.second.data(), size * sizeof(std::pair<termid, float>));
+        }
+    }
+
+
+    void loadFromStream(std::istream &input) {
+        std::unique_lock<std::mutex> lock(lock_);
+        terms_.clear();
+        points_.clear();
+        size_t count;
+        readBinaryPOD(input, count);
+        points_.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            labeltype label;
+            uint32_t size;
+            readBinaryPOD(input, label);
+            readBinaryPOD(input, size);
+            std::vector<std::pair<termid, float>> point(size);
+            input.read((char *) point.data(), size * sizeof(std::pair<termid, float>));
+            if (!input)
+                throw std::runtime_error("Sparse index seems to be corrupted or unsupported");
+            for (const auto &term : point) {
+                PostingList &list = terms_[term.first];
+                list.postings.push_back(Posting{label, term.second});
+                list.max_impact = std::max(list.max_impact, term.second);
+            }
+            points_[label] = std::move(point);
+        }
+        for (auto &list : terms_)
+            std::sort(list.second.postings.begin(), list.second.postings.end());
+    }
+};
+
+}  // namespace hnswlib
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hnswlib {
+
+/*
+* Worker threads shared by the parallel loops of the indexes, so that a batch search or a
+* parallel build does not start and join its own threads on every call. The workers are started
+* on first use and kept until the process exits; starting a thread is costly in particular for
+* the web workers that back the threads of pthread wasm builds.
+*/
+class ThreadPool {
+    // one call of run: its tasks are claimed in order by the caller and the workers holding a ticket
+    struct Job {
+        const std::function<void(size_t)> *task;
+        size_t num_tasks;
+        std::atomic<size_t> next{0};
+        size_t tickets{0};  // workers that may still work on the job, guarded by the pool lock
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        void work() {
+            for (size_t i = next++; i < num_tasks; i = next++) {
+                try {
+                    (*task)(i);
+                } catch (...) {
+                    std::unique_lock<std::mutex> lock(error_lock);
+                    if (!error)
+                        error = std::current_exception();
+                    next = num_tasks;
+                    return;
+                }
+            }
+        }
+    };
+
+    std::mutex lock_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Job *> tickets_;
+    std::vector<std::thread> workers_;
+    bool stop_{false};
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(lock_);
+        while (true) {
+            work_cv_.wait(lock, [this]() { return stop_ || !tickets_.empty(); });
+            if (tickets_.empty())
+                return;
+            Job *job = tickets_.front();
+            tickets_.pop_front();
+            lock.unlock();
+            job->work();
+            lock.lock();
+            if (--job->tickets == 0)
+                done_cv_.notify_all();
+        }
+    }
+
+    ThreadPool() {}
+
+ public:
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    static ThreadPool &instance() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto &worker : workers_)
+            worker.join();
+    }
+
+    /*
+    * Calls task(i) for every i in [0, num_tasks) on the calling thread and up to num_tasks - 1
+    * workers, and returns once all calls have ended. The tasks run concurrently only while workers
+    * are idle, so they must not wait for each other. The first exception thrown stops the tasks
+    * not yet started and is rethrown. May be called from a task.
+    */
+    void run(size_t num_tasks, const std::function<void(size_t)> &task) {
+        Job job;
+        job.task = &task;
+        job.num_tasks = num_tasks;
+        size_t helpers = num_tasks > 1 ? num_tasks - 1 : 0;
+        if (helpers > 0) {
+            std::unique_lock<std::mutex> lock(lock_);
+            while (workers_.size() < helpers)
+                workers_.emplace_back([this]() { workerLoop(); });
+            job.tickets = helpers;
+            for (size_t i = 0; i < helpers; i++)
+                tickets_.push_back(&job);
+            lock.unlock();
+            work_cv_.notify_all();
+        }
+
+        job.work();
+
+        if (helpers > 0) {
+            // tickets no worker picked up are withdrawn, the others are waited for
+            std::unique_lock<std::mutex> lock(lock_);
+            for (auto it = tickets_.begin(); it != tickets_.end();) {
+                if (*it == &job) {
+                    it = tickets_.erase(it);
+                    job.tickets--;
+                } else {
+                    ++it;
+                }
+            }
+            done_cv_.wait(lock, [&job]() { return job.tickets == 0; });
+        }
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+};
+
+}  // namespace hnswlib
@@ -57,11 +57,26 @@ class VisitedListPool {
             } else {
                 rez = new VisitedList(numelements);
             }
+            if (rez->numelements < (unsigned int) numelements) {
+                // created before the last reserve
+                delete rez;
+                rez = new VisitedList(numelements);
+            }
         }
         rez->reset();
         return rez;
     }
 
+    /*
+    * Makes the lists handed out from now on cover at least numelements1 elements. The lists in the
+    * pool are replaced lazily, so growing an index does not allocate all of them at once.
+    */
+    void reserve(int numelements1) {
+        std::unique_lock <std::mutex> lock(poolguard);
+        if (numelements1 > numelements)
+            numelements = numelements1;
+    }
+
     void releaseVisitedList(VisitedList *vl) {
         std::unique_lock <std::mutex> lock(poolguard);
         pool.push_front(vl);
@@ -4,6 +4,7 @@ import type factory from './hnswlib-wasm';
 
 export type HierarchicalNSW = module.HierarchicalNSW;
 export type BruteforceSearch = module.BruteforceSearch;
+export type PartitionedIndex = module.PartitionedIndex;
 export type L2Space = module.L2Space;
 export type InnerProductSpace = module.InnerProductSpace;
 export type VectorFloat = module.VectorFloat;
@@ -14,6 +15,7 @@ export type HnswModuleFactory = typeof factory;
 export type normalizePoint = HnswlibModule['normalizePoint'];
 
 export * from './constants';
+export * from './sharded-index';
 
 export interface HnswlibModule extends EmscriptenModule {
   normalizePoint(vec: number[]): number[];
@@ -24,11 +26,13 @@ export interface HnswlibModule extends EmscriptenModule {
     readIndexFromBuffer: (buffer: Uint8Array) => void;
     writeIndexToBuffer: () => Uint8Array;
   };
+  PartitionedIndex: new (space: 'l2' | 'ip' | 'cosine', dim: number) => module.PartitionedIndex;
   VectorFloat: new () => module.VectorFloat;
   VectorInt: new () => module.VectorInt;
 }
 
 let library: HnswlibModule;
+let library64: HnswlibModule;
 
 /**
  * Load the HNSW library in node or browser
@@ -54,6 +58,40 @@ export const loadHnswlib = async (): Promise<HnswlibModule> => {
   }
 };
 
+/**
+ * Load the wasm64 build of the HNSW library in node, its memory can grow past the 4 GB of the default build.
+ * The build is made with `make wasm64` and needs node with Memory64 support (node >= 24, or node 20/22 with
+ * `--experimental-wasm-memory64`). Indexes saved by the two builds are not interchangeable.
+ */
+export const loadHnswlib64 = async (): Promise<HnswlibModule> => {
+  if (typeof process === 'undefined' || process.versions?.node === undefined) {
+    throw new Error('The wasm64 build of hnswlib can only be loaded in node.');
+  }
+  if (!library64) {
+    // resolved at runtime, the wasm64 build is optional and not bundled
+    const modulePath = new URL('../lib/hnswlib64.mjs', import.meta.url).href;
+    const factoryFunc = (await import(/* @vite-ignore */ modulePath)).default;
+    library64 = (await factoryFunc()) as HnswlibModule;
+  }
+  return library64;
+};
+
+/**
+ * Create a new instance of the HNSW library with its own memory, unlike `loadHnswlib` which always returns the same
+ * instance. Used to place the shards of a `ShardedIndex` in separate memories.
+ */
+export const instantiateHnswlib = async (): Promise<HnswlibModule> => {
+  // @ts-expect-error - hnswlib can be a global variable in the browser
+  if (typeof hnswlib !== 'undefined' && hnswlib !== null) {
+    // @ts-expect-error - hnswlib can be a global variable in the browser
+    const lib = hnswlib();
+    if (lib != null) return lib;
+  }
+
+  const factoryFunc = (await import('../lib/hnswlib.mjs')).default;
+  return (await factoryFunc()) as HnswlibModule;
+};
+
 // disabled due to lack of perfomance improvemant and additional complexity
 
 // /**
@@ -0,0 +1,237 @@
+import type { SearchFilter, SearchResult } from './hnswlib-wasm';
+
+/**
+ * The part of the index API a shard has to provide. `HierarchicalNSW` satisfies it directly; a shard living in a
+ * web worker can implement it with methods returning promises, in which case the shards are searched in parallel.
+ */
+export interface IndexShard {
+  addPoint(point: number[], label: number, replaceDeleted: boolean): void | Promise<void>;
+  markDelete(label: number): void | Promise<void>;
+  searchKnn(
+    queryPoint: number[],
+    numNeighbors: number,
+    filter: SearchFilter | undefined
+  ): SearchResult | Promise<SearchResult>;
+  getCurrentCount(): number | Promise<number>;
+  getUsedLabelsView(): Uint32Array | Promise<Uint32Array>;
+  writeIndexToBuffer(): Uint8Array | Promise<Uint8Array>;
+  readIndexFromBuffer(buffer: Uint8Array): void | Promise<void>;
+}
+
+/**
+ * How labels are assigned to shards. `hash`: by a hash of the label, so no bookkeeping is needed.
+ * `round-robin`: in insertion order, which keeps the shards evenly filled; the assignment is kept in memory and
+ * rebuilt from the shard contents by `loadShard`.
+ */
+export type ShardRouting = 'hash' | 'round-robin';
+
+const hashLabel = (label: number): number => {
+  let x = label >>> 0;
+  x = Math.imul(x ^ (x >>> 16), 0x45d9f3b);
+  x = Math.imul(x ^ (x >>> 16), 0x45d9f3b);
+  return (x ^ (x >>> 16)) >>> 0;
+};
+
+/**
+ * Merges search results sorted by ascending distance into the `numNeighbors` closest, using a heap over the heads
+ * of the shard results.
+ */
+export const mergeSearchResults = (results: SearchResult[], numNeighbors: number): SearchResult => {
+  const distances: number[] = [];
+  const neighbors: number[] = [];
+  // heap entries: [shard, position in that shard's result]
+  const heap: [number, number][] = [];
+  const less = (a: [number, number], b: [number, number]) =>
+    results[a[0]].distances[a[1]] < results[b[0]].distances[b[1]];
+  const siftDown = (i: number) => {
+    for (;;) {
+      const l = 2 * i + 1;
+      const r = l + 1;
+      let m = i;
+      if (l < heap.length && less(heap[l], heap[m])) m = l;
+      if (r < heap.length && less(heap[r], heap[m])) m = r;
+      if (m === i) return;
+      [heap[i], heap[m]] = [heap[m], heap[i]];
+      i = m;
+    }
+  };
+
+  results.forEach((result, shard) => {
+    if (result.distances.length > 0) heap.push([shard, 0]);
+  });
+  for (let i = Math.floor(heap.length / 2) - 1; i >= 0; i--) siftDown(i);
+
+  while (heap.length > 0 && distances.length < numNeighbors) {
+    const [shard, pos] = heap[0];
+    distances.push(results[shard].distances[pos]);
+    neighbors.push(results[shard].neighbors[pos]);
+    if (pos + 1 < results[shard].distances.length) {
+      heap[0] = [shard, pos + 1];
+    } else {
+      heap[0] = heap[heap.length - 1];
+      heap.pop();
+    }
+    siftDown(0);
+  }
+  return { distances, neighbors };
+};
+
+/**
+ * Search index made of independent shards, each one a full index with its own memory. Placing the shards in
+ * separate module instances (see `instantiateHnswlib`) or workers lifts the size limit of a single wasm memory.
+ * Inserts are routed to one shard, searches go to all shards and their results are merged.
+ *
+ * ```typescript
+ * const shards = [];
+ * for (let i = 0; i < 4; i++) {
+ *   const lib = await instantiateHnswlib();
+ *   const shard = new lib.HierarchicalNSW('l2', 3);
+ *   shard.initIndex(1_000_000, 16, 200, 100);
+ *   shards.push(shard);
+ * }
+ * const index = new ShardedIndex(shards, 'hash');
+ * await index.addPoint([1, 2, 3], 0);
+ * const result = await index.searchKnn([1, 2, 3], 10);
+ * ```
+ */
+export class ShardedIndex {
+  private readonly shards: IndexShard[];
+  private readonly routing: ShardRouting;
+  private readonly labelToShard = new Map<number, number>();
+  private nextShard = 0;
+
+  /**
+   * @param {IndexShard[]} shards The initialized shards, their number is fixed.
+   * @param {ShardRouting} routing How labels are assigned to shards (default: 'hash').
+   */
+  constructor(shards: IndexShard[], routing: ShardRouting = 'hash') {
+    if (shards.length === 0) {
+      throw new Error('Invalid the number of shards (must be a positive number).');
+    }
+    this.shards = shards;
+    this.routing = routing;
+  }
+
+  /**
+   * returns the number of shards.
+   * @return {number} The number of shards.
+   */
+  getNumShards(): number {
+    return this.shards.length;
+  }
+
+  /**
+   * returns the shard at the given position.
+   * @param {number} shard The position of the shard.
+   * @return {IndexShard} The shard.
+   */
+  getShard(shard: number): IndexShard {
+    this.checkShard(shard);
+    return this.shards[shard];
+  }
+
+  /**
+   * returns the shard that holds or would receive the given label.
+   * @param {number} label The label of the datum point.
+   * @return {number} The position of the shard.
+   */
+  shardOf(label: number): number {
+    if (this.routing === 'hash') {
+      return hashLabel(label) % this.shards.length;
+    }
+    const shard = this.labelToShard.get(label);
+    return shard !== undefined ? shard : this.nextShard;
+  }
+
+  /**
+   * adds a datum point to the shard its label is routed to. Updates the point if the label is already indexed.
+   * @param {number[]} point The datum point to be added.
+   * @param {number} label The label of the datum point, unique across all shards.
+   * @param {boolean} replaceDeleted Whether the place of a deleted datum point can be reused (default: false).
+   */
+  async addPoint(point: number[], label: number, replaceDeleted = false): Promise<void> {
+    const shard = this.shardOf(label);
+    await this.shards[shard].addPoint(point, label, replaceDeleted);
+    if (this.routing === 'round-robin' && !this.labelToShard.has(label)) {
+      this.labelToShard.set(label, shard);
+      this.nextShard = (this.nextShard + 1) % this.shards.length;
+    }
+  }
+
+  /**
+   * marks the datum point as deleted in the shard that holds it.
+   * @param {number} label The label of the datum point to be deleted.
+   */
+  async markDelete(label: number): Promise<void> {
+    if (this.routing === 'round-robin' && !this.labelToShard.has(label)) {
+      throw new Error(`Label not found: ${label}`);
+    }
+    await this.shards[this.shardOf(label)].markDelete(label);
+  }
+
+  /**
+   * returns the `numNeighbors` closest items over all shards. Every shard is searched for `numNeighbors` items,
+   * the shards returning promises are searched concurrently.
+   * @param {number[]} queryPoint The query point vector.
+   * @param {number} numNeighbors The number of nearest neighbors to search for.
+   * @param {SearchFilter | undefined} filter The function filters elements by its labels, or the array of allowed labels.
+   * @return {SearchResult} The distances and labels of the nearest neighbors, closest first.
+   */
+  async searchKnn(
+    queryPoint: number[],
+    numNeighbors: number,
+    filter?: SearchFilter | undefined
+  ): Promise<SearchResult> {
+    const counts = await Promise.all(this.shards.map((shard) => shard.getCurrentCount()));
+    const results = await Promise.all(
+      this.shards.map((shard, i) =>
+        counts[i] > 0 ? shard.searchKnn(queryPoint, Math.min(numNeighbors, counts[i]), filter) : null
+      )
+    );
+    return mergeSearchResults(results.filter((result): result is SearchResult => result !== null), numNeighbors);
+  }
+
+  /**
+   * returns the number of data points over all shards.
+   * @return {number} The number of data points.
+   */
+  async getCurrentCount(): Promise<number> {
+    const counts = await Promise.all(this.shards.map((shard) => shard.getCurrentCount()));
+    return counts.reduce((sum, count) => sum + count, 0);
+  }
+
+  /**
+   * saves one shard, so that the shards can be stored and loaded independently.
+   * @param {number} shard The position of the shard.
+   * @return {Uint8Array} The buffer containing the shard data.
+   */
+  async saveShard(shard: number): Promise<Uint8Array> {
+    this.checkShard(shard);
+    return this.shards[shard].writeIndexToBuffer();
+  }
+
+  /**
+   * loads one shard from a buffer written by `saveShard`. Shards must be loaded back at the position they were
+   * saved from, otherwise hash routing sends updates and deletions to the wrong shard.
+   * @param {number} shard The position of the shard.
+   * @param {Uint8Array} buffer The buffer to read from.
+   */
+  async loadShard(shard: number, buffer: Uint8Array): Promise<void> {
+    this.checkShard(shard);
+    await this.shards[shard].readIndexFromBuffer(buffer);
+    if (this.routing === 'round-robin') {
+      for (const [label, owner] of this.labelToShard) {
+        if (owner === shard) this.labelToShard.delete(label);
+      }
+      // other calls into the module may run while awaiting and detach a view, keep a copy
+      const labels = (await this.shards[shard].getUsedLabelsView()).slice();
+      labels.forEach((label) => this.labelToShard.set(label, shard));
+    }
+  }
+
+  private checkShard(shard: number): void {
+    if (!Number.isInteger(shard) || shard < 0 || shard >= this.shards.length) {
+      throw new RangeError(`Invalid shard (expected 0 to ${this.shards.length - 1}, but got ${shard}).`);
+    }
+  }
+}
@@ -7,16 +7,25 @@
 #include <emscripten/val.h>
 #include <exception>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
 #include <fstream>
 #include <memory>
 #include <new>
 #include <numeric>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <iostream>
+#include <list>
+#include <limits>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "hnswlib/hnswlib.h"
 
 namespace emscripten {
@@ -36,6 +45,87 @@ namespace emscripten {
       }
     }
 
+    /// @brief The constant added to the ranks by reciprocal rank fusion, the usual 60
+    const float RRF_RANK_CONSTANT = 60.0f;
+
+    /// @brief Ends an index image with extra sections: the graph image, the sparse vectors, the attributes, the next
+    /// label addItems hands out as uint64, the size of the graph image as uint64, then this tag. Images ending with
+    /// EXTRA_SECTIONS_TAG_V1 have no next label. Images without extra sections are plain graph images.
+    const char EXTRA_SECTIONS_TAG[8] = {'H', 'N', 'S', 'W', 'E', 'X', 'T', '2'};
+    const char EXTRA_SECTIONS_TAG_V1[8] = {'H', 'N', 'S', 'W', 'E', 'X', 'T', '1'};
+
+    /// @brief Splits an index image into the graph image and the extra sections, returns false if it has none
+    /// @param hasNextLabel set to whether the extra sections end with the next label
+    bool splitExtraSections(const std::vector<char>& buffer, std::vector<char>& graphImage, std::string& extraSections,
+                            bool& hasNextLabel) {
+      const size_t trailerSize = sizeof(uint64_t) + sizeof(EXTRA_SECTIONS_TAG);
+      if (buffer.size() < trailerSize) return false;
+      const char* tag = buffer.data() + buffer.size() - sizeof(EXTRA_SECTIONS_TAG);
+      hasNextLabel = memcmp(tag, EXTRA_SECTIONS_TAG, sizeof(EXTRA_SECTIONS_TAG)) == 0;
+      if (!hasNextLabel && memcmp(tag, EXTRA_SECTIONS_TAG_V1, sizeof(EXTRA_SECTIONS_TAG_V1)) != 0) {
+        return false;
+      }
+      uint64_t graphSize;
+      memcpy(&graphSize, buffer.data() + buffer.size() - trailerSize, sizeof(graphSize));
+      if (graphSize > buffer.size() - trailerSize) return false;
+      graphImage.assign(buffer.begin(), buffer.begin() + graphSize);
+      extraSections.assign(buffer.begin() + graphSize, buffer.end() - trailerSize);
+      return true;
+    }
+
+    /// @brief Converts (score, id) pairs into a {<idsKey>: Uint32Array, scores: Float32Array} object
+    emscripten::val scoredResultsToObject(const std::vector<std::pair<float, uint32_t>>& scored, const char* idsKey) {
+      std::vector<uint32_t> ids(scored.size());
+      std::vector<float> scores(scored.size());
+      for (size_t i = 0; i < scored.size(); i++) {
+        scores[i] = scored[i].first;
+        ids[i] = scored[i].second;
+      }
+      emscripten::val idsArray = emscripten::val::global("Uint32Array").new_(ids.size());
+      idsArray.call<void>("set", emscripten::val(emscripten::typed_memory_view(ids.size(), ids.data())));
+      emscripten::val scoresArray = emscripten::val::global("Float32Array").new_(scores.size());
+      scoresArray.call<void>("set", emscripten::val(emscripten::typed_memory_view(scores.size(), scores.data())));
+
+      emscripten::val results = emscripten::val::object();
+      results.set(idsKey, idsArray);
+      results.set("scores", scoresArray);
+      return results;
+    }
+
+    /// @brief Converts (distance, label) pairs, closest first, into a {distances: Float32Array, neighbors: Uint32Array} object
+    emscripten::val rangeResultsToObject(const std::vector<std::pair<float, size_t>>& found) {
+      std::vector<float> distances(found.size());
+      std::vector<uint32_t> neighbors(found.size());
+      for (size_t i = 0; i < found.size(); i++) {
+        distances[i] = found[i].first;
+        neighbors[i] = static_cast<uint32_t>(found[i].second);
+      }
+      emscripten::val distancesArray = emscripten::val::global("Float32Array").new_(distances.size());
+      distancesArray.call<void>("set", emscripten::val(emscripten::typed_memory_view(distances.size(), distances.data())));
+      emscripten::val neighborsArray = emscripten::val::global("Uint32Array").new_(neighbors.size());
+      neighborsArray.call<void>("set", emscripten::val(emscripten::typed_memory_view(neighbors.size(), neighbors.data())));
+
+      emscripten::val results = emscripten::val::object();
+      results.set("distances", distancesArray);
+      results.set("neighbors", neighborsArray);
+      return results;
+    }
+
+    /// @brief Copies a point into the layout the index stores: cosine spaces append the inverse norm, and
+    /// cosine indexes saved by older versions store the normalized vector
+    std::vector<float> preparePoint(const std::vector<float>& vec, const hnswlib::CosineSpace* cosine, bool normalize) {
+      if (cosine) {
+        std::vector<float> point(vec.size() + 1);
+        cosine->preparePoint(vec.data(), point.data());
+        return point;
+      }
+      std::vector<float> point = vec;
+      if (normalize) {
+        normalizePoints(point);
+      }
+      return point;
+    }
+
     void normalizePointsPtrs(float* vec, size_t dim) {
       float sum = 0;
       for (size_t i = 0; i < dim; ++i) {
@@ -150,6 +240,127 @@ namespace emscripten {
     emscripten::val callback_;
   };
 
+  /// @brief The document of each chunk label, the groups searchDocuments ranks
+  class DocumentMap : public hnswlib::BaseGroupFunctor {
+  public:
+    void set(uint32_t label, uint32_t document) {
+      erase(label);
+      documentOfLabel_[label] = document;
+      labelsOfDocument_[document].push_back(label);
+    }
+
+    void erase(uint32_t label) {
+      auto found = documentOfLabel_.find(label);
+      if (found == documentOfLabel_.end()) return;
+      std::vector<uint32_t>& previous = labelsOfDocument_[found->second];
+      previous.erase(std::find(previous.begin(), previous.end(), label));
+      if (previous.empty()) labelsOfDocument_.erase(found->second);
+      documentOfLabel_.erase(found);
+    }
+
+    bool contains(uint32_t label) const {
+      return documentOfLabel_.count(label) != 0;
+    }
+
+    int64_t documentOf(uint32_t label) const {
+      auto found = documentOfLabel_.find(label);
+      return found == documentOfLabel_.end() ? -1 : static_cast<int64_t>(found->second);
+    }
+
+    const std::vector<uint32_t>& labelsOf(uint32_t document) const {
+      return labelsOfDocument_.at(document);
+    }
+
+    void clear() {
+      documentOfLabel_.clear();
+      labelsOfDocument_.clear();
+    }
+
+    hnswlib::labeltype operator()(hnswlib::labeltype label) override {
+      return documentOfLabel_.at(static_cast<uint32_t>(label));
+    }
+
+  private:
+    std::unordered_map<uint32_t, uint32_t> documentOfLabel_;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> labelsOfDocument_;
+  };
+
+  /// @brief Allows the labels that belong to a document, chunks without a document are not searched for
+  class DocumentFilterFunctor : public hnswlib::BaseFilterFunctor {
+  public:
+    explicit DocumentFilterFunctor(const DocumentMap& documents) : documents_(documents) {}
+
+    bool operator()(hnswlib::labeltype id) override {
+      return documents_.contains(static_cast<uint32_t>(id));
+    }
+
+  private:
+    const DocumentMap& documents_;
+  };
+
+  /// @brief Converts an attribute predicate object: {and: [...]}, {or: [...]}, {not: predicate},
+  /// {attribute, min, max} for numbers in [min, max], or {attribute, tags} for any of the tags
+  hnswlib::AttributePredicate parseAttributePredicate(emscripten::val js_predicate) {
+    hnswlib::AttributePredicate predicate;
+    if (js_predicate.isNull() || js_predicate.isUndefined() || js_predicate.typeOf().as<std::string>() != "object") {
+      printf("Invalid attribute predicate (must be an object).\n");
+      throw std::invalid_argument("Invalid attribute predicate (must be an object).");
+    }
+    if (!js_predicate["and"].isUndefined() || !js_predicate["or"].isUndefined()) {
+      const bool isAnd = !js_predicate["and"].isUndefined();
+      predicate.kind = isAnd ? hnswlib::AttributePredicate::AND : hnswlib::AttributePredicate::OR;
+      emscripten::val clauses = js_predicate[isAnd ? "and" : "or"];
+      if (!clauses.isArray()) {
+        printf("Invalid attribute predicate (and and or must be arrays of predicates).\n");
+        throw std::invalid_argument("Invalid attribute predicate (and and or must be arrays of predicates).");
+      }
+      const size_t length = clauses["length"].as<size_t>();
+      for (size_t i = 0; i < length; i++) predicate.children.push_back(parseAttributePredicate(clauses[i]));
+    }
+    else if (!js_predicate["not"].isUndefined()) {
+      predicate.kind = hnswlib::AttributePredicate::NOT;
+      predicate.children.push_back(parseAttributePredicate(js_predicate["not"]));
+    }
+    else if (!js_predicate["attribute"].isUndefined() && !js_predicate["tags"].isUndefined()) {
+      predicate.kind = hnswlib::AttributePredicate::TAGS;
+      predicate.column = js_predicate["attribute"].as<std::string>();
+      emscripten::val tags = js_predicate["tags"];
+      if (tags.isString()) {
+        predicate.tags.push_back(tags.as<std::string>());
+      } else {
+        const size_t length = tags["length"].as<size_t>();
+        for (size_t i = 0; i < length; i++) predicate.tags.push_back(tags[i].as<std::string>());
+      }
+    }
+    else if (!js_predicate["attribute"].isUndefined()) {
+      predicate.kind = hnswlib::AttributePredicate::RANGE;
+      predicate.column = js_predicate["attribute"].as<std::string>();
+      emscripten::val min = js_predicate["min"];
+      emscripten::val max = js_predicate["max"];
+      predicate.min = min.isUndefined() ? -std::numeric_limits<double>::infinity() : min.as<double>();
+      predicate.max = max.isUndefined() ? std::numeric_limits<double>::infinity() : max.as<double>();
+    }
+    else {
+      printf("Invalid attribute predicate (expected and, or, not, or attribute).\n");
+      throw std::invalid_argument("Invalid attribute predicate (expected and, or, not, or attribute).");
+    }
+    return predicate;
+  }
+
+  /// @brief Creates the native filter for a search filter argument: either a function called with each label,
+  /// or an array of the allowed labels, whose size lets the index pick the search strategy up front
+  std::unique_ptr<hnswlib::BaseFilterFunctor> createFilterFunctor(emscripten::val js_filter) {
+    if (js_filter.isNull() || js_filter.isUndefined()) {
+      return nullptr;
+    }
+    if (js_filter.isArray() || js_filter.instanceof(emscripten::val::global("Uint32Array"))) {
+      const std::vector<uint32_t> labels = emscripten::convertJSArrayToNumberVector<uint32_t>(js_filter);
+      return std::unique_ptr<hnswlib::BaseFilterFunctor>(
+        new hnswlib::LabelSetFilter(std::vector<hnswlib::labeltype>(labels.begin(), labels.end())));
+    }
+    return std::unique_ptr<hnswlib::BaseFilterFunctor>(new CustomFilterFunctor(js_filter));
+  }
+
 
 
   /*****************/
@@ -159,10 +370,13 @@ namespace emscripten {
     uint32_t dim_;
     hnswlib::BruteforceSearch<float>* index_;
     hnswlib::SpaceInterface<float>* space_;
+    /// @brief The space of a cosine index, nullptr for other spaces and for cosine indexes saved by older versions
+    hnswlib::CosineSpace* cosine_;
+    /// @brief Whether points are normalized before they are stored, only for cosine indexes saved by older versions
     bool normalize_;
 
     BruteforceSearch(const std::string& space_name, uint32_t dim)
-      : index_(nullptr), space_(nullptr), normalize_(false), dim_(dim) {
+      : index_(nullptr), space_(nullptr), cosine_(nullptr), normalize_(false), dim_(dim) {
 
       if (space_name == "l2") {
         space_ = new hnswlib::L2Space(static_cast<size_t>(dim_));
@@ -171,8 +385,8 @@ namespace emscripten {
         space_ = new hnswlib::InnerProductSpace(static_cast<size_t>(dim_));
       }
       else if (space_name == "cosine") {
-        space_ = new hnswlib::InnerProductSpace(static_cast<size_t>(dim_));
-        normalize_ = true;
+        cosine_ = new hnswlib::CosineSpace(static_cast<size_t>(dim_));
+        space_ = cosine_;
       }
       else {
         printf("invalid space should be expected l2, ip, or cosine, name: %s\n", space_name.c_str());
@@ -194,15 +408,29 @@ namespace emscripten {
       }
     }
 
+    /// @brief Cosine indexes store the inverse norm after each vector, the legacy ones saved by older versions
+    /// store normalized vectors and are searched with the inner product space. Only called without index_.
+    void useCosineSpace(bool legacy) {
+      if (space_) delete space_;
+      cosine_ = legacy ? nullptr : new hnswlib::CosineSpace(static_cast<size_t>(dim_));
+      space_ = legacy ? static_cast<hnswlib::SpaceInterface<float>*>(new hnswlib::InnerProductSpace(static_cast<size_t>(dim_))) : cosine_;
+      normalize_ = legacy;
+    }
+
     void initIndex(uint32_t max_elements) {
       if (index_) delete index_;
+      if (normalize_) useCosineSpace(false);
       index_ = new hnswlib::BruteforceSearch<float>(space_, static_cast<size_t>(max_elements));
     }
 
     void readIndexFromBuffer(const std::vector<char>& buffer) {
       if (index_) delete index_;
+      index_ = nullptr;
 
       try {
+        if (normalize_) useCosineSpace(false);
+        // images saved before the cosine space stored the norm hold only dim floats per vector
+        if (cosine_ && hnswlib::BruteforceSearch<float>::getStoredDataSize(buffer) == dim_ * sizeof(float)) useCosineSpace(true);
         index_ = new hnswlib::BruteforceSearch<float>(space_);
         index_->loadIndexFromBuffer(buffer, space_);
       }
@@ -247,10 +475,7 @@ namespace emscripten {
         throw std::invalid_argument("Invalid vector size. Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
       }
 
-      std::vector<float> mutableVec = vec;
-      if (normalize_) {
-        internal::normalizePoints(mutableVec);
-      }
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
 
       if (index_->cur_element_count == index_->maxelements_) {
         throw std::runtime_error("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: " + std::to_string(index_->maxelements_));
@@ -296,11 +521,7 @@ namespace emscripten {
         filterFnCpp = new CustomFilterFunctor(js_filterFn);
       }
 
-      std::vector<float> mutableVec = vec;
-
-      if (normalize_) {
-        internal::normalizePoints(mutableVec);
-      }
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
 
       std::priority_queue<std::pair<float, size_t>> knn =
         index_->searchKnn(reinterpret_cast<void*>(mutableVec.data()), static_cast<size_t>(k), filterFnCpp);
@@ -313,7 +534,7 @@ namespace emscripten {
       for (int32_t i = static_cast<int32_t>(n_results) - 1; i >= 0; i--) {
         auto nn = knn.top();
         distances.set(i, nn.first);
-        neighbors.set(i, nn.second);
+        neighbors.set(i, static_cast<uint32_t>(nn.second));
         knn.pop();
       }
 
@@ -326,6 +547,89 @@ namespace emscripten {
       return results;
     }
 
+    emscripten::val searchRange(const std::vector<float>& vec, float radius, uint32_t maxResults, emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      if (vec.size() != dim_) {
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+          std::to_string(vec.size()) + ").");
+      }
+
+      if (maxResults <= 0) {
+        throw std::invalid_argument("Invalid the maximum number of results (must be a positive number).");
+      }
+
+      std::unique_ptr<CustomFilterFunctor> filterFnCpp;
+      if (!js_filterFn.isNull() && !js_filterFn.isUndefined()) {
+        filterFnCpp.reset(new CustomFilterFunctor(js_filterFn));
+      }
+
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
+
+      return internal::rangeResultsToObject(
+        index_->searchRange(mutableVec.data(), radius, static_cast<size_t>(maxResults), filterFnCpp.get()));
+    }
+
+    emscripten::val searchKnnBatch(const std::vector<std::vector<float>>& vecs, uint32_t k, emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      if (k > index_->maxelements_) {
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (cannot be given a value greater than `maxElements`: " +
+          std::to_string(index_->maxelements_) + ").");
+      }
+      if (k <= 0) {
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+
+      std::vector<float> flatQueries;
+      flatQueries.reserve(vecs.size() * space_->get_data_size() / sizeof(float));
+      for (const auto& vec : vecs) {
+        if (vec.size() != dim_) {
+          throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+            std::to_string(vec.size()) + ").");
+        }
+        std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
+        flatQueries.insert(flatQueries.end(), mutableVec.begin(), mutableVec.end());
+      }
+
+      std::unique_ptr<CustomFilterFunctor> filterFnCpp;
+      if (!js_filterFn.isNull() && !js_filterFn.isUndefined()) {
+        filterFnCpp.reset(new CustomFilterFunctor(js_filterFn));
+      }
+
+      // the JS filter can only be called from the main thread
+      size_t numThreads = 1;
+#ifdef __EMSCRIPTEN_PTHREADS__
+      if (!filterFnCpp) numThreads = std::max(1u, std::thread::hardware_concurrency());
+#endif
+
+      auto knns = index_->searchKnnBatch(flatQueries.data(), vecs.size(), static_cast<size_t>(k), filterFnCpp.get(), numThreads);
+
+      emscripten::val results = emscripten::val::array();
+      for (size_t q = 0; q < knns.size(); q++) {
+        auto& knn = knns[q];
+        const size_t n_results = knn.size();
+        emscripten::val distances = emscripten::val::array();
+        emscripten::val neighbors = emscripten::val::array();
+        for (int32_t i = static_cast<int32_t>(n_results) - 1; i >= 0; i--) {
+          auto nn = knn.top();
+          distances.set(i, nn.first);
+          neighbors.set(i, static_cast<uint32_t>(nn.second));
+          knn.pop();
+        }
+        emscripten::val result = emscripten::val::object();
+        result.set("distances", distances);
+        result.set("neighbors", neighbors);
+        results.set(q, result);
+      }
+
+      return results;
+    }
+
     uint32_t getMaxElements() {
       if (index_ == nullptr) {
         throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
@@ -350,6 +654,218 @@ namespace emscripten {
   /***************** *****************/
   /***************** *****************/
 
+  /// @brief Dense set of labels with O(1) insert and erase, stored contiguously so it can be viewed as a typed array
+  class LabelSet {
+  public:
+    bool contains(uint32_t label) const {
+      return positions_.count(label) != 0;
+    }
+
+    bool insert(uint32_t label) {
+      if (positions_.count(label) != 0) return false;
+      positions_[label] = labels_.size();
+      labels_.push_back(label);
+      return true;
+    }
+
+    bool erase(uint32_t label) {
+      auto it = positions_.find(label);
+      if (it == positions_.end()) return false;
+      const size_t pos = it->second;
+      const uint32_t last = labels_.back();
+      labels_[pos] = last;
+      positions_[last] = pos;
+      labels_.pop_back();
+      positions_.erase(label);
+      return true;
+    }
+
+    void clear() {
+      labels_.clear();
+      positions_.clear();
+    }
+
+    size_t size() const { return labels_.size(); }
+
+    const std::vector<uint32_t>& values() const { return labels_; }
+
+  private:
+    std::vector<uint32_t> labels_;
+    hnswlib::FlatHashMap<uint32_t, size_t> positions_;
+  };
+
+  /// @brief Allows the labels allowed by the search filter, if any, that are live in the dense index, so that sparse
+  /// vectors of deleted labels, of labels removed by compact and of labels never added are not returned
+  class SparseFilterFunctor : public hnswlib::BaseFilterFunctor {
+  public:
+    SparseFilterFunctor(const LabelSet& used, hnswlib::BaseFilterFunctor* filter) : used_(used), filter_(filter) {}
+
+    bool operator()(hnswlib::labeltype id) override {
+      return used_.contains(static_cast<uint32_t>(id)) && (!filter_ || (*filter_)(id));
+    }
+
+  private:
+    const LabelSet& used_;
+    hnswlib::BaseFilterFunctor* filter_;
+  };
+
+  /// @brief Aggregates per-query search stats into totals and histograms with power-of-two buckets
+  class SearchStatsRecorder {
+  public:
+    static const size_t NUM_BUCKETS = 32;
+
+    void record(const hnswlib::SearchStats& stats, double elapsedMs) {
+      queries_++;
+      hops_ += stats.hops;
+      distanceComputations_ += stats.distance_computations;
+      visited_ += stats.visited;
+      filterRejections_ += stats.filter_rejections;
+      deletedSkips_ += stats.deleted_skips;
+      stoppedEarly_ += stats.stopped_early ? 1 : 0;
+      elapsedMs_ += elapsedMs;
+      maxElapsedMs_ = std::max(maxElapsedMs_, elapsedMs);
+      latencyHistogram_[bucketOf(static_cast<uint64_t>(elapsedMs * 1000.0))]++;
+      hopsHistogram_[bucketOf(stats.hops)]++;
+      distanceComputationsHistogram_[bucketOf(stats.distance_computations)]++;
+    }
+
+    void reset() {
+      *this = SearchStatsRecorder();
+    }
+
+    emscripten::val toObject() const {
+      emscripten::val result = emscripten::val::object();
+      result.set("queries", static_cast<double>(queries_));
+      result.set("hops", static_cast<double>(hops_));
+      result.set("distanceComputations", static_cast<double>(distanceComputations_));
+      result.set("visited", static_cast<double>(visited_));
+      result.set("filterRejections", static_cast<double>(filterRejections_));
+      result.set("deletedSkips", static_cast<double>(deletedSkips_));
+      result.set("stoppedEarly", static_cast<double>(stoppedEarly_));
+      result.set("elapsedMs", elapsedMs_);
+      result.set("maxElapsedMs", maxElapsedMs_);
+      result.set("latencyHistogram", histogramToArray(latencyHistogram_));
+      result.set("hopsHistogram", histogramToArray(hopsHistogram_));
+      result.set("distanceComputationsHistogram", histogramToArray(distanceComputationsHistogram_));
+      return result;
+    }
+
+  private:
+    /// @brief Bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i), the last bucket everything above
+    static size_t bucketOf(uint64_t value) {
+      size_t bucket = 0;
+      while (value > 0 && bucket < NUM_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+      }
+      return bucket;
+    }
+
+    static emscripten::val histogramToArray(const std::array<uint32_t, NUM_BUCKETS>& histogram) {
+      emscripten::val result = emscripten::val::array();
+      for (size_t i = 0; i < NUM_BUCKETS; i++) result.set(i, histogram[i]);
+      return result;
+    }
+
+    uint64_t queries_ = 0;
+    uint64_t hops_ = 0;
+    uint64_t distanceComputations_ = 0;
+    uint64_t visited_ = 0;
+    uint64_t filterRejections_ = 0;
+    uint64_t deletedSkips_ = 0;
+    uint64_t stoppedEarly_ = 0;
+    double elapsedMs_ = 0;
+    double maxElapsedMs_ = 0;
+    std::array<uint32_t, NUM_BUCKETS> latencyHistogram_{};
+    std::array<uint32_t, NUM_BUCKETS> hopsHistogram_{};
+    std::array<uint32_t, NUM_BUCKETS> distanceComputationsHistogram_{};
+  };
+
+  /// @brief Bounded LRU cache of searchKnn results. Every change of the index bumps the generation and empties the
+  /// cache, and results of searches that started before the last change are not inserted.
+  class QueryResultCache {
+  public:
+    struct Result {
+      std::vector<float> distances;
+      std::vector<uint32_t> neighbors;
+    };
+
+    /// @brief Sets the maximum number of cached results, 0 disables the cache
+    void setCapacity(size_t capacity) {
+      std::lock_guard<std::mutex> lock(lock_);
+      capacity_ = capacity;
+      while (entries_.size() > capacity_) evictLeastRecentlyUsed();
+    }
+
+    size_t capacity() const {
+      return capacity_;
+    }
+
+    uint64_t generation() {
+      std::lock_guard<std::mutex> lock(lock_);
+      return generation_;
+    }
+
+    bool lookup(const std::string& key, Result& result) {
+      std::lock_guard<std::mutex> lock(lock_);
+      auto found = positions_.find(key);
+      if (found == positions_.end()) {
+        misses_++;
+        return false;
+      }
+      entries_.splice(entries_.begin(), entries_, found->second);
+      result = found->second->second;
+      hits_++;
+      return true;
+    }
+
+    void insert(const std::string& key, Result result, uint64_t generation) {
+      std::lock_guard<std::mutex> lock(lock_);
+      if (capacity_ == 0 || generation != generation_ || positions_.count(key) != 0) return;
+      entries_.emplace_front(key, std::move(result));
+      positions_[key] = entries_.begin();
+      if (entries_.size() > capacity_) evictLeastRecentlyUsed();
+    }
+
+    void invalidate() {
+      std::lock_guard<std::mutex> lock(lock_);
+      generation_++;
+      entries_.clear();
+      positions_.clear();
+    }
+
+    emscripten::val statsToObject() {
+      std::lock_guard<std::mutex> lock(lock_);
+      emscripten::val result = emscripten::val::object();
+      result.set("hits", static_cast<double>(hits_));
+      result.set("misses", static_cast<double>(misses_));
+      result.set("entries", static_cast<double>(entries_.size()));
+      result.set("generation", static_cast<double>(generation_));
+      return result;
+    }
+
+    void resetStats() {
+      std::lock_guard<std::mutex> lock(lock_);
+      hits_ = 0;
+      misses_ = 0;
+    }
+
+  private:
+    void evictLeastRecentlyUsed() {
+      positions_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+    std::mutex lock_;
+    size_t capacity_ = 0;
+    uint64_t generation_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    /// @brief Most recently used first
+    std::list<std::pair<std::string, Result>> entries_;
+    std::unordered_map<std::string, std::list<std::pair<std::string, Result>>::iterator> positions_;
+  };
+
   class HierarchicalNSW {
   public:
     uint32_t dim_;
@@ -359,17 +875,33 @@ namespace emscripten {
     std::mutex mutate_lock_;
     /// @brief Lock for cache
     std::mutex label_cache_lock_;
-    /// @brief Cache for used labels populated from index_ by updateUsedLabelsCache()
-    bool updateCache_ = false;
-    std::vector<uint32_t> usedLabelsCache_;
-    /// @brief Cache for deleted labels populated from index_ by updateDeletedLabelsCache()
-    std::vector<uint32_t> deletedLabelsCache_;
+    /// @brief Used labels, kept up to date on every mutation
+    LabelSet usedLabelsCache_;
+    /// @brief Deleted labels, kept up to date on every mutation and used as the free-list by generateLabels()
+    LabelSet deletedLabelsCache_;
+    /// @brief Next label handed out by generateLabels(), greater than any label the index has had since it was
+    /// initialized, so that labels removed by compact are not handed out again. Saved with the extra sections.
+    uint64_t nextLabel_ = 0;
+    /// @brief Document of each chunk label, set with setDocumentIds, cleared when another index is initialized or read
+    DocumentMap documents_;
+    /// @brief Sparse vectors of the labels for searchSparse and hybridSearch, saved after the graph image
+    hnswlib::SparseIndex sparse_;
+    /// @brief Attributes of the labels that attribute predicates filter on, saved after the sparse vectors
+    hnswlib::AttributeStore attributes_;
+    /// @brief searchKnn results by query, k, ef and filter, disabled until setQueryCacheSize
+    QueryResultCache queryCache_;
+    /// @brief Whether searchKnn collects per-query stats and adds them to searchStats_
+    bool searchStatsEnabled_ = false;
+    SearchStatsRecorder searchStats_;
+    /// @brief The space of a cosine index, nullptr for other spaces and for cosine indexes saved by older versions
+    hnswlib::CosineSpace* cosine_;
+    /// @brief Whether points are normalized before they are stored, only for cosine indexes saved by older versions
     bool normalize_;
     std::string autoSaveFilename_ = "";
 
 
     HierarchicalNSW(const std::string& space_name, uint32_t dim)
-      : index_(nullptr), space_(nullptr), normalize_(false), dim_(dim) {
+      : index_(nullptr), space_(nullptr), cosine_(nullptr), normalize_(false), dim_(dim) {
       if (space_name == "l2") {
         space_ = new hnswlib::L2Space(static_cast<size_t>(dim_));
       }
@@ -377,8 +909,8 @@ namespace emscripten {
         space_ = new hnswlib::InnerProductSpace(static_cast<size_t>(dim_));
       }
       else if (space_name == "cosine") {
-        space_ = new hnswlib::InnerProductSpace(static_cast<size_t>(dim_));
-        normalize_ = true;
+        cosine_ = new hnswlib::CosineSpace(static_cast<size_t>(dim_));
+        space_ = cosine_;
       }
       else {
         printf("invalid space should be expected l2, ip, or cosine, name: %s\n", space_name.c_str());
@@ -401,18 +933,55 @@ namespace emscripten {
     }
 
 
+    /// @brief Cosine indexes store the inverse norm after each vector, the legacy ones saved by older versions
+    /// store normalized vectors and are searched with the inner product space. Only called without index_.
+    void useCosineSpace(bool legacy) {
+      if (space_) delete space_;
+      cosine_ = legacy ? nullptr : new hnswlib::CosineSpace(static_cast<size_t>(dim_));
+      space_ = legacy ? static_cast<hnswlib::SpaceInterface<float>*>(new hnswlib::InnerProductSpace(static_cast<size_t>(dim_))) : cosine_;
+      normalize_ = legacy;
+    }
+
     void initIndex(uint32_t max_elements, uint32_t m = 16, uint32_t ef_construction = 200, uint32_t random_seed = 100) {
       if (index_) delete index_;
+      if (normalize_) useCosineSpace(false);
 
       index_ = new hnswlib::HierarchicalNSW<float>(space_, max_elements, m, ef_construction, random_seed, true);
+      documents_.clear();
+      sparse_.clear();
+      attributes_.clear();
+      nextLabel_ = 0;
+      updateLabelCaches();
     }
 
     void readIndexFromBuffer(const std::vector<char>& buffer) {
       if (index_) delete index_;
+      index_ = nullptr;
+      documents_.clear();
+      sparse_.clear();
+      attributes_.clear();
+      nextLabel_ = 0;
 
       try {
+        std::vector<char> graphImage;
+        std::string extraSections;
+        bool hasNextLabel = false;
+        const bool hasExtras = internal::splitExtraSections(buffer, graphImage, extraSections, hasNextLabel);
+        const std::vector<char>& image = hasExtras ? graphImage : buffer;
+        if (normalize_) useCosineSpace(false);
+        // images saved before the cosine space stored the norm hold only dim floats per vector
+        if (cosine_ && hnswlib::HierarchicalNSW<float>::getStoredDataSize(image) == dim_ * sizeof(float)) useCosineSpace(true);
         index_ = new hnswlib::HierarchicalNSW<float>(space_);
-        index_->loadIndexFromBuffer(buffer, space_);
+        index_->loadIndexFromBuffer(image, space_);
+        if (hasExtras) {
+          std::istringstream input(extraSections);
+          sparse_.loadFromStream(input);
+          attributes_.loadFromStream(input);
+          if (hasNextLabel) {
+            input.read(reinterpret_cast<char*>(&nextLabel_), sizeof(nextLabel_));
+            if (!input) throw std::runtime_error("Index seems to be corrupted or unsupported");
+          }
+        }
         updateLabelCaches();
       }
       catch (const std::runtime_error& e) {
@@ -434,7 +1003,24 @@ namespace emscripten {
       if (index_ == nullptr) {
         throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
       }
-      return index_->saveIndexToBuffer();
+      std::vector<char> image = index_->saveIndexToBuffer();
+      // the next label only needs saving once compact has removed the largest labels
+      uint64_t labelsEnd = 0;
+      for (const auto& kv : index_->label_lookup_) {
+        labelsEnd = std::max<uint64_t>(labelsEnd, static_cast<uint64_t>(kv.first) + 1);
+      }
+      if (sparse_.getCurrentElementCount() == 0 && attributes_.getCurrentElementCount() == 0 && nextLabel_ <= labelsEnd) return image;
+
+      const uint64_t graphSize = image.size();
+      std::ostringstream output;
+      sparse_.saveToStream(output);
+      attributes_.saveToStream(output);
+      output.write(reinterpret_cast<const char*>(&nextLabel_), sizeof(nextLabel_));
+      const std::string extraSections = output.str();
+      image.insert(image.end(), extraSections.begin(), extraSections.end());
+      image.insert(image.end(), reinterpret_cast<const char*>(&graphSize), reinterpret_cast<const char*>(&graphSize) + sizeof(graphSize));
+      image.insert(image.end(), internal::EXTRA_SECTIONS_TAG, internal::EXTRA_SECTIONS_TAG + sizeof(internal::EXTRA_SECTIONS_TAG));
+      return image;
     }
 
     void resizeIndex(uint32_t new_max_elements) {
@@ -442,6 +1028,62 @@ namespace emscripten {
         throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
       }
       index_->resizeIndex(static_cast<size_t>(new_max_elements));
+      queryCache_.invalidate();
+    }
+
+    /// @brief Sets how a full index grows when more items are added
+    /// @param growth_factor the factor the capacity is multiplied by, or 0 to reject inserts into a full index
+    void setGrowthFactor(float growth_factor) {
+      if (index_ == nullptr) {
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (growth_factor != 0 && !(growth_factor > 1)) {
+        printf("Invalid growth factor. Must be 0 or greater than 1.\n");
+        throw std::invalid_argument("Invalid growth factor. Must be 0 or greater than 1.");
+      }
+      index_->setGrowthFactor(growth_factor);
+    }
+
+    float getGrowthFactor() {
+      if (index_ == nullptr) {
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      return index_->getGrowthFactor();
+    }
+
+    /// @brief Physically removes the elements marked as deleted and renumbers the remaining ones
+    /// @param shrink_to_fit true to also reduce maxElements to the number of remaining elements and release the memory
+    /// @return the number of bytes released, 0 without shrink_to_fit, a double so that it is not truncated in wasm64 builds
+    double compact(bool shrink_to_fit = true) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      std::vector<uint32_t> removedLabels;
+      {
+        std::lock_guard<std::mutex> cache_lock(label_cache_lock_);
+        removedLabels = deletedLabelsCache_.values();
+      }
+
+      try {
+        std::lock_guard<std::mutex> global_lock(index_->global);
+        const size_t reclaimed = index_->compact(shrink_to_fit);
+        // the labels are gone from the index, a label added later must not inherit their side data
+        for (const uint32_t label : removedLabels) {
+          documents_.erase(label);
+          sparse_.removePoint(static_cast<hnswlib::labeltype>(label));
+          attributes_.removeLabel(static_cast<hnswlib::labeltype>(label));
+        }
+        updateLabelCaches();
+        return static_cast<double>(reclaimed);
+      }
+      catch (const std::exception& e) {
+        printf("Could not compact %s\n", e.what());
+        throw std::runtime_error("Could not compact " + std::string(e.what()));
+      }
     }
 
 
@@ -464,84 +1106,87 @@ namespace emscripten {
 
     std::vector<uint32_t> getUsedLabels() {
       std::lock_guard<std::mutex> lock(label_cache_lock_);
-      if (updateCache_) {
-        updateLabelCaches();
-      }
-      return usedLabelsCache_;
+      return usedLabelsCache_.values();
     }
 
     std::vector<uint32_t> getDeletedLabels() {
       std::lock_guard<std::mutex> lock(label_cache_lock_);
-      if (updateCache_) {
-        updateLabelCaches();
-      }
-      return deletedLabelsCache_;
+      return deletedLabelsCache_.values();
+    }
+
+    /// @brief Uint32Array view of the used labels without copying, valid until the next call into the module,
+    /// since any allocation may grow the memory and detach it
+    emscripten::val getUsedLabelsView() {
+      std::lock_guard<std::mutex> lock(label_cache_lock_);
+      const std::vector<uint32_t>& labels = usedLabelsCache_.values();
+      return emscripten::val(emscripten::typed_memory_view(labels.size(), labels.data()));
+    }
+
+    /// @brief Uint32Array view of the deleted labels without copying, valid until the next call into the module,
+    /// since any allocation may grow the memory and detach it
+    emscripten::val getDeletedLabelsView() {
+      std::lock_guard<std::mutex> lock(label_cache_lock_);
+      const std::vector<uint32_t>& labels = deletedLabelsCache_.values();
+      return emscripten::val(emscripten::typed_memory_view(labels.size(), labels.data()));
     }
 
-    /// @brief Update local used and deleted labels cache
+    /// @brief Rebuild the used and deleted labels caches from index_, only needed when the index is replaced or compacted.
+    /// nextLabel_ only grows, it is reset by initIndex and readIndexFromBuffer.
     void updateLabelCaches() {
+      queryCache_.invalidate();
       std::lock_guard<std::mutex> lock(label_cache_lock_);
-      std::vector<uint32_t> usedLabels;
-      std::vector<uint32_t> deletedLabels;
-      std::unordered_map<hnswlib::tableint, hnswlib::labeltype> reverse_label_lookup;
-      updateCache_ = false;
+      usedLabelsCache_.clear();
+      deletedLabelsCache_.clear();
+      if (index_ == nullptr) return;
 
       for (const auto& kv : index_->label_lookup_) {
-        reverse_label_lookup[kv.second] = kv.first;
-        if (index_->deleted_elements.find(kv.second) == index_->deleted_elements.end()) {
-          usedLabels.push_back(static_cast<uint32_t>(kv.first));
+        const uint32_t label = static_cast<uint32_t>(kv.first);
+        if (index_->isMarkedDeleted(kv.second)) {
+          deletedLabelsCache_.insert(label);
         }
-      }
-
-      for (const auto& element : index_->deleted_elements) {
-        auto it = reverse_label_lookup.find(element);
-        if (it != reverse_label_lookup.end()) {
-          deletedLabels.push_back(static_cast<uint32_t>(it->second));
+        else {
+          usedLabelsCache_.insert(label);
         }
+        nextLabel_ = std::max<uint64_t>(nextLabel_, static_cast<uint64_t>(label) + 1);
       }
-
-      usedLabelsCache_ = std::move(usedLabels);
-      deletedLabelsCache_ = std::move(deletedLabels);
     }
 
+    /// @brief Add one point to index_ and record the label changes in the label caches
+    void addPointAndTrackLabel(const std::vector<float>& vec, uint32_t label, bool replace_deleted) {
+      hnswlib::labeltype replaced_label;
+      const bool replaced = index_->addPoint(reinterpret_cast<const void*>(vec.data()), static_cast<hnswlib::labeltype>(label), replace_deleted, &replaced_label);
+      queryCache_.invalidate();
 
-
+      std::lock_guard<std::mutex> lock(label_cache_lock_);
+      if (replaced) {
+        deletedLabelsCache_.erase(static_cast<uint32_t>(replaced_label));
+      }
+      deletedLabelsCache_.erase(label);
+      usedLabelsCache_.insert(label);
+      nextLabel_ = std::max<uint64_t>(nextLabel_, static_cast<uint64_t>(label) + 1);
+    }
 
     /// @brief Create labels based on the current used labels and labels marked deleted
     /// @param size input array size
     /// @param replace_deleted true if we want to reuse deleted labels
     /// @return 
     std::vector<uint32_t> generateLabels(size_t size, bool replace_deleted) {
+      std::lock_guard<std::mutex> lock(label_cache_lock_);
       std::vector<uint32_t> labels;
+      labels.reserve(size);
 
-      {
-        std::lock_guard<std::mutex> guard1(index_->label_lookup_lock);
-        std::lock_guard<std::mutex> guard2(index_->deleted_elements_lock);
-
-        // Determine the current maxLabel, its incremented later before use
-        int64_t maxLabel = -1;
-        for (const auto& pair : index_->label_lookup_) {
-          if (pair.first > maxLabel) {
-            maxLabel = pair.first;
-          }
-        }
-
-        if (replace_deleted) {
-          // Fill with deleted labels first
-          for (const auto& pair : index_->label_lookup_) {
-            if (index_->deleted_elements.find(pair.second) != index_->deleted_elements.end()) {
-              labels.push_back(static_cast<uint32_t>(pair.first));
-              if (labels.size() == size) {
-                return labels;
-              }
-            }
-          }
+      if (replace_deleted) {
+        // Fill with deleted labels first, taken from the back so that removing them later is O(1)
+        const std::vector<uint32_t>& deletedLabels = deletedLabelsCache_.values();
+        for (auto it = deletedLabels.rbegin(); it != deletedLabels.rend() && labels.size() < size; ++it) {
+          labels.push_back(*it);
         }
+      }
 
-        // If not enough deleted labels or replace_deleted is false, generate new ones
-        while (labels.size() < size) {
-          labels.push_back(static_cast<uint32_t>(++maxLabel));
-        }
+      // If not enough deleted labels or replace_deleted is false, generate new ones
+      uint64_t nextLabel = nextLabel_;
+      while (labels.size() < size) {
+        labels.push_back(static_cast<uint32_t>(nextLabel++));
       }
 
       return labels;
@@ -560,38 +1205,32 @@ namespace emscripten {
         throw std::runtime_error("The number of vectors and ids must be greater than 0.");
       }
 
-      if (index_->cur_element_count + vec.size() > index_->max_elements_) {
+      if (!index_->reserveForInsert(vec.size())) {
         printf("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: %zu\n", index_->max_elements_);
         throw std::runtime_error("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: " + std::to_string(index_->max_elements_));
       }
 
-      {
-        std::lock_guard<std::mutex> lock(index_->global);
-        // Generate labels for the vectors to be added
-        std::vector<uint32_t> labels = generateLabels(vec.size(), replace_deleted);
-
-        try {
-          for (size_t i = 0; i < vec.size(); ++i) {
-            if (vec[i].size() != dim_) {
-              printf("Invalid vector size at index %zu. Must be equal to the dimension of the space. The dimension of the space is %d.\n", i, dim_);
-              throw std::invalid_argument("Invalid vector size at index " + std::to_string(i) + ". Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
-            }
+      // only mutate_lock_ is held for the batch: addPoint takes the index locks it needs per point,
+      // and searches with lock-free search enabled keep running meanwhile
+      // Generate labels for the vectors to be added
+      std::vector<uint32_t> labels = generateLabels(vec.size(), replace_deleted);
 
-            std::vector<float> mutableVec = vec[i];
+      try {
+        for (size_t i = 0; i < vec.size(); ++i) {
+          if (vec[i].size() != dim_) {
+            printf("Invalid vector size at index %zu. Must be equal to the dimension of the space. The dimension of the space is %d.\n", i, dim_);
+            throw std::invalid_argument("Invalid vector size at index " + std::to_string(i) + ". Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
+          }
 
-            if (normalize_) {
-              internal::normalizePoints(mutableVec);
-            }
+          std::vector<float> mutableVec = internal::preparePoint(vec[i], cosine_, normalize_);
 
-            index_->addPoint(reinterpret_cast<void*>(mutableVec.data()), static_cast<hnswlib::labeltype>(labels[i]), replace_deleted);
-          }
-          updateCache_ = true;
-          return labels;
-        }
-        catch (const std::exception& e) {
-          printf("Could not addItems %s\n", e.what());
-          throw std::runtime_error("Could not addItems " + std::string(e.what()));
+          addPointAndTrackLabel(mutableVec, labels[i], replace_deleted);
         }
+        return labels;
+      }
+      catch (const std::exception& e) {
+        printf("Could not addItems %s\n", e.what());
+        throw std::runtime_error("Could not addItems " + std::string(e.what()));
       }
     }
 
@@ -608,20 +1247,15 @@ namespace emscripten {
         throw std::invalid_argument("Invalid vector size. Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
       }
 
-      std::vector<float> mutableVec = vec;
-
-      if (normalize_) {
-        internal::normalizePoints(mutableVec);
-      }
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
 
-      if (index_->cur_element_count == index_->max_elements_) {
+      if (!index_->reserveForInsert(1)) {
         printf("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: %zu\n", index_->max_elements_);
         throw std::runtime_error("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: " + std::to_string(index_->max_elements_));
       }
 
       try {
-        index_->addPoint(reinterpret_cast<void*>(mutableVec.data()), static_cast<hnswlib::labeltype>(idx), replace_deleted);
-        updateCache_ = true;
+        addPointAndTrackLabel(mutableVec, idx, replace_deleted);
       }
       catch (const std::exception& e) {
         printf("HNSWLIB ERROR: %s\n", e.what());
@@ -650,7 +1284,7 @@ namespace emscripten {
         throw std::runtime_error("The number of vectors and ids must be greater than 0.");
       }
 
-      if (index_->cur_element_count + idVec.size() > index_->max_elements_) {
+      if (!index_->reserveForInsert(idVec.size())) {
         printf("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: %zu\n", index_->max_elements_);
         throw std::runtime_error("The maximum number of elements has been reached in index, please increased the index max_size.  max_size: " + std::to_string(index_->max_elements_));
       }
@@ -662,21 +1296,140 @@ namespace emscripten {
             throw std::invalid_argument("Invalid vector size at index " + std::to_string(i) + ". Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
           }
 
-          std::vector<float> mutableVec = vec[i];
-
-          if (normalize_) {
-            internal::normalizePoints(mutableVec);
-          }
+          std::vector<float> mutableVec = internal::preparePoint(vec[i], cosine_, normalize_);
 
-          index_->addPoint(reinterpret_cast<void*>(mutableVec.data()), static_cast<hnswlib::labeltype>(idVec[i]), replace_deleted);
+          addPointAndTrackLabel(mutableVec, idVec[i], replace_deleted);
         }
-        updateCache_ = true;
       }
       catch (const std::exception& e) {
         throw std::runtime_error("Could not addPoints " + std::string(e.what()));
       }
     }
 
+    /// @brief Checks a batch of points stored back to back and converts them to the layout the index stores
+    /// @param flat_vectors the points, count * dim values
+    /// @param count the number of points
+    /// @return the points to pass to the index
+    std::vector<float> prepareFlatBatch(const std::vector<float>& flat_vectors, size_t count) {
+      if (count <= 0) {
+        printf("The number of vectors and ids must be greater than 0.\n");
+        throw std::runtime_error("The number of vectors and ids must be greater than 0.");
+      }
+
+      if (flat_vectors.size() != count * dim_) {
+        printf("Invalid the given array length (expected %zu, but got %zu).\n", count * dim_, flat_vectors.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(count * dim_) + ", but got " +
+          std::to_string(flat_vectors.size()) + ").");
+      }
+
+      if (cosine_) {
+        std::vector<float> points(count * (dim_ + 1));
+        for (size_t i = 0; i < count; ++i) {
+          cosine_->preparePoint(flat_vectors.data() + i * dim_, points.data() + i * (dim_ + 1));
+        }
+        return points;
+      }
+
+      std::vector<float> points = flat_vectors;
+      if (normalize_) {
+        for (size_t i = 0; i < count; ++i) {
+          internal::normalizePointsPtrs(points.data() + i * dim_, dim_);
+        }
+      }
+      return points;
+    }
+
+    /// @brief Bulk-loads an empty index, faster than adding the points one by one
+    /// @param flat_vectors the points stored back to back, labels.size() * dim values
+    /// @param labels the label of each point
+    void buildFromBatch(const std::vector<float>& flat_vectors, const std::vector<uint32_t>& labels) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      const std::vector<float> points = prepareFlatBatch(flat_vectors, labels.size());
+      const std::vector<hnswlib::labeltype> indexLabels(labels.begin(), labels.end());
+
+      size_t numThreads = 1;
+#ifdef __EMSCRIPTEN_PTHREADS__
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+#endif
+
+      try {
+        index_->buildFromBatch(points.data(), indexLabels.data(), labels.size(), numThreads);
+      }
+      catch (const std::exception& e) {
+        printf("Could not buildFromBatch %s\n", e.what());
+        throw std::runtime_error("Could not buildFromBatch " + std::string(e.what()));
+      }
+      updateLabelCaches();
+    }
+
+    /// @brief Replaces the vectors of existing points, repairing the graph around them once per batch
+    /// @param labels the label of each point, all in the index and not deleted
+    /// @param flat_vectors the new vectors stored back to back, labels.size() * dim values
+    /// @param repair_probability the probability that a neighbor of an updated point gets its links repaired
+    void updateItems(const std::vector<uint32_t>& labels, const std::vector<float>& flat_vectors, float repair_probability) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (repair_probability < 0 || repair_probability > 1) {
+        printf("Invalid the repair probability (must be in the range [0, 1]).\n");
+        throw std::invalid_argument("Invalid the repair probability (must be in the range [0, 1]).");
+      }
+
+      const std::vector<float> points = prepareFlatBatch(flat_vectors, labels.size());
+      const std::vector<hnswlib::labeltype> indexLabels(labels.begin(), labels.end());
+
+      size_t numThreads = 1;
+#ifdef __EMSCRIPTEN_PTHREADS__
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+#endif
+
+      try {
+        index_->updatePoints(points.data(), indexLabels.data(), labels.size(), repair_probability, numThreads);
+        queryCache_.invalidate();
+      }
+      catch (const std::exception& e) {
+        printf("Could not updateItems %s\n", e.what());
+        throw std::runtime_error("Could not updateItems " + std::string(e.what()));
+      }
+    }
+
+    /// @brief Builds an empty index offline: every layer is linked from an approximate kNN graph computed with NN-Descent
+    /// @param flat_vectors the points stored back to back, labels.size() * dim values
+    /// @param labels the label of each point, all different
+    /// @param max_iterations the maximum number of NN-Descent iterations
+    void buildOffline(const std::vector<float>& flat_vectors, const std::vector<uint32_t>& labels, uint32_t max_iterations) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      const std::vector<float> points = prepareFlatBatch(flat_vectors, labels.size());
+      const std::vector<hnswlib::labeltype> indexLabels(labels.begin(), labels.end());
+
+      size_t numThreads = 1;
+#ifdef __EMSCRIPTEN_PTHREADS__
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+#endif
+
+      try {
+        hnswlib::NNDescentBuilder<float> builder(0, static_cast<size_t>(max_iterations));
+        builder.build(*index_, points.data(), indexLabels.data(), labels.size(), numThreads);
+      }
+      catch (const std::exception& e) {
+        printf("Could not buildOffline %s\n", e.what());
+        throw std::runtime_error("Could not buildOffline " + std::string(e.what()));
+      }
+      updateLabelCaches();
+    }
+
 
 
     int getMaxElements() {
@@ -694,7 +1447,9 @@ namespace emscripten {
         throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
       }
       index_->markDelete(static_cast<hnswlib::labeltype>(idx));
-      updateLabelCaches();
+      queryCache_.invalidate();
+      usedLabelsCache_.erase(idx);
+      deletedLabelsCache_.insert(idx);
     }
 
     void markDeleteItems(const std::vector<uint32_t>& labelsVec) {
@@ -705,10 +1460,12 @@ namespace emscripten {
       }
 
       try {
-        for (const hnswlib::labeltype& label : labelsVec) {
+        for (const uint32_t label : labelsVec) {
           index_->markDelete(static_cast<hnswlib::labeltype>(label));
+          queryCache_.invalidate();
+          usedLabelsCache_.erase(label);
+          deletedLabelsCache_.insert(label);
         }
-        updateLabelCaches();
       }
       catch (const std::exception& e) {
         printf("Could not markDeleteItems %s\n", e.what());
@@ -724,7 +1481,9 @@ namespace emscripten {
         throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
       }
       index_->unmarkDelete(static_cast<hnswlib::labeltype>(idx));
-      updateLabelCaches();
+      queryCache_.invalidate();
+      deletedLabelsCache_.erase(idx);
+      usedLabelsCache_.insert(idx);
     }
 
     emscripten::val searchKnn(const std::vector<float>& vec, uint32_t k, emscripten::val js_filterFn = emscripten::val::undefined()) {
@@ -749,40 +1508,559 @@ namespace emscripten {
         throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
       }
 
-      CustomFilterFunctor* filterFnCpp = nullptr;
-      if (!js_filterFn.isNull() && !js_filterFn.isUndefined()) {
-        filterFnCpp = new CustomFilterFunctor(js_filterFn);
-      }
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
 
+      // the stats describe the searches run, so the cache is bypassed while they are collected
+      std::string cacheKey;
+      const bool cacheable = queryCache_.capacity() > 0 && !searchStatsEnabled_ && queryCacheKey(mutableVec, k, js_filterFn, cacheKey);
+      QueryResultCache::Result found;
+      if (cacheable && queryCache_.lookup(cacheKey, found)) return knnResultsToObject(found);
+      const uint64_t generation = cacheable ? queryCache_.generation() : 0;
 
-      std::vector<float> mutableVec = vec;
-      if (normalize_) {
-        internal::normalizePoints(mutableVec);
-      }
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilter(js_filterFn);
 
+      hnswlib::SearchStats stats;
+      const auto start = std::chrono::steady_clock::now();
       std::priority_queue<std::pair<float, size_t>> knn =
-        index_->searchKnn(reinterpret_cast<void*>(mutableVec.data()), static_cast<size_t>(k), filterFnCpp);
+        index_->searchKnn(reinterpret_cast<void*>(mutableVec.data()), static_cast<size_t>(k), filterFnCpp.get(),
+          searchStatsEnabled_ ? &stats : nullptr);
+      const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
       const size_t n_results = knn.size();
-      emscripten::val distances = emscripten::val::array();
-      emscripten::val neighbors = emscripten::val::array();
+      found.distances.resize(n_results);
+      found.neighbors.resize(n_results);
 
       // Reverse the loop order
       for (int32_t i = static_cast<int32_t>(n_results) - 1; i >= 0; i--) {
         auto nn = knn.top();
-        distances.set(i, nn.first);
-        neighbors.set(i, nn.second);
+        found.distances[i] = nn.first;
+        found.neighbors[i] = static_cast<uint32_t>(nn.second);
         knn.pop();
       }
 
-      if (filterFnCpp) delete filterFnCpp;
+      emscripten::val results = knnResultsToObject(found);
+      if (cacheable) queryCache_.insert(cacheKey, std::move(found), generation);
+
+      if (searchStatsEnabled_) {
+        searchStats_.record(stats, elapsedMs);
+        emscripten::val levelHops = emscripten::val::array();
+        for (size_t i = 0; i < stats.level_hops.size(); i++) levelHops.set(i, static_cast<double>(stats.level_hops[i]));
+        emscripten::val queryStats = emscripten::val::object();
+        queryStats.set("ef", static_cast<double>(stats.ef));
+        queryStats.set("hops", static_cast<double>(stats.hops));
+        queryStats.set("levelHops", levelHops);
+        queryStats.set("distanceComputations", static_cast<double>(stats.distance_computations));
+        queryStats.set("visited", static_cast<double>(stats.visited));
+        queryStats.set("filterRejections", static_cast<double>(stats.filter_rejections));
+        queryStats.set("deletedSkips", static_cast<double>(stats.deleted_skips));
+        queryStats.set("stoppedEarly", stats.stopped_early);
+        queryStats.set("elapsedMs", elapsedMs);
+        results.set("stats", queryStats);
+      }
 
+      return results;
+    }
+
+    /// @brief Converts searchKnn results into a {distances: number[], neighbors: number[]} object
+    static emscripten::val knnResultsToObject(const QueryResultCache::Result& found) {
+      emscripten::val distances = emscripten::val::array();
+      emscripten::val neighbors = emscripten::val::array();
+      for (size_t i = 0; i < found.neighbors.size(); i++) {
+        distances.set(i, found.distances[i]);
+        neighbors.set(i, found.neighbors[i]);
+      }
       emscripten::val results = emscripten::val::object();
       results.set("distances", distances);
       results.set("neighbors", neighbors);
-
       return results;
     }
 
+    /// @brief The queryCache_ key of a searchKnn call: the prepared query bytes, k, ef and the filter, given as the
+    /// allowed labels or the canonical predicate. False for filter functions, whose results cannot be cached.
+    bool queryCacheKey(const std::vector<float>& query, uint32_t k, emscripten::val js_filter, std::string& key) {
+      const bool hasFilter = !js_filter.isNull() && !js_filter.isUndefined();
+      if (hasFilter && js_filter.typeOf().as<std::string>() == "function") return false;
+      const uint32_t ef = static_cast<uint32_t>(index_->ef_);
+      key.assign(reinterpret_cast<const char*>(query.data()), query.size() * sizeof(float));
+      key.append(reinterpret_cast<const char*>(&k), sizeof(k));
+      key.append(reinterpret_cast<const char*>(&ef), sizeof(ef));
+      if (!hasFilter) return true;
+      if (js_filter.isArray() || js_filter.instanceof(emscripten::val::global("Uint32Array"))) {
+        const std::vector<uint32_t> labels = emscripten::convertJSArrayToNumberVector<uint32_t>(js_filter);
+        key.push_back('L');
+        key.append(reinterpret_cast<const char*>(labels.data()), labels.size() * sizeof(uint32_t));
+      } else {
+        key.push_back('P');
+        key.append(parseAttributePredicate(js_filter).key());
+      }
+      return true;
+    }
+
+    /// @brief Caches up to capacity searchKnn results, the least recently used are dropped first; 0 disables the cache
+    void setQueryCacheSize(uint32_t capacity) {
+      queryCache_.setCapacity(capacity);
+    }
+
+    uint32_t getQueryCacheSize() const {
+      return static_cast<uint32_t>(queryCache_.capacity());
+    }
+
+    /// @brief Returns {hits, misses, entries, generation}, the generation counting the changes of the index
+    emscripten::val getQueryCacheStats() {
+      return queryCache_.statsToObject();
+    }
+
+    void resetQueryCacheStats() {
+      queryCache_.resetStats();
+    }
+
+    emscripten::val searchRange(const std::vector<float>& vec, float radius, uint32_t maxResults, emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      if (vec.size() != dim_) {
+        printf("Invalid the given array length (expected %lu, but got %zu).\n", static_cast<unsigned long>(dim_), vec.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+          std::to_string(vec.size()) + ").");
+      }
+
+      if (maxResults <= 0) {
+        printf("Invalid the maximum number of results (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the maximum number of results (must be a positive number).");
+      }
+
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilter(js_filterFn);
+
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
+
+      return internal::rangeResultsToObject(
+        index_->searchRange(mutableVec.data(), radius, static_cast<size_t>(maxResults), filterFnCpp.get()));
+    }
+
+    /// @brief Returns k of the fetchK nearest neighbors picked by maximal marginal relevance, in the order picked
+    /// @param vec the query vector
+    /// @param k the number of results
+    /// @param fetchK the number of nearest neighbors to pick from
+    /// @param lambda the weight of the relevance to the query against the diversity of the results, in [0, 1]
+    /// @param js_filterFn the labels to consider, or undefined
+    emscripten::val searchKnnDiverse(const std::vector<float>& vec, uint32_t k, uint32_t fetchK, float lambda,
+                                     emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+
+      if (vec.size() != dim_) {
+        printf("Invalid the given array length (expected %lu, but got %zu).\n", static_cast<unsigned long>(dim_), vec.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+          std::to_string(vec.size()) + ").");
+      }
+
+      if (k <= 0) {
+        printf("Invalid the number of k-nearest neighbors (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+      if (fetchK > index_->max_elements_) {
+        printf("Invalid the number of candidates (cannot be given a value greater than `maxElements`: %zu).\n", index_->max_elements_);
+        throw std::invalid_argument("Invalid the number of candidates (cannot be given a value greater than `maxElements`: " +
+          std::to_string(index_->max_elements_) + ").");
+      }
+      if (!(lambda >= 0.0f && lambda <= 1.0f)) {
+        printf("Invalid the relevance weight (must be in the range [0, 1]).\n");
+        throw std::invalid_argument("Invalid the relevance weight (must be in the range [0, 1]).");
+      }
+
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilter(js_filterFn);
+
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
+
+      return internal::rangeResultsToObject(index_->searchKnnDiverse(mutableVec.data(), static_cast<size_t>(k),
+        static_cast<size_t>(fetchK), lambda, filterFnCpp.get()));
+    }
+
+    /// @brief Assigns chunk labels to documents for searchDocuments, a label belongs to at most one document
+    /// @param labels the chunk labels
+    /// @param documentIds the document of each label
+    void setDocumentIds(const std::vector<uint32_t>& labels, const std::vector<uint32_t>& documentIds) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (labels.size() != documentIds.size()) {
+        printf("Invalid the given array length (expected %zu, but got %zu).\n", labels.size(), documentIds.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(labels.size()) + ", but got " +
+          std::to_string(documentIds.size()) + ").");
+      }
+      for (size_t i = 0; i < labels.size(); i++) {
+        documents_.set(labels[i], documentIds[i]);
+      }
+    }
+
+    /// @return the document of the label, or undefined if it has none
+    emscripten::val getDocumentId(uint32_t label) const {
+      const int64_t document = documents_.documentOf(label);
+      return document < 0 ? emscripten::val::undefined() : emscripten::val(static_cast<uint32_t>(document));
+    }
+
+    /// @brief Distance from a query in the stored layout to the point of a label
+    /// @return false if the label is not in the index or marked as deleted
+    bool distanceToLabel(const float* query, uint32_t label, float& distance) const {
+      hnswlib::tableint internalId;
+      {
+        std::unique_lock<std::mutex> lock(index_->label_lookup_lock);
+        auto found = index_->label_lookup_.find(label);
+        if (found == index_->label_lookup_.end()) return false;
+        internalId = found->second;
+      }
+      if (index_->isMarkedDeleted(internalId)) return false;
+      distance = index_->fstdistfunc_(query, index_->getDataByInternalId(internalId), index_->dist_func_param_);
+      return true;
+    }
+
+    /// @brief Searches for the documents closest to the query, searching until kDocs distinct documents are found
+    /// @param queries the query vectors, several only for maxsim
+    /// @param kDocs the number of documents
+    /// @param aggregation how the chunk similarities make a document score: max, sum of the topN best chunks, or
+    /// maxsim, the sum over the query vectors of their best chunk, computed exactly for the documents found
+    /// @param topN the number of chunks summed by sum
+    emscripten::val searchDocuments(const std::vector<std::vector<float>>& queries, uint32_t kDocs, const std::string& aggregation, uint32_t topN) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (queries.empty()) {
+        printf("The number of query vectors must be greater than 0.\n");
+        throw std::invalid_argument("The number of query vectors must be greater than 0.");
+      }
+      for (const auto& query : queries) {
+        if (query.size() != dim_) {
+          printf("Invalid the given array length (expected %lu, but got %zu).\n", static_cast<unsigned long>(dim_), query.size());
+          throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+            std::to_string(query.size()) + ").");
+        }
+      }
+      if (kDocs <= 0) {
+        printf("Invalid the number of documents (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of documents (must be a positive number).");
+      }
+      if (aggregation != "max" && aggregation != "sum" && aggregation != "maxsim") {
+        printf("invalid aggregation should be expected max, sum, or maxsim, name: %s\n", aggregation.c_str());
+        throw std::invalid_argument("invalid aggregation should be expected max, sum, or maxsim, name: " + aggregation);
+      }
+      if (aggregation != "maxsim" && queries.size() != 1) {
+        printf("Invalid the number of query vectors (only maxsim accepts more than one).\n");
+        throw std::invalid_argument("Invalid the number of query vectors (only maxsim accepts more than one).");
+      }
+      if (aggregation == "sum" && topN <= 0) {
+        printf("Invalid the number of chunks per document (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of chunks per document (must be a positive number).");
+      }
+
+      // scores are non-negative similarities, higher is closer, so summing more close chunks never lowers a score:
+      // 1 / (1 + d) for l2, (1 + cos) / 2 for cosine, and the logistic of the inner product for ip
+      const bool l2 = dynamic_cast<hnswlib::L2Space*>(space_) != nullptr;
+      const bool cosine = cosine_ != nullptr || normalize_;
+      auto similarity = [l2, cosine](float distance) {
+        if (l2) return 1.0f / (1.0f + std::max(distance, 0.0f));
+        if (cosine) return std::min(std::max(1.0f - 0.5f * distance, 0.0f), 1.0f);
+        return 1.0f / (1.0f + std::exp(distance - 1.0f));
+      };
+      DocumentFilterFunctor filter(documents_);
+      std::vector<std::pair<float, uint32_t>> scored;
+
+      if (aggregation == "maxsim") {
+        std::vector<std::vector<float>> prepared;
+        std::unordered_set<uint32_t> candidates;
+        for (const auto& query : queries) {
+          prepared.push_back(internal::preparePoint(query, cosine_, normalize_));
+          for (const auto& group : index_->searchKnnGrouped(prepared.back().data(), kDocs, 1, documents_, &filter)) {
+            candidates.insert(static_cast<uint32_t>(group.first));
+          }
+        }
+        for (uint32_t document : candidates) {
+          float score = 0;
+          bool live = false;
+          for (const auto& query : prepared) {
+            float best = 0;
+            for (uint32_t label : documents_.labelsOf(document)) {
+              float distance;
+              if (distanceToLabel(query.data(), label, distance)) {
+                best = std::max(best, similarity(distance));
+                live = true;
+              }
+            }
+            score += best;
+          }
+          if (live) scored.emplace_back(score, document);
+        }
+      }
+      else {
+        std::vector<float> prepared = internal::preparePoint(queries[0], cosine_, normalize_);
+        const size_t groupSize = aggregation == "sum" ? static_cast<size_t>(topN) : 1;
+        for (const auto& group : index_->searchKnnGrouped(prepared.data(), kDocs, groupSize, documents_, &filter)) {
+          float score = 0;
+          for (const auto& member : group.second) {
+            score += similarity(member.first);
+          }
+          scored.emplace_back(score, static_cast<uint32_t>(group.first));
+        }
+      }
+
+      std::stable_sort(scored.begin(), scored.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+        return a.first > b.first;
+      });
+      scored.resize(std::min(scored.size(), static_cast<size_t>(kDocs)));
+      return internal::scoredResultsToObject(scored, "documents");
+    }
+
+    /// @brief Sparse search over the labels allowed by the filter and live in the dense index
+    std::vector<std::pair<float, hnswlib::labeltype>> sparseSearch(const std::vector<uint32_t>& terms, const std::vector<float>& weights,
+                                                                   size_t k, hnswlib::BaseFilterFunctor* filter) {
+      std::lock_guard<std::mutex> lock(label_cache_lock_);
+      SparseFilterFunctor allowed(usedLabelsCache_, filter);
+      try {
+        return sparse_.searchKnn(terms.data(), weights.data(), terms.size(), k, &allowed);
+      }
+      catch (const std::runtime_error& e) {
+        printf("Could not searchSparse: %s\n", e.what());
+        throw std::runtime_error("Could not searchSparse: " + std::string(e.what()));
+      }
+    }
+
+    /// @brief Sets the sparse vector of a label, e.g. its BM25 term weights, replacing the one it had
+    /// @param terms the term ids
+    /// @param weights the weight of each term, non-negative
+    /// @param label the label, shared with the dense vectors
+    void addSparsePoint(const std::vector<uint32_t>& terms, const std::vector<float>& weights, uint32_t label) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (terms.size() != weights.size()) {
+        printf("Invalid the given array length (expected %zu, but got %zu).\n", terms.size(), weights.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(terms.size()) + ", but got " +
+          std::to_string(weights.size()) + ").");
+      }
+      try {
+        sparse_.addPoint(terms.data(), weights.data(), terms.size(), static_cast<hnswlib::labeltype>(label));
+      }
+      catch (const std::exception& e) {
+        printf("Could not addSparsePoint: %s\n", e.what());
+        throw std::runtime_error("Could not addSparsePoint: " + std::string(e.what()));
+      }
+    }
+
+    /// @brief Removes the sparse vector of a label, returns false if it has none
+    bool removeSparsePoint(uint32_t label) {
+      return sparse_.removePoint(static_cast<hnswlib::labeltype>(label));
+    }
+
+    uint32_t getSparseCount() const {
+      return static_cast<uint32_t>(sparse_.getCurrentElementCount());
+    }
+
+    /// @brief Returns the k labels with the highest sparse scores, the sum of query weight * point weight over the shared terms
+    emscripten::val searchSparse(const std::vector<uint32_t>& terms, const std::vector<float>& weights, uint32_t k,
+                                 emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (terms.size() != weights.size()) {
+        printf("Invalid the given array length (expected %zu, but got %zu).\n", terms.size(), weights.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(terms.size()) + ", but got " +
+          std::to_string(weights.size()) + ").");
+      }
+      if (k <= 0) {
+        printf("Invalid the number of k-nearest neighbors (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilter(js_filterFn);
+      std::vector<std::pair<float, uint32_t>> scored;
+      for (const auto& hit : sparseSearch(terms, weights, k, filterFnCpp.get()))
+        scored.emplace_back(hit.first, static_cast<uint32_t>(hit.second));
+      return internal::scoredResultsToObject(scored, "neighbors");
+    }
+
+    /// @brief Searches the dense and the sparse vectors and fuses both rankings natively
+    /// @param vec the dense query vector
+    /// @param terms the sparse query term ids
+    /// @param weights the sparse query term weights
+    /// @param k the number of results
+    /// @param fusion rrf: reciprocal rank fusion, weighted: weighted sum of the min-max normalized scores
+    /// @param denseWeight the weight of the dense ranking in [0, 1], the sparse ranking gets the rest
+    /// @param js_filterFn the labels to consider, or undefined
+    emscripten::val hybridSearch(const std::vector<float>& vec, const std::vector<uint32_t>& terms, const std::vector<float>& weights,
+                                 uint32_t k, const std::string& fusion, float denseWeight,
+                                 emscripten::val js_filterFn = emscripten::val::undefined()) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (vec.size() != dim_) {
+        printf("Invalid the given array length (expected %lu, but got %zu).\n", static_cast<unsigned long>(dim_), vec.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+          std::to_string(vec.size()) + ").");
+      }
+      if (terms.size() != weights.size()) {
+        printf("Invalid the given array length (expected %zu, but got %zu).\n", terms.size(), weights.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(terms.size()) + ", but got " +
+          std::to_string(weights.size()) + ").");
+      }
+      if (k <= 0) {
+        printf("Invalid the number of k-nearest neighbors (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+      if (fusion != "rrf" && fusion != "weighted") {
+        printf("invalid fusion should be expected rrf or weighted, name: %s\n", fusion.c_str());
+        throw std::invalid_argument("invalid fusion should be expected rrf or weighted, name: " + fusion);
+      }
+      if (!(denseWeight >= 0.0f && denseWeight <= 1.0f)) {
+        printf("Invalid the dense weight (must be in the range [0, 1]).\n");
+        throw std::invalid_argument("Invalid the dense weight (must be in the range [0, 1]).");
+      }
+
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilter(js_filterFn);
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, normalize_);
+
+      // both rankings are taken from a pool of ef candidates, the depth the dense search explores anyway
+      const size_t poolSize = std::max(static_cast<size_t>(k), index_->ef_);
+      std::priority_queue<std::pair<float, size_t>> dense = index_->searchKnn(mutableVec.data(), poolSize, filterFnCpp.get());
+      std::vector<std::pair<float, uint32_t>> denseHits(dense.size());
+      for (size_t i = denseHits.size(); i > 0; i--) {
+        // distances turned into scores, higher is better
+        denseHits[i - 1] = std::make_pair(-dense.top().first, static_cast<uint32_t>(dense.top().second));
+        dense.pop();
+      }
+      std::vector<std::pair<float, uint32_t>> sparseHits;
+      for (const auto& hit : sparseSearch(terms, weights, poolSize, filterFnCpp.get()))
+        sparseHits.emplace_back(hit.first, static_cast<uint32_t>(hit.second));
+
+      std::unordered_map<uint32_t, float> fused;
+      auto fuse = [&](const std::vector<std::pair<float, uint32_t>>& hits, float weight) {
+        if (hits.empty()) return;
+        const float best = hits.front().first;
+        const float range = best - hits.back().first;
+        for (size_t rank = 0; rank < hits.size(); rank++) {
+          float contribution;
+          if (fusion == "rrf") {
+            contribution = weight / (internal::RRF_RANK_CONSTANT + rank + 1);
+          } else {
+            contribution = weight * (range > 0 ? (hits[rank].first - hits.back().first) / range : 1.0f);
+          }
+          fused[hits[rank].second] += contribution;
+        }
+      };
+      fuse(denseHits, denseWeight);
+      fuse(sparseHits, 1.0f - denseWeight);
+
+      std::vector<std::pair<float, uint32_t>> top(fused.size());
+      std::transform(fused.begin(), fused.end(), top.begin(), [](const std::pair<const uint32_t, float>& entry) {
+        return std::make_pair(entry.second, entry.first);
+      });
+      std::sort(top.begin(), top.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+      });
+      top.resize(std::min(top.size(), static_cast<size_t>(k)));
+      return internal::scoredResultsToObject(top, "neighbors");
+    }
+
+    /// @brief Creates the native filter for a search filter argument, attribute predicates are evaluated into bitmaps
+    /// of the attribute rows of the matching labels, which the attribute store caches until the attributes change
+    std::unique_ptr<hnswlib::BaseFilterFunctor> createFilter(emscripten::val js_filter) {
+      if (js_filter.isNull() || js_filter.isUndefined() || js_filter.isArray() ||
+          js_filter.typeOf().as<std::string>() != "object" || js_filter.instanceof(emscripten::val::global("Uint32Array"))) {
+        return createFilterFunctor(js_filter);
+      }
+      hnswlib::AttributePredicate predicate = parseAttributePredicate(js_filter);
+      try {
+        return std::unique_ptr<hnswlib::BaseFilterFunctor>(new hnswlib::LabelBitmapFilter(attributes_.filter(predicate)));
+      }
+      catch (const std::runtime_error& e) {
+        printf("Invalid attribute predicate: %s\n", e.what());
+        throw std::invalid_argument("Invalid attribute predicate: " + std::string(e.what()));
+      }
+    }
+
+    /// @brief Sets the attributes of a label for attribute predicates, replacing the ones it had
+    /// @param label the label
+    /// @param attributes an object of numbers, strings (a tag) and arrays of strings (tags) by attribute name
+    void setAttributes(uint32_t label, emscripten::val attributes) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      const std::vector<std::string> names =
+        emscripten::vecFromJSArray<std::string>(emscripten::val::global("Object").call<emscripten::val>("keys", attributes));
+      // all values are read before the store is touched, so an invalid one leaves the old attributes in place
+      std::vector<hnswlib::AttributeValue> values(names.size());
+      for (size_t i = 0; i < names.size(); i++) {
+        emscripten::val value = attributes[names[i]];
+        values[i].name = names[i];
+        if (value.isNumber()) {
+          values[i].number = value.as<double>();
+        }
+        else if (value.isString()) {
+          values[i].is_tags = true;
+          values[i].tags.push_back(value.as<std::string>());
+        }
+        else if (value.isArray()) {
+          values[i].is_tags = true;
+          values[i].tags = emscripten::vecFromJSArray<std::string>(value);
+        }
+        else {
+          printf("Invalid the attribute %s (must be a number, a string or an array of strings).\n", names[i].c_str());
+          throw std::invalid_argument("Invalid the attribute " + names[i] + " (must be a number, a string or an array of strings).");
+        }
+      }
+      try {
+        attributes_.setAttributes(label, values);
+      }
+      catch (const std::exception& e) {
+        printf("Could not setAttributes: %s\n", e.what());
+        throw std::runtime_error("Could not setAttributes: " + std::string(e.what()));
+      }
+      queryCache_.invalidate();
+    }
+
+    void removeAttributes(uint32_t label) {
+      attributes_.removeLabel(label);
+      queryCache_.invalidate();
+    }
+
+    /// @brief Returns the attributes of a label as set with setAttributes, tags as arrays, or undefined if it has none
+    emscripten::val getAttributes(uint32_t label) const {
+      if (!attributes_.hasAttributes(label)) return emscripten::val::undefined();
+      emscripten::val attributes = emscripten::val::object();
+      attributes_.forEachAttribute(label,
+        [&](const std::string& name, double value) { attributes.set(name, value); },
+        [&](const std::string& name, const std::vector<std::string>& tags) {
+          emscripten::val values = emscripten::val::array();
+          for (size_t i = 0; i < tags.size(); i++) values.set(i, tags[i]);
+          attributes.set(name, values);
+        });
+      return attributes;
+    }
+
+    bool getSearchStatsEnabled() const {
+      return searchStatsEnabled_;
+    }
+
+    void setSearchStatsEnabled(bool enabled) {
+      searchStatsEnabled_ = enabled;
+    }
+
+    emscripten::val getSearchStats() const {
+      return searchStats_.toObject();
+    }
+
+    void resetSearchStats() {
+      searchStats_.reset();
+    }
+
     uint32_t getCurrentCount() const {
       if (index_ == nullptr) {
         printf("Search index has not been initialized, call `initIndex` in advance.\n");
@@ -812,6 +2090,229 @@ namespace emscripten {
         index_->setEf(static_cast<size_t>(ef));
       }
     }
+
+    uint32_t getEarlyStopPatience() const {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      return static_cast<uint32_t>(index_->early_stop_patience_);
+    }
+
+    void setEarlyStopPatience(uint32_t patience) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      index_->setEarlyStopPatience(static_cast<size_t>(patience));
+      queryCache_.invalidate();
+    }
+
+    void setFilterSelectivityThresholds(float bruteForceSelectivity, float twoHopSelectivity) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      index_->setFilterSelectivityThresholds(bruteForceSelectivity, twoHopSelectivity);
+      queryCache_.invalidate();
+    }
+
+    bool getLockFreeSearch() const {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      return index_->getLockFreeSearch();
+    }
+
+    /// @brief Lets searches run without locks while other threads add, update or delete points
+    /// @param enabled true to enable lock-free search, the index starts with it disabled
+    void setLockFreeSearch(bool enabled) {
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      index_->setLockFreeSearch(enabled);
+    }
+
+    uint32_t tuneEarlyStopPatience(float targetRecall, uint32_t k) {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+      if (targetRecall <= 0 || targetRecall > 1) {
+        printf("Invalid the target recall (must be in the range (0, 1]).\n");
+        throw std::invalid_argument("Invalid the target recall (must be in the range (0, 1]).");
+      }
+      if (k <= 0) {
+        printf("Invalid the number of k-nearest neighbors (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+      std::lock_guard<std::mutex> lock(mutate_lock_);
+      const size_t patience = index_->tuneEarlyStopPatience(targetRecall, static_cast<size_t>(k));
+      queryCache_.invalidate();
+      return static_cast<uint32_t>(patience);
+    }
+  };
+
+
+  /// @brief Many small indexes in one container, addressed by a partition key. Partitions are brute-force
+  /// until they reach the promote threshold and are then rebuilt as HNSW graphs sharing one set of buffers.
+  class PartitionedIndex {
+  public:
+    uint32_t dim_;
+    hnswlib::PartitionedIndex<float>* index_;
+    hnswlib::SpaceInterface<float>* space_;
+    /// @brief The space of a cosine index, nullptr for other spaces
+    hnswlib::CosineSpace* cosine_;
+
+    PartitionedIndex(const std::string& space_name, uint32_t dim)
+      : dim_(dim), index_(nullptr), space_(nullptr), cosine_(nullptr) {
+      if (space_name == "l2") {
+        space_ = new hnswlib::L2Space(static_cast<size_t>(dim_));
+      }
+      else if (space_name == "ip") {
+        space_ = new hnswlib::InnerProductSpace(static_cast<size_t>(dim_));
+      }
+      else if (space_name == "cosine") {
+        cosine_ = new hnswlib::CosineSpace(static_cast<size_t>(dim_));
+        space_ = cosine_;
+      }
+      else {
+        printf("invalid space should be expected l2, ip, or cosine, name: %s\n", space_name.c_str());
+        throw std::invalid_argument("invalid space should be expected l2, ip, or cosine, name: " + space_name);
+      }
+    }
+
+    ~PartitionedIndex() {
+      if (index_) delete index_;
+      if (space_) delete space_;
+    }
+
+    emscripten::val isIndexInitialized() {
+      return emscripten::val(index_ != nullptr);
+    }
+
+    /// @brief Creates an empty container
+    /// @param promote_threshold number of elements at which a partition is rebuilt as an HNSW graph
+    void initIndex(uint32_t promote_threshold, uint32_t m = 16, uint32_t ef_construction = 200, uint32_t random_seed = 100) {
+      if (index_) delete index_;
+      index_ = new hnswlib::PartitionedIndex<float>(space_, promote_threshold, m, ef_construction, random_seed);
+    }
+
+    void addPoint(uint32_t partition, const std::vector<float>& vec, uint32_t label) {
+      checkInitialized();
+      if (vec.size() != dim_) {
+        printf("Invalid vector size. Must be equal to the dimension of the space. The dimension of the space is %d.\n", dim_);
+        throw std::invalid_argument("Invalid vector size. Must be equal to the dimension of the space. The dimension of the space is " + std::to_string(this->dim_) + ".");
+      }
+
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, false);
+
+      try {
+        index_->addPoint(static_cast<hnswlib::partitionkey>(partition), reinterpret_cast<void*>(mutableVec.data()),
+          static_cast<hnswlib::labeltype>(label));
+      }
+      catch (const std::exception& e) {
+        printf("HNSWLIB ERROR: %s\n", e.what());
+        throw std::runtime_error("HNSWLIB ERROR: " + std::string(e.what()));
+      }
+    }
+
+    void removePoint(uint32_t partition, uint32_t label) {
+      checkInitialized();
+      try {
+        index_->removePoint(static_cast<hnswlib::partitionkey>(partition), static_cast<hnswlib::labeltype>(label));
+      }
+      catch (const std::exception& e) {
+        printf("HNSWLIB ERROR: %s\n", e.what());
+        throw std::runtime_error("HNSWLIB ERROR: " + std::string(e.what()));
+      }
+    }
+
+    /// @brief Searches a single partition, a missing partition gives empty results
+    emscripten::val searchKnn(uint32_t partition, const std::vector<float>& vec, uint32_t k, emscripten::val js_filterFn = emscripten::val::undefined()) {
+      checkInitialized();
+      if (vec.size() != dim_) {
+        printf("Invalid the given array length (expected %lu, but got %zu).\n", static_cast<unsigned long>(dim_), vec.size());
+        throw std::invalid_argument("Invalid the given array length (expected " + std::to_string(dim_) + ", but got " +
+          std::to_string(vec.size()) + ").");
+      }
+      if (k <= 0) {
+        printf("Invalid the number of k-nearest neighbors (must be a positive number).\n");
+        throw std::invalid_argument("Invalid the number of k-nearest neighbors (must be a positive number).");
+      }
+
+      std::unique_ptr<hnswlib::BaseFilterFunctor> filterFnCpp = createFilterFunctor(js_filterFn);
+
+      std::vector<float> mutableVec = internal::preparePoint(vec, cosine_, false);
+
+      std::priority_queue<std::pair<float, size_t>> knn =
+        index_->searchKnn(static_cast<hnswlib::partitionkey>(partition), reinterpret_cast<void*>(mutableVec.data()),
+          static_cast<size_t>(k), filterFnCpp.get());
+      std::vector<std::pair<float, size_t>> found(knn.size());
+      for (size_t i = found.size(); i > 0; i--) {
+        found[i - 1] = knn.top();
+        knn.pop();
+      }
+      return internal::rangeResultsToObject(found);
+    }
+
+    void dropPartition(uint32_t partition) {
+      checkInitialized();
+      index_->dropPartition(static_cast<hnswlib::partitionkey>(partition));
+    }
+
+    uint32_t getNumPartitions() {
+      checkInitialized();
+      return static_cast<uint32_t>(index_->getNumPartitions());
+    }
+
+    emscripten::val getPartitionKeys() {
+      checkInitialized();
+      const std::vector<hnswlib::partitionkey> keys = index_->getPartitionKeys();
+      emscripten::val result = emscripten::val::array();
+      for (size_t i = 0; i < keys.size(); i++) result.set(i, static_cast<uint32_t>(keys[i]));
+      return result;
+    }
+
+    uint32_t getPartitionSize(uint32_t partition) {
+      checkInitialized();
+      return static_cast<uint32_t>(index_->getPartitionSize(static_cast<hnswlib::partitionkey>(partition)));
+    }
+
+    bool isPartitionPromoted(uint32_t partition) {
+      checkInitialized();
+      return index_->isPromoted(static_cast<hnswlib::partitionkey>(partition));
+    }
+
+    uint32_t getPromoteThreshold() {
+      checkInitialized();
+      return static_cast<uint32_t>(index_->getPromoteThreshold());
+    }
+
+    uint32_t getEfSearch() {
+      checkInitialized();
+      return static_cast<uint32_t>(index_->getEf());
+    }
+
+    void setEfSearch(uint32_t ef) {
+      checkInitialized();
+      index_->setEf(static_cast<size_t>(ef));
+    }
+
+    uint32_t getNumDimensions() {
+      return dim_;
+    }
+
+  private:
+    void checkInitialized() {
+      if (index_ == nullptr) {
+        printf("Search index has not been initialized, call `initIndex` in advance.\n");
+        throw std::runtime_error("Search index has not been initialized, call `initIndex` in advance.");
+      }
+    }
   };
 
 
@@ -850,6 +2351,8 @@ namespace emscripten {
       .function("addPoint", &BruteforceSearch::addPoint)
       .function("removePoint", &BruteforceSearch::removePoint)
       .function("searchKnn", &BruteforceSearch::searchKnn)
+      .function("searchKnnBatch", &BruteforceSearch::searchKnnBatch)
+      .function("searchRange", &BruteforceSearch::searchRange)
       .function("getMaxElements", &BruteforceSearch::getMaxElements)
       .function("getCurrentCount", &BruteforceSearch::getCurrentCount)
       .function("getNumDimensions", &BruteforceSearch::getNumDimensions);
@@ -861,12 +2364,20 @@ namespace emscripten {
       .function("readIndexFromBuffer", &HierarchicalNSW::readIndexFromBuffer)
       .function("writeIndexToBuffer", &HierarchicalNSW::writeIndexToBuffer)
       .function("resizeIndex", &HierarchicalNSW::resizeIndex)
+      .function("setGrowthFactor", &HierarchicalNSW::setGrowthFactor)
+      .function("getGrowthFactor", &HierarchicalNSW::getGrowthFactor)
+      .function("compact", &HierarchicalNSW::compact)
       .function("getPoint", &HierarchicalNSW::getPoint)
       .function("addPoint", &HierarchicalNSW::addPoint)
       .function("addPoints", &HierarchicalNSW::addPoints)
       .function("addItems", &HierarchicalNSW::addItems)
+      .function("buildFromBatch", &HierarchicalNSW::buildFromBatch)
+      .function("updateItems", &HierarchicalNSW::updateItems)
+      .function("buildOffline", &HierarchicalNSW::buildOffline)
       .function("getUsedLabels", &HierarchicalNSW::getUsedLabels)
       .function("getDeletedLabels", &HierarchicalNSW::getDeletedLabels)
+      .function("getUsedLabelsView", &HierarchicalNSW::getUsedLabelsView)
+      .function("getDeletedLabelsView", &HierarchicalNSW::getDeletedLabelsView)
       .function("getMaxElements", &HierarchicalNSW::getMaxElements)
       .function("markDelete", &HierarchicalNSW::markDelete)
       .function("markDeleteItems", &HierarchicalNSW::markDeleteItems)
@@ -875,6 +2386,50 @@ namespace emscripten {
       .function("getNumDimensions", &HierarchicalNSW::getNumDimensions)
       .function("getEfSearch", &HierarchicalNSW::getEfSearch)
       .function("setEfSearch", &HierarchicalNSW::setEfSearch)
-      .function("searchKnn", &HierarchicalNSW::searchKnn);
+      .function("getEarlyStopPatience", &HierarchicalNSW::getEarlyStopPatience)
+      .function("setEarlyStopPatience", &HierarchicalNSW::setEarlyStopPatience)
+      .function("tuneEarlyStopPatience", &HierarchicalNSW::tuneEarlyStopPatience)
+      .function("getLockFreeSearch", &HierarchicalNSW::getLockFreeSearch)
+      .function("setLockFreeSearch", &HierarchicalNSW::setLockFreeSearch)
+      .function("setFilterSelectivityThresholds", &HierarchicalNSW::setFilterSelectivityThresholds)
+      .function("searchKnn", &HierarchicalNSW::searchKnn)
+      .function("setQueryCacheSize", &HierarchicalNSW::setQueryCacheSize)
+      .function("getQueryCacheSize", &HierarchicalNSW::getQueryCacheSize)
+      .function("getQueryCacheStats", &HierarchicalNSW::getQueryCacheStats)
+      .function("resetQueryCacheStats", &HierarchicalNSW::resetQueryCacheStats)
+      .function("searchRange", &HierarchicalNSW::searchRange)
+      .function("searchKnnDiverse", &HierarchicalNSW::searchKnnDiverse)
+      .function("setDocumentIds", &HierarchicalNSW::setDocumentIds)
+      .function("getDocumentId", &HierarchicalNSW::getDocumentId)
+      .function("searchDocuments", &HierarchicalNSW::searchDocuments)
+      .function("addSparsePoint", &HierarchicalNSW::addSparsePoint)
+      .function("removeSparsePoint", &HierarchicalNSW::removeSparsePoint)
+      .function("getSparseCount", &HierarchicalNSW::getSparseCount)
+      .function("searchSparse", &HierarchicalNSW::searchSparse)
+      .function("hybridSearch", &HierarchicalNSW::hybridSearch)
+      .function("setAttributes", &HierarchicalNSW::setAttributes)
+      .function("removeAttributes", &HierarchicalNSW::removeAttributes)
+      .function("getAttributes", &HierarchicalNSW::getAttributes)
+      .function("getSearchStatsEnabled", &HierarchicalNSW::getSearchStatsEnabled)
+      .function("setSearchStatsEnabled", &HierarchicalNSW::setSearchStatsEnabled)
+      .function("getSearchStats", &HierarchicalNSW::getSearchStats)
+      .function("resetSearchStats", &HierarchicalNSW::resetSearchStats);
+
+    emscripten::class_<PartitionedIndex>("PartitionedIndex")
+      .constructor<const std::string&, uint32_t>()
+      .function("initIndex", &PartitionedIndex::initIndex)
+      .function("isIndexInitialized", &PartitionedIndex::isIndexInitialized)
+      .function("addPoint", &PartitionedIndex::addPoint)
+      .function("removePoint", &PartitionedIndex::removePoint)
+      .function("searchKnn", &PartitionedIndex::searchKnn)
+      .function("dropPartition", &PartitionedIndex::dropPartition)
+      .function("getNumPartitions", &PartitionedIndex::getNumPartitions)
+      .function("getPartitionKeys", &PartitionedIndex::getPartitionKeys)
+      .function("getPartitionSize", &PartitionedIndex::getPartitionSize)
+      .function("isPartitionPromoted", &PartitionedIndex::isPartitionPromoted)
+      .function("getPromoteThreshold", &PartitionedIndex::getPromoteThreshold)
+      .function("getEfSearch", &PartitionedIndex::getEfSearch)
+      .function("setEfSearch", &PartitionedIndex::setEfSearch)
+      .function("getNumDimensions", &PartitionedIndex::getNumDimensions);
   }
 }
@@ -358,4 +358,65 @@ describe('BruteforceSearch', () => {
       });
     });
   });
+
+  describe('#searchKnnBatch', () => {
+    beforeAll(() => {
+      index = new hnswlib.BruteforceSearch('l2', 3);
+      index.initIndex(4);
+      index.addPoint([1, 2, 3], 0);
+      index.addPoint([1, 2, 5], 1);
+      index.addPoint([1, 2, 4], 2);
+      index.addPoint([1, 2, 9], 3);
+    });
+
+    it('throws an error if given an array with a length different from the number of dimensions', () => {
+      expect(() => {
+        index.searchKnnBatch([[1, 2, 3], [1, 2, 5, 4]], 2, undefined);
+      }).toThrow('Invalid the given array length (expected 3, but got 4).');
+    });
+
+    it('returns the same results as searchKnn for each query', () => {
+      const queries = [[1, 2, 5], [1, 2, 8], [1, 2, 3]];
+      const results = index.searchKnnBatch(queries, 2, undefined);
+      expect(results.length).toBe(3);
+      queries.forEach((query, i) => {
+        expect(results[i]).toMatchObject(index.searchKnn(query, 2, undefined));
+      });
+    });
+
+    it('returns filtered search results', () => {
+      const filter = (label: number) => label % 2 == 0;
+      expect(index.searchKnnBatch([[1, 2, 5]], 4, filter)).toMatchObject([{ distances: [1, 4], neighbors: [2, 0] }]);
+    });
+  });
+
+  describe('#searchRange', () => {
+    beforeAll(() => {
+      index = new hnswlib.BruteforceSearch('l2', 3);
+      index.initIndex(4);
+      index.addPoint([1, 2, 3], 0);
+      index.addPoint([1, 2, 5], 1);
+      index.addPoint([1, 2, 4], 2);
+      index.addPoint([1, 2, 9], 3);
+    });
+
+    it('throws an error if given a non-positive maximum number of results', () => {
+      expect(() => {
+        index.searchRange([1, 2, 5], 4, 0, undefined);
+      }).toThrow('Invalid the maximum number of results (must be a positive number).');
+    });
+
+    it('returns the points within the radius, closest first', () => {
+      const result = index.searchRange([1, 2, 5], 4, 10, undefined);
+      expect(result.distances).toBeInstanceOf(Float32Array);
+      expect(result.neighbors).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.neighbors)).toEqual([1, 2, 0]);
+      expect(Array.from(result.distances)).toEqual([0, 1, 4]);
+    });
+
+    it('keeps the closest points up to the maximum number of results', () => {
+      const result = index.searchRange([1, 2, 5], 100, 2, (label: number) => label !== 1);
+      expect(Array.from(result.neighbors)).toEqual([2, 0]);
+    });
+  });
 });
@@ -142,6 +142,57 @@ describe('hnswlib.HierarchicalNSW', () => {
     });
   });
 
+  describe('#setGrowthFactor', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.setGrowthFactor(2);
+      }).toThrow(/Search index has not been initialized, call `initIndex` in advance./);
+    });
+
+    it('throws an error if given an invalid growth factor', () => {
+      index.initIndex(2, ...defaultParams.initIndex);
+      expect(() => {
+        index.setGrowthFactor(0.5);
+      }).toThrow(/Invalid growth factor/);
+      expect(index.getGrowthFactor()).toBe(0);
+    });
+
+    it('grows the index instead of rejecting items', () => {
+      expect(() => {
+        index.addItems(
+          [
+            [1, 2, 3],
+            [2, 3, 4],
+            [3, 4, 5],
+          ],
+          false
+        );
+      }).toThrow(testErrors.indexSize);
+      index.setGrowthFactor(2);
+      expect(index.getGrowthFactor()).toBe(2);
+      const labels = index.addItems(
+        [
+          [1, 2, 3],
+          [2, 3, 4],
+          [3, 4, 5],
+        ],
+        false
+      );
+      expect(vectorToArray(labels)).toEqual([0, 1, 2]);
+      labels.delete();
+      expect(index.getMaxElements()).toBe(4);
+      index.addPoint([4, 5, 6], 3, false);
+      index.addPoint([5, 6, 7], 4, false);
+      expect(index.getMaxElements()).toBe(8);
+      expect(index.searchKnn([5, 6, 7], 2, undefined).neighbors).toEqual([4, 3]);
+    });
+  });
+
   describe('#getUsedLabels', () => {
     let index: HierarchicalNSW;
     beforeAll(() => {
@@ -205,6 +256,23 @@ describe('hnswlib.HierarchicalNSW', () => {
       expect(vectorToArray(deletedLabels)).toEqual(expect.arrayContaining([1, 3]));
       usedLabels.delete();
       deletedLabels.delete();
+      expect(Array.from(index.getUsedLabelsView()).sort()).toEqual([0, 2]);
+      expect(Array.from(index.getDeletedLabelsView()).sort()).toEqual([1, 3]);
+    });
+
+    it('addItems reuses deleted labels and then continues after the largest label', () => {
+      const items = [
+        [3, 4, 5],
+        [4, 5, 6],
+        [5, 6, 7],
+      ];
+      const labels = index.addItems(items, true);
+      expect(vectorToArray(labels).sort()).toEqual([1, 3, 4]);
+      labels.delete();
+      const deletedLabels = index.getDeletedLabels();
+      expect(vectorToArray(deletedLabels)).toEqual([]);
+      deletedLabels.delete();
+      expect(Array.from(index.getUsedLabelsView()).sort()).toEqual([0, 1, 2, 3, 4]);
     });
   });
 
@@ -371,6 +439,413 @@ describe('hnswlib.HierarchicalNSW', () => {
     });
   });
 
+  describe('#setEarlyStopPatience', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.setEarlyStopPatience(8);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('sets the patience and keeps search results', () => {
+      index.initIndex(3, ...defaultParams.initIndex);
+      index.addItems([[1, 2, 3], [2, 3, 4], [3, 4, 5], [4, 5, 6]], false);
+      expect(index.getEarlyStopPatience()).toBe(0);
+      index.setEarlyStopPatience(8);
+      expect(index.getEarlyStopPatience()).toBe(8);
+      expect(index.searchKnn([1, 2, 3], 1, undefined).neighbors).toEqual([0]);
+    });
+
+    it('tunes the patience for a target recall', () => {
+      index.setEfSearch(50);
+      const patience = index.tuneEarlyStopPatience(1.0, 1);
+      expect(index.getEarlyStopPatience()).toBe(patience);
+      expect(() => {
+        index.tuneEarlyStopPatience(1.5, 1);
+      }).toThrow('Invalid the target recall (must be in the range (0, 1]).');
+    });
+
+    it('disables early termination when k is not smaller than ef', () => {
+      index.setEfSearch(4);
+      index.setEarlyStopPatience(8);
+      expect(index.tuneEarlyStopPatience(0.5, 4)).toBe(0);
+      expect(index.getEarlyStopPatience()).toBe(0);
+    });
+  });
+
+  describe('#setQueryCacheSize', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+      index.initIndex(100, ...defaultParams.initIndex);
+      const items = Array.from({ length: 50 }, (_, i) => [i, i + 1, i + 2]);
+      index.addItems(items, false);
+    });
+
+    it('is disabled by default', () => {
+      expect(index.getQueryCacheSize()).toBe(0);
+      index.searchKnn([10, 11, 12], 3);
+      expect(index.getQueryCacheStats()).toMatchObject({ hits: 0, misses: 0, entries: 0 });
+    });
+
+    it('answers repeated searches from the cache', () => {
+      index.setQueryCacheSize(2);
+      const first = index.searchKnn([10, 11, 12], 3);
+      expect(index.searchKnn([10, 11, 12], 3)).toEqual(first);
+      index.searchKnn([10, 11, 12], 2);
+      index.searchKnn([10, 11, 12], 3, [11, 12]);
+      index.searchKnn([10, 11, 12], 3, (label: number) => label > 0);
+      expect(index.getQueryCacheStats()).toMatchObject({ hits: 1, misses: 3, entries: 2 });
+    });
+
+    it('is emptied when the index changes', () => {
+      const { generation } = index.getQueryCacheStats();
+      index.addPoint([10, 11, 12.1], 50, false);
+      expect(index.getQueryCacheStats()).toMatchObject({ entries: 0, generation: generation + 1 });
+      expect(index.searchKnn([10, 11, 11.9], 2).neighbors).toEqual([10, 50]);
+      index.markDelete(50);
+      expect(index.searchKnn([10, 11, 11.9], 2).neighbors).toEqual([10, 9]);
+      index.resetQueryCacheStats();
+      expect(index.getQueryCacheStats()).toMatchObject({ hits: 0, misses: 0, entries: 1 });
+    });
+  });
+
+  describe('#searchRange', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.searchRange([1, 2, 5], 4, 10, undefined);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('returns the points within the radius, closest first', () => {
+      index.initIndex(4, ...defaultParams.initIndex);
+      index.addPoints([[1, 2, 3], [1, 2, 5], [1, 2, 4], [1, 2, 9]], [0, 1, 2, 3], false);
+      const result = index.searchRange([1, 2, 5], 4, 10, undefined);
+      expect(result.neighbors).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.neighbors)).toEqual([1, 2, 0]);
+      expect(Array.from(result.distances)).toEqual([0, 1, 4]);
+    });
+
+    it('keeps the closest points up to the maximum number of results', () => {
+      const result = index.searchRange([1, 2, 5], 100, 2, (label: number) => label !== 1);
+      expect(Array.from(result.neighbors)).toEqual([2, 0]);
+    });
+  });
+
+  describe('#searchKnnDiverse', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.searchKnnDiverse([0, 0, 0], 2, 4, 0.5, undefined);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('throws an error if the relevance weight is out of range', () => {
+      index.initIndex(4, ...defaultParams.initIndex);
+      index.addPoints([[0, 0, 1], [0, 0, 1.1], [0, 2, 0], [0, 0, 5]], [0, 1, 2, 3], false);
+      expect(() => {
+        index.searchKnnDiverse([0, 0, 0], 2, 4, 1.5, undefined);
+      }).toThrow('Invalid the relevance weight (must be in the range [0, 1]).');
+    });
+
+    it('returns the nearest neighbors with a relevance weight of 1', () => {
+      const result = index.searchKnnDiverse([0, 0, 0], 2, 4, 1, undefined);
+      expect(result.neighbors).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.neighbors)).toEqual([0, 1]);
+    });
+
+    it('skips the neighbors close to those already picked', () => {
+      const result = index.searchKnnDiverse([0, 0, 0], 2, 4, 0.5, undefined);
+      expect(Array.from(result.neighbors)).toEqual([0, 2]);
+      expect(Array.from(result.distances)).toEqual([1, 4]);
+    });
+  });
+
+  describe('#hybridSearch', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 2);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.addSparsePoint([7], [1], 0);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('returns the points with the highest sparse scores', () => {
+      index.initIndex(4, ...defaultParams.initIndex);
+      index.addPoints([[0, 0], [1, 0], [2, 0], [3, 0]], [0, 1, 2, 3], false);
+      index.addSparsePoint([7], [2], 3);
+      index.addSparsePoint([7, 9], [1, 5], 2);
+      index.addSparsePoint([8], [1], 0);
+      expect(index.getSparseCount()).toBe(3);
+      const result = index.searchSparse([7], [1], 2, undefined);
+      expect(result.neighbors).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.neighbors)).toEqual([3, 2]);
+      expect(Array.from(result.scores)).toEqual([2, 1]);
+    });
+
+    it('throws an error if a weight is negative', () => {
+      expect(() => {
+        index.addSparsePoint([7], [-1], 1);
+      }).toThrow('Could not addSparsePoint: Sparse weights must be non-negative');
+    });
+
+    it('fuses the dense and sparse rankings', () => {
+      expect(Array.from(index.hybridSearch([0, 0], [7], [1], 3, 'rrf', 0.5, undefined).neighbors)).toEqual([3, 2, 0]);
+      expect(Array.from(index.hybridSearch([0, 0], [7], [1], 3, 'weighted', 0.2, undefined).neighbors)).toEqual([3, 0, 1]);
+      expect(() => {
+        index.hybridSearch([0, 0], [7], [1], 3, 'max' as 'rrf', 0.5, undefined);
+      }).toThrow('invalid fusion should be expected rrf or weighted, name: max');
+    });
+
+    it('keeps the sparse vectors in the saved index', () => {
+      const restored = new hnswlib.HierarchicalNSW('l2', 2);
+      restored.readIndexFromBuffer(index.writeIndexToBuffer());
+      expect(restored.getCurrentCount()).toBe(4);
+      expect(Array.from(restored.searchSparse([7], [1], 2, undefined).neighbors)).toEqual([3, 2]);
+    });
+
+    it('skips removed and deleted points', () => {
+      expect(index.removeSparsePoint(2)).toBe(true);
+      expect(index.removeSparsePoint(2)).toBe(false);
+      index.markDelete(3);
+      expect(Array.from(index.searchSparse([7, 8], [1, 1], 2, undefined).neighbors)).toEqual([0]);
+    });
+
+    it('skips the sparse vectors of labels that are not in the dense index', () => {
+      index.addSparsePoint([8], [5], 9);
+      expect(Array.from(index.searchSparse([8], [1], 2, undefined).neighbors)).toEqual([0]);
+      index.compact(false);
+      expect(Array.from(index.searchSparse([7, 8], [1, 1], 2, undefined).neighbors)).toEqual([0]);
+    });
+  });
+
+  describe('#searchDocuments', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.searchDocuments([[0, 0, 0]], 2, 'max', 1);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('assigns the data points to documents', () => {
+      index.initIndex(7, ...defaultParams.initIndex);
+      index.addPoints(
+        [[0, 0, 2], [0, 0, 3], [0, 0, 1], [0, 0, 10], [0, 0, 4], [0, 0, 5], [0, 0, 0]],
+        [0, 1, 2, 3, 4, 5, 6],
+        false
+      );
+      index.setDocumentIds([0, 1, 2, 3, 4, 5], [10, 10, 20, 20, 30, 30]);
+      expect(index.getDocumentId(3)).toBe(20);
+      expect(index.getDocumentId(6)).toBeUndefined();
+      expect(() => {
+        index.setDocumentIds([0, 1], [10]);
+      }).toThrow('Invalid the given array length (expected 2, but got 1).');
+    });
+
+    it('throws an error if the aggregation is invalid', () => {
+      expect(() => {
+        index.searchDocuments([[0, 0, 0]], 2, 'min' as 'max', 1);
+      }).toThrow('invalid aggregation should be expected max, sum, or maxsim, name: min');
+      expect(() => {
+        index.searchDocuments([[0, 0, 0], [0, 0, 10]], 2, 'max', 1);
+      }).toThrow('Invalid the number of query vectors (only maxsim accepts more than one).');
+    });
+
+    it('scores each document by its closest data point', () => {
+      const result = index.searchDocuments([[0, 0, 0]], 2, 'max', 1);
+      expect(result.documents).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.documents)).toEqual([20, 10]);
+      expect(result.scores[0]).toBeCloseTo(1 / 2, 6);
+      expect(result.scores[1]).toBeCloseTo(1 / 5, 6);
+    });
+
+    it('scores each document by the sum of its closest data points', () => {
+      const result = index.searchDocuments([[0, 0, 0]], 3, 'sum', 2);
+      expect(Array.from(result.documents)).toEqual([20, 10, 30]);
+      expect(result.scores[0]).toBeCloseTo(1 / 2 + 1 / 101, 6);
+      expect(result.scores[1]).toBeCloseTo(1 / 5 + 1 / 10, 6);
+      expect(result.scores[2]).toBeCloseTo(1 / 17 + 1 / 26, 6);
+    });
+
+    it('ranks a document with more close data points above one with a single closer data point', () => {
+      const documents = new hnswlib.HierarchicalNSW('l2', 3);
+      documents.initIndex(4, ...defaultParams.initIndex);
+      documents.addPoints([[0, 0, 1], [0, 0, 2], [0, 2, 0], [2, 0, 0]], [0, 1, 2, 3], false);
+      documents.setDocumentIds([0, 1, 2, 3], [1, 2, 2, 2]);
+      const result = documents.searchDocuments([[0, 0, 0]], 2, 'sum', 3);
+      expect(Array.from(result.documents)).toEqual([2, 1]);
+      expect(result.scores[0]).toBeCloseTo(3 / 5, 6);
+      expect(result.scores[1]).toBeCloseTo(1 / 2, 6);
+    });
+
+    it('scores each document by the sum of the closest data point to each query vector', () => {
+      const result = index.searchDocuments([[0, 0, 0], [0, 0, 10]], 3, 'maxsim', 1);
+      expect(Array.from(result.documents)).toEqual([20, 10, 30]);
+      expect(result.scores[0]).toBeCloseTo(1 / 2 + 1, 6);
+      expect(result.scores[1]).toBeCloseTo(1 / 5 + 1 / 50, 6);
+      expect(result.scores[2]).toBeCloseTo(1 / 17 + 1 / 26, 6);
+    });
+  });
+
+  describe('#setAttributes', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.setAttributes(0, { price: 1 });
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('sets the attributes of a data point', () => {
+      index.initIndex(100, ...defaultParams.initIndex);
+      const items = Array.from({ length: 100 }, (_, i) => [i, i + 1, i + 2]);
+      index.addItems(items, false);
+      for (let i = 0; i < 100; i++) {
+        index.setAttributes(i, { price: i, color: i % 2 === 0 ? 'red' : ['blue', 'green'] });
+      }
+      expect(index.getAttributes(3)).toEqual({ price: 3, color: ['blue', 'green'] });
+      expect(() => {
+        index.setAttributes(0, { color: 'blue', price: 'cheap' });
+      }).toThrow('Could not setAttributes: Attribute price holds numbers');
+      expect(index.getAttributes(0)).toEqual({ price: 0, color: ['red'] });
+    });
+
+    it('filters the search by an attribute predicate', () => {
+      const filter = { and: [{ attribute: 'price', min: 40, max: 60 }, { attribute: 'color', tags: 'red' }] };
+      expect(index.searchKnn([49.8, 50.8, 51.8], 3, filter).neighbors).toEqual([50, 48, 52]);
+      expect(index.searchKnn([49.8, 50.8, 51.8], 2, { not: { attribute: 'price', max: 95 } }).neighbors).toEqual([96, 97]);
+    });
+
+    it('keeps the attributes in the saved index', () => {
+      index.removeAttributes(50);
+      expect(index.getAttributes(50)).toBeUndefined();
+      const restored = new hnswlib.HierarchicalNSW('l2', 3);
+      restored.readIndexFromBuffer(index.writeIndexToBuffer());
+      expect(restored.getAttributes(52)).toEqual({ price: 52, color: ['red'] });
+      const filter = { or: [{ attribute: 'price', min: 49, max: 51 }, { attribute: 'color', tags: ['purple'] }] };
+      expect(restored.searchKnn([51, 52, 53], 3, filter).neighbors).toEqual([51, 49]);
+    });
+
+    it('sets the attributes of a large label', () => {
+      index.setAttributes(4000000000, { price: 1 });
+      expect(index.getAttributes(4000000000)).toEqual({ price: 1 });
+      index.removeAttributes(4000000000);
+      expect(index.getAttributes(4000000000)).toBeUndefined();
+    });
+  });
+
+  describe('#setFilterSelectivityThresholds', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+      index.initIndex(100, ...defaultParams.initIndex);
+      const items = Array.from({ length: 100 }, (_, i) => [i, i + 1, i + 2]);
+      index.addItems(items, false);
+    });
+
+    it('accepts an array of allowed labels as filter', () => {
+      expect(index.searchKnn([50, 51, 52], 2, [3, 70, 98]).neighbors).toEqual([70, 3]);
+      expect(index.searchKnn([50, 51, 52], 2, new Uint32Array([3, 70, 98])).neighbors).toEqual([70, 3]);
+    });
+
+    it('returns the same results for every strategy', () => {
+      const filter = (label: number) => label % 10 === 0;
+      expect(index.searchKnn([51, 52, 53], 3, filter).neighbors).toEqual([50, 60, 40]);
+      index.setFilterSelectivityThresholds(0, 1);
+      expect(index.searchKnn([51, 52, 53], 3, filter).neighbors).toEqual([50, 60, 40]);
+      index.setFilterSelectivityThresholds(1, 1);
+      expect(index.searchKnn([51, 52, 53], 3, filter).neighbors).toEqual([50, 60, 40]);
+      index.setFilterSelectivityThresholds(0, 0);
+      expect(index.searchKnn([51, 52, 53], 3, filter).neighbors).toEqual([50, 60, 40]);
+    });
+  });
+
+  describe('#setLockFreeSearch', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.setLockFreeSearch(true);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('keeps search results while points are added, updated and deleted', () => {
+      index.initIndex(100, ...defaultParams.initIndex);
+      expect(index.getLockFreeSearch()).toBe(false);
+      index.setLockFreeSearch(true);
+      expect(index.getLockFreeSearch()).toBe(true);
+      index.addItems(Array.from({ length: 50 }, (_, i) => [i, i + 1, i + 2]), false);
+      expect(index.searchKnn([10.4, 11.4, 12.4], 2, undefined).neighbors).toEqual([10, 11]);
+      index.addPoint([100, 101, 102], 10, false);
+      index.markDelete(9);
+      expect(index.searchKnn([10.4, 11.4, 12.4], 2, undefined).neighbors).toEqual([11, 12]);
+      expect(Array.from(index.searchRange([20.1, 21.1, 22.1], 3, 10, undefined).neighbors)).toEqual([20, 21]);
+      index.setLockFreeSearch(false);
+      expect(index.searchKnn([10.4, 11.4, 12.4], 2, undefined).neighbors).toEqual([11, 12]);
+    });
+  });
+
+  describe('#getSearchStats', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+      index.initIndex(3, ...defaultParams.initIndex);
+      index.addItems([[1, 2, 3], [2, 3, 4], [3, 4, 5]], false);
+    });
+
+    it('does not report stats unless enabled', () => {
+      expect(index.getSearchStatsEnabled()).toBe(false);
+      expect(index.searchKnn([1, 2, 3], 1, undefined).stats).toBeUndefined();
+      expect(index.getSearchStats().queries).toBe(0);
+    });
+
+    it('reports per-query stats and aggregates them', () => {
+      index.setSearchStatsEnabled(true);
+      index.markDelete(1);
+      const result = index.searchKnn([1, 2, 3], 1, (label: number) => label !== 2);
+      expect(result.neighbors).toEqual([0]);
+      expect(result.stats?.visited).toBe(3);
+      expect(result.stats?.deletedSkips).toBe(1);
+      expect(result.stats?.filterRejections).toBe(1);
+      expect(result.stats?.levelHops.length).toBeGreaterThan(0);
+      const stats = index.getSearchStats();
+      expect(stats.queries).toBe(1);
+      expect(stats.visited).toBe(3);
+      expect(stats.latencyHistogram.reduce((a, b) => a + b, 0)).toBe(1);
+    });
+
+    it('resets the aggregated stats', () => {
+      index.resetSearchStats();
+      expect(index.getSearchStats().queries).toBe(0);
+    });
+  });
+
   describe('#addPoint', () => {
     let index: HierarchicalNSW;
     beforeAll(() => {
@@ -430,6 +905,123 @@ describe('hnswlib.HierarchicalNSW', () => {
     });
   });
 
+  describe('#buildFromBatch', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.buildFromBatch([1, 2, 3], [0]);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('throws an error if the array length does not match the number of labels', () => {
+      index.initIndex(10, ...defaultParams.initIndex);
+      expect(() => {
+        index.buildFromBatch([1, 2, 3, 4], [0]);
+      }).toThrow(/Invalid the given array length/);
+    });
+
+    it('adds all points and finds them', () => {
+      const items: number[] = [];
+      const labels: number[] = [];
+      for (let i = 0; i < 50; i++) {
+        items.push(i, i + 1, i + 2);
+        labels.push(100 + i);
+      }
+      index.initIndex(10, ...defaultParams.initIndex);
+      expect(() => {
+        index.buildFromBatch(items, labels);
+      }).toThrow(/The number of elements exceeds the specified limit/);
+
+      index.initIndex(50, ...defaultParams.initIndex);
+      index.buildFromBatch(items, labels);
+      expect(index.getCurrentCount()).toBe(50);
+      expect(index.searchKnn([20.2, 21.2, 22.2], 3, undefined).neighbors).toEqual([120, 121, 119]);
+      expect(Array.from(index.getUsedLabelsView()).sort()).toEqual(labels);
+    });
+
+    it('throws an error if the index is not empty', () => {
+      expect(() => {
+        index.buildFromBatch([1, 2, 3], [0]);
+      }).toThrow(/buildFromBatch can only be used on an empty index/);
+    });
+  });
+
+  describe('#updateItems', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.updateItems([0], [1, 2, 3], 1);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('throws an error if a label is not in the index', () => {
+      index.initIndex(50, ...defaultParams.initIndex);
+      index.addItems(Array.from({ length: 50 }, (_, i) => [i, i + 1, i + 2]), false);
+      expect(() => {
+        index.updateItems([3, 70], [1, 2, 3, 4, 5, 6], 1);
+      }).toThrow(/Label not found/);
+      expect(() => {
+        index.updateItems([3], [1, 2, 3], 1.5);
+      }).toThrow('Invalid the repair probability (must be in the range [0, 1]).');
+      expect(index.getPoint(3)).toMatchObject([3, 4, 5]);
+    });
+
+    it('moves the points and finds them at their new place', () => {
+      index.updateItems([3, 4, 5], [100, 101, 102, 101, 102, 103, 102, 103, 104], 1);
+      expect(index.getPoint(4)).toMatchObject([101, 102, 103]);
+      expect(index.searchKnn([101.2, 102.2, 103.2], 3, undefined).neighbors).toEqual([4, 5, 3]);
+      expect(index.searchKnn([4.2, 5.2, 6.2], 2, undefined).neighbors).toEqual([6, 2]);
+    });
+  });
+
+  describe('#buildOffline', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.buildOffline([1, 2, 3], [0], 10);
+      }).toThrow('Search index has not been initialized, call `initIndex` in advance.');
+    });
+
+    it('throws an error if a label is given twice', () => {
+      index.initIndex(10, ...defaultParams.initIndex);
+      expect(() => {
+        index.buildOffline([1, 2, 3, 4, 5, 6], [0, 0], 10);
+      }).toThrow(/The labels given to the offline builder must be unique/);
+      expect(index.getCurrentCount()).toBe(0);
+    });
+
+    it('builds an index that can be saved and extended', () => {
+      const items: number[] = [];
+      const labels: number[] = [];
+      for (let i = 0; i < 2000; i++) {
+        items.push(i, i + 1, i + 2);
+        labels.push(i);
+      }
+      index.initIndex(2000, ...defaultParams.initIndex);
+      index.buildOffline(items, labels, 10);
+      expect(index.getCurrentCount()).toBe(2000);
+      expect(index.searchKnn([1500.2, 1501.2, 1502.2], 3, undefined).neighbors).toEqual([1500, 1501, 1499]);
+
+      const restored = new hnswlib.HierarchicalNSW('l2', 3);
+      restored.readIndexFromBuffer(index.writeIndexToBuffer());
+      restored.resizeIndex(2001);
+      restored.addPoint([2000.2, 2001.2, 2002.2], 2000, false);
+      expect(restored.searchKnn([2000, 2001, 2002], 2, undefined).neighbors).toEqual([2000, 1999]);
+    });
+  });
+
   describe('#markDelete', () => {
     let index: HierarchicalNSW;
     beforeAll(() => {
@@ -517,6 +1109,69 @@ describe('hnswlib.HierarchicalNSW', () => {
     });
   });
 
+  describe('#compact', () => {
+    let index: HierarchicalNSW;
+    beforeAll(() => {
+      index = new hnswlib.HierarchicalNSW('l2', 3);
+    });
+
+    it('throws an error if called before the index is initialized', () => {
+      expect(() => {
+        index.compact(false);
+      }).toThrow(testErrors.indexNotInitalized);
+    });
+
+    it('removes deleted elements and keeps the remaining ones searchable', () => {
+      index.initIndex(4, ...defaultParams.initIndex);
+      const vec1 = arrayToVector([1, 2, 3], new hnswlib.VectorFloat());
+      index.addPoint(vec1, 0, false);
+      vec1.delete();
+      const vec2 = arrayToVector([1, 2, 4], new hnswlib.VectorFloat());
+      index.addPoint(vec2, 1, false);
+      vec2.delete();
+      const vec3 = arrayToVector([1, 2, 5], new hnswlib.VectorFloat());
+      index.addPoint(vec3, 2, false);
+      vec3.delete();
+      index.markDelete(1);
+      expect(index.compact(false)).toBe(0);
+      expect(index.getCurrentCount()).toBe(2);
+      const deletedLabels = index.getDeletedLabels();
+      expect(vectorToArray(deletedLabels)).toEqual([]);
+      deletedLabels.delete();
+      const query = arrayToVector([1, 2, 4], new hnswlib.VectorFloat());
+      expect(index.searchKnn(query, 2, undefined).neighbors).toEqual(expect.arrayContaining([0, 2]));
+      query.delete();
+      expect(index.getPoint(2)).toMatchObject([1, 2, 5]);
+    });
+
+    it('shrinks the maximum number of elements when requested', () => {
+      expect(index.compact(true)).toBeGreaterThan(0);
+      expect(index.getMaxElements()).toBe(2);
+    });
+
+    it('does not hand out the removed labels again, also after saving', () => {
+      index.initIndex(4, ...defaultParams.initIndex);
+      index.setGrowthFactor(2);
+      const added = index.addItems([[1, 2, 3], [1, 2, 4], [1, 2, 5]], false);
+      expect(vectorToArray(added)).toEqual([0, 1, 2]);
+      added.delete();
+      index.setAttributes(2, { price: 2 });
+      index.addSparsePoint([7], [1], 2);
+      index.markDelete(2);
+      index.compact(false);
+      expect(index.getAttributes(2)).toBeUndefined();
+      expect(index.getSparseCount()).toBe(0);
+      const restored = new hnswlib.HierarchicalNSW('l2', 3);
+      restored.readIndexFromBuffer(index.writeIndexToBuffer());
+      restored.setGrowthFactor(2);
+      for (const target of [index, restored]) {
+        const labels = target.addItems([[1, 2, 6]], false);
+        expect(vectorToArray(labels)).toEqual([3]);
+        labels.delete();
+      }
+    });
+  });
+
   describe('#searchKnn', () => {
     describe('when metric space is "l2"', () => {
       let index: HierarchicalNSW;
@@ -653,6 +1308,16 @@ describe('hnswlib.HierarchicalNSW', () => {
         expect(res.distances[0]).toBeCloseTo(1.0 - 20.0 / (Math.sqrt(14) * Math.sqrt(30)), 6);
         expect(res.distances[1]).toBeCloseTo(1.0 - 28.0 / (Math.sqrt(29) * Math.sqrt(30)), 6);
       });
+
+      it('keeps the original vectors', () => {
+        expect(index.getPoint(1)).toMatchObject([2, 3, 4]);
+        const restored = new hnswlib.HierarchicalNSW('cosine', 3);
+        restored.readIndexFromBuffer(index.writeIndexToBuffer());
+        expect(restored.getPoint(2)).toMatchObject([3, 4, 5]);
+        const vec = arrayToVector([1, 2, 5], new hnswlib.VectorFloat());
+        expect(restored.searchKnn(vec, 2, undefined).neighbors).toMatchObject([0, 1]);
+        vec.delete();
+      });
     });
 
     describe('when filter function is given', () => {
@@ -0,0 +1,93 @@
+import { HnswlibModule, PartitionedIndex, loadHnswlib } from '~lib/index';
+import { testErrors } from '~test/testHelpers';
+
+describe('PartitionedIndex', () => {
+  let hnswlib: HnswlibModule;
+  let index: PartitionedIndex;
+
+  beforeAll(async () => {
+    // Instantiate the Emscripten module
+    hnswlib = await loadHnswlib();
+  });
+
+  describe('#constructor', () => {
+    it('throws an error if given a String that is neither "l2", "ip", nor "cosine" to first argument', () => {
+      expect(() => {
+        // @ts-expect-error for testing
+        new hnswlib.PartitionedIndex('coss', 3);
+      }).toThrow(/invalid space should be expected l2, ip, or cosine/);
+    });
+  });
+
+  describe('#initIndex', () => {
+    beforeAll(() => {
+      index = new hnswlib.PartitionedIndex('l2', 3);
+    });
+
+    it('throws if called before the index is initialized', () => {
+      expect(index.isIndexInitialized()).toBe(false);
+      expect(() => index.addPoint(0, [1, 2, 3], 0)).toThrow(testErrors.indexNotInitalized);
+    });
+
+    it('stores the promote threshold', () => {
+      index.initIndex(50, 16, 200, 1);
+      expect(index.isIndexInitialized()).toBe(true);
+      expect(index.getPromoteThreshold()).toBe(50);
+      expect(index.getNumPartitions()).toBe(0);
+    });
+  });
+
+  describe('#searchKnn', () => {
+    beforeAll(() => {
+      index = new hnswlib.PartitionedIndex('l2', 3);
+      index.initIndex(50, 16, 200, 1);
+      for (let i = 0; i < 100; i++) {
+        index.addPoint(1, [i, i + 1, i + 2], i);
+      }
+      for (let i = 0; i < 10; i++) {
+        index.addPoint(2, [-i, -i - 1, -i - 2], i);
+      }
+    });
+
+    it('keeps small partitions flat and promotes large ones', () => {
+      expect(index.getNumPartitions()).toBe(2);
+      expect(index.getPartitionKeys().sort()).toEqual([1, 2]);
+      expect(index.getPartitionSize(1)).toBe(100);
+      expect(index.getPartitionSize(2)).toBe(10);
+      expect(index.isPartitionPromoted(1)).toBe(true);
+      expect(index.isPartitionPromoted(2)).toBe(false);
+    });
+
+    it('searches only within the given partition', () => {
+      const result = index.searchKnn(1, [50.2, 51.2, 52.2], 2, undefined);
+      expect(result.distances).toBeInstanceOf(Float32Array);
+      expect(result.neighbors).toBeInstanceOf(Uint32Array);
+      expect(Array.from(result.neighbors)).toEqual([50, 51]);
+      expect(Array.from(index.searchKnn(2, [50.2, 51.2, 52.2], 2, undefined).neighbors)).toEqual([0, 1]);
+    });
+
+    it('applies the filter within the partition', () => {
+      expect(Array.from(index.searchKnn(1, [50, 51, 52], 2, [3, 70]).neighbors)).toEqual([70, 3]);
+      expect(Array.from(index.searchKnn(2, [0, 0, 0], 1, (label: number) => label > 5).neighbors)).toEqual([6]);
+    });
+
+    it('returns empty results for a missing partition', () => {
+      expect(index.searchKnn(3, [50, 51, 52], 2, undefined).neighbors).toHaveLength(0);
+    });
+
+    it('removes points from flat and promoted partitions', () => {
+      index.removePoint(1, 50);
+      index.removePoint(2, 0);
+      expect(index.getPartitionSize(1)).toBe(99);
+      expect(index.getPartitionSize(2)).toBe(9);
+      expect(index.searchKnn(1, [50, 51, 52], 1, undefined).neighbors).not.toContain(50);
+      expect(() => index.removePoint(2, 0)).toThrow(/Label not found/);
+    });
+
+    it('drops a partition', () => {
+      index.dropPartition(2);
+      expect(index.getNumPartitions()).toBe(1);
+      expect(index.getPartitionSize(2)).toBe(0);
+    });
+  });
+});
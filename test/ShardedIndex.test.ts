@@ -0,0 +1,97 @@
+import {
+  defaultParams,
+  HierarchicalNSW,
+  HnswlibModule,
+  instantiateHnswlib,
+  loadHnswlib,
+  mergeSearchResults,
+  ShardedIndex,
+} from '~lib/index';
+
+describe('ShardedIndex', () => {
+  let hnswlib: HnswlibModule;
+
+  const createShards = (lib: HnswlibModule, numShards: number): HierarchicalNSW[] => {
+    const shards: HierarchicalNSW[] = [];
+    for (let i = 0; i < numShards; i++) {
+      const shard = new lib.HierarchicalNSW('l2', 3);
+      shard.initIndex(100, ...defaultParams.initIndex);
+      shards.push(shard);
+    }
+    return shards;
+  };
+
+  beforeAll(async () => {
+    hnswlib = await loadHnswlib();
+  });
+
+  describe('#constructor', () => {
+    it('throws an error if no shards are given', () => {
+      expect(() => new ShardedIndex([])).toThrow(/Invalid the number of shards/);
+    });
+  });
+
+  describe('#mergeSearchResults', () => {
+    it('merges sorted results into the closest ones', () => {
+      const merged = mergeSearchResults(
+        [
+          { distances: [1, 4], neighbors: [10, 40] },
+          { distances: [], neighbors: [] },
+          { distances: [2, 3], neighbors: [20, 30] },
+        ],
+        3
+      );
+      expect(merged).toEqual({ distances: [1, 2, 3], neighbors: [10, 20, 30] });
+    });
+  });
+
+  describe('#searchKnn', () => {
+    it('returns the same neighbors as a single index', async () => {
+      const single = new hnswlib.HierarchicalNSW('l2', 3);
+      single.initIndex(100, ...defaultParams.initIndex);
+      const index = new ShardedIndex(createShards(hnswlib, 3), 'hash');
+      for (let i = 0; i < 60; i++) {
+        await index.addPoint([i, i + 1, i + 2], i);
+        single.addPoint([i, i + 1, i + 2], i, false);
+      }
+      expect(await index.getCurrentCount()).toBe(60);
+
+      const result = await index.searchKnn([30.2, 31.2, 32.2], 3);
+      expect(result.neighbors).toEqual([30, 31, 29]);
+      expect(result.neighbors).toEqual(single.searchKnn([30.2, 31.2, 32.2], 3, undefined).neighbors);
+    });
+
+    it('skips deleted points and applies the filter on every shard', async () => {
+      const index = new ShardedIndex(createShards(hnswlib, 2), 'round-robin');
+      for (let i = 0; i < 20; i++) {
+        await index.addPoint([i, i, i], i);
+      }
+      await index.markDelete(10);
+      expect((await index.searchKnn([10.2, 10.2, 10.2], 2)).neighbors).toEqual([11, 9]);
+      expect((await index.searchKnn([11, 11, 11], 2, [3, 17])).neighbors).toEqual([17, 3]);
+    });
+  });
+
+  describe('#saveShard', () => {
+    it('restores a shard in a separate module instance', async () => {
+      const index = new ShardedIndex(createShards(hnswlib, 2), 'round-robin');
+      for (let i = 0; i < 20; i++) {
+        await index.addPoint([i, i, i], i);
+      }
+      const buffer = await index.saveShard(1);
+
+      const otherLib = await instantiateHnswlib();
+      const restored = new ShardedIndex([index.getShard(0), ...createShards(otherLib, 1)], 'round-robin');
+      await restored.loadShard(1, buffer);
+      expect(restored.shardOf(1)).toBe(1);
+      expect((await restored.searchKnn([0.9, 0.9, 0.9], 1)).neighbors).toEqual([1]);
+      await restored.markDelete(1);
+      expect((await restored.searchKnn([0.9, 0.9, 0.9], 1)).neighbors).toEqual([0]);
+    });
+
+    it('throws an error for an invalid shard', async () => {
+      const index = new ShardedIndex(createShards(hnswlib, 2));
+      await expect(index.saveShard(2)).rejects.toThrow(/Invalid shard/);
+    });
+  });
+});